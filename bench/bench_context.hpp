@@ -0,0 +1,42 @@
+#ifndef BENCH_CONTEXT_H
+#define BENCH_CONTEXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstdlib>
+
+// Makes a hidden 3.3 core context current for the benchmarks: with software rendering, GLFW's null platform with an
+// OSMesa context where GLFW supports it (3.4+), otherwise a hidden window with Mesa's llvmpipe forced on. Returns
+// NULL if no context could be created.
+inline GLFWwindow *CreateBenchContext(bool software, const char *title)
+{
+#ifndef _WIN32
+    if (software)
+        setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+#endif
+#ifdef GLFW_PLATFORM_NULL
+    if (software && glfwPlatformSupported(GLFW_PLATFORM_NULL))
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit())
+        return NULL;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+#ifdef GLFW_PLATFORM_NULL
+    if (glfwGetPlatform() == GLFW_PLATFORM_NULL)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+    // everything is rendered into offscreen targets, the window only carries the context
+    GLFWwindow *window = glfwCreateWindow(64, 64, title, NULL, NULL);
+    if (window)
+        glfwMakeContextCurrent(window);
+    return window;
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef BENCH_RENDERER_H
+#define BENCH_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.hpp"
+#include "cpu_lighting.hpp"
+#include "frame_arena.hpp"
+#include "frame_graph.hpp"
+#include "gl_state.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+#include "shader_variants.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Light slots of the viewer's shaders
+const unsigned int BENCH_MAX_LIGHTS = 10;
+
+enum BenchShading
+{
+    BENCH_FORWARD,
+    BENCH_DEFERRED,
+    BENCH_DEFERRED_CPU // geometry pass on GL, lighting on the CPU (CpuLighting)
+};
+
+// How the lighting shader compares to the CPU reference
+struct BenchLightingCheck
+{
+    float MaxError;          // largest difference of a color channel
+    unsigned int Mismatches; // pixels differing by more than the tolerance
+    unsigned int Pixels;
+};
+
+// What a benchmark frame draws
+struct BenchFrame
+{
+    std::vector<glm::mat4> Transforms;
+    std::vector<Model*> Models; // one per transform
+    std::vector<glm::vec3> LightPositions;
+    std::vector<glm::vec3> LightColors;
+};
+
+// Renders benchmark frames offscreen with the viewer's shaders, forward (base shader) or deferred (geometry and
+// lighting passes, the lighting either as the shader or on the CPU), at a fixed resolution. Every instance is drawn: no culling, streaming or dynamic resolution,
+// so that configurations compare like for like.
+class BenchRenderer
+{
+    public:
+        BenchRenderer()
+            : shading(BENCH_FORWARD), width(0), height(0), baseShader(0), lightingPassShader(0), frame(0), quadVAO(0), quadVBO(0)
+        {
+        }
+
+        ~BenchRenderer()
+        {
+            GLState().DeleteVertexArray(quadVAO);
+            GLState().DeleteBuffer(quadVBO);
+        }
+
+        // shaderDirectory holds the viewer's shaders, e.g. "../src/shaders/"
+        void Init(const std::string &shaderDirectory)
+        {
+            // the lit passes are specialised for the light count, like in the viewer
+            baseShaderVariants.Init(shaderDirectory + "base_shader.vs", shaderDirectory + "base_shader.fs");
+            geometryPassShader = Shader((shaderDirectory + "geometry_pass.vs").c_str(), (shaderDirectory + "geometry_pass.fs").c_str());
+            lightingPassShaderVariants.Init(shaderDirectory + "lighting_pass.vs", shaderDirectory + "lighting_pass.fs");
+            lightingPassShaderVariants.OnCompile([](Shader &shader)
+            {
+                shader.SetInteger("gPosition", 0);
+                shader.SetInteger("gNormal", 1);
+                shader.SetInteger("gAlbedoSpec", 2);
+                shader.SetVector2f("uvScale", 1.0f, 1.0f);
+            });
+        }
+
+        // the CPU lighting of BENCH_DEFERRED_CPU, e.g. to set its thread count
+        CpuLighting &Lighting()
+        {
+            return cpuLighting;
+        }
+
+        // rebuilds the render targets and passes for a mode and resolution
+        void Configure(BenchShading shadingMode, int renderWidth, int renderHeight)
+        {
+            shading = shadingMode;
+            width = renderWidth;
+            height = renderHeight;
+            frameGraph.Reset();
+            // lit scene in the viewer's format
+            color = frameGraph.CreateTexture("color", targetDesc(GL_RGBA16F));
+            FrameGraphResource depth = frameGraph.CreateTexture("depth", targetDesc(GL_DEPTH_COMPONENT24));
+            if (shading == BENCH_FORWARD)
+            {
+                unsigned int forwardPass = frameGraph.AddPass("forward shading", [this]() { renderForward(); });
+                frameGraph.Write(forwardPass, color);
+                frameGraph.Write(forwardPass, depth);
+                frameGraph.SetSideEffect(forwardPass);
+            }
+            else
+            {
+                gPosition = frameGraph.CreateTexture("gPosition", targetDesc(GL_RGB16F));
+                gNormal = frameGraph.CreateTexture("gNormal", targetDesc(GL_RGB16F));
+                gAlbedoSpec = frameGraph.CreateTexture("gAlbedoSpec", targetDesc(GL_RGBA8));
+                unsigned int geometryPass = frameGraph.AddPass("geometry", [this]() { renderGeometry(); });
+                frameGraph.Write(geometryPass, gPosition);
+                frameGraph.Write(geometryPass, gNormal);
+                frameGraph.Write(geometryPass, gAlbedoSpec);
+                frameGraph.Write(geometryPass, depth);
+                unsigned int lightingPass = shading == BENCH_DEFERRED_CPU ?
+                    frameGraph.AddPass("cpu lighting", [this]() { renderCpuLighting(); }) :
+                    frameGraph.AddPass("lighting", [this]() { renderLighting(); });
+                frameGraph.Read(lightingPass, gPosition);
+                frameGraph.Read(lightingPass, gNormal);
+                frameGraph.Read(lightingPass, gAlbedoSpec);
+                frameGraph.Write(lightingPass, color);
+                frameGraph.SetSideEffect(lightingPass);
+            }
+            frameGraph.Compile();
+        }
+
+        // issues the frame; the caller waits for it (glFinish) to time it
+        void Render(Camera &camera, const BenchFrame &frameContent)
+        {
+            FrameMemory().Reset();
+            cameraPosition = camera.Position;
+            projection = glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, 100.0f);
+            view = camera.GetViewMatrix();
+            frame = &frameContent;
+            lightingDefines.Clear();
+            lightingDefines.Constant("POINT_LIGHTS", (int)std::min((size_t)BENCH_MAX_LIGHTS, frame->LightPositions.size()));
+            if (shading == BENCH_FORWARD)
+                baseShader = &baseShaderVariants.Get(ShaderDefines(lightingDefines).Keyword("DIR_LIGHT"));
+            else if (shading == BENCH_DEFERRED)
+                lightingPassShader = &lightingPassShaderVariants.Get(lightingDefines);
+            frameGraph.Execute();
+            frame = 0;
+        }
+
+        // compares the lit result of the last deferred frame with the CPU reference (every light, no culling).
+        // Persistent targets aren't needed: reading back right after Render() sees what the frame left.
+        BenchLightingCheck ValidateLighting(const BenchFrame &frameContent, float tolerance)
+        {
+            BenchLightingCheck check;
+            check.MaxError = 0.0f;
+            check.Mismatches = 0;
+            check.Pixels = (unsigned int)(width * height);
+            gBuffer.ReadBack(frameGraph.Texture(gPosition), frameGraph.Texture(gNormal), frameGraph.Texture(gAlbedoSpec), width, height);
+            CpuLighting reference;
+            reference.CullLights = false;
+            reference.ThreadCount = cpuLighting.ThreadCount;
+            frame = &frameContent;
+            gatherLights();
+            frame = 0;
+            reference.Shade(gBuffer, cpuLights, cameraPosition, litPixels);
+            shaded.resize(litPixels.size());
+            GLState().BindTexture(GL_TEXTURE_2D, frameGraph.Texture(color));
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &shaded[0]);
+            for (unsigned int i = 0; i < check.Pixels; i++)
+            {
+                float error = 0.0f;
+                for (unsigned int c = 0; c < 3; c++)
+                    error = std::max(error, std::fabs(shaded[i * 4 + c] - litPixels[i * 4 + c]));
+                check.MaxError = std::max(check.MaxError, error);
+                if (error > tolerance)
+                    check.Mismatches++;
+            }
+            return check;
+        }
+
+    private:
+        FrameGraph frameGraph;
+        FrameGraphResource color, gPosition, gNormal, gAlbedoSpec;
+        BenchShading shading;
+        int width, height;
+        ShaderVariants baseShaderVariants;
+        ShaderVariants lightingPassShaderVariants;
+        Shader geometryPassShader;
+        // the variants of the current light count
+        ShaderDefines lightingDefines;
+        Shader *baseShader;
+        Shader *lightingPassShader;
+        // per-frame values shared by the passes
+        const BenchFrame *frame;
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 cameraPosition;
+        unsigned int quadVAO, quadVBO;
+        // CPU lighting
+        CpuLighting cpuLighting;
+        CpuGBuffer gBuffer;
+        std::vector<CpuLight> cpuLights;
+        std::vector<float> litPixels;
+        std::vector<float> shaded; // readback of the shader's result
+
+        FrameGraphTextureDesc targetDesc(GLenum internalFormat) const
+        {
+            FrameGraphTextureDesc desc;
+            desc.Width = width;
+            desc.Height = height;
+            desc.InternalFormat = internalFormat;
+            desc.Filter = GL_NEAREST;
+            return desc;
+        }
+
+        void setLights(Shader &shader)
+        {
+            for (unsigned int i = 0; i < BENCH_MAX_LIGHTS; i++)
+            {
+                shader.SetVector3f(FrameMemory().Format("pointLights[%u].Position", i), i < frame->LightPositions.size() ? frame->LightPositions[i] : glm::vec3(0.0f));
+                shader.SetVector3f(FrameMemory().Format("pointLights[%u].Color", i), i < frame->LightColors.size() ? frame->LightColors[i] : glm::vec3(0.0f));
+                shader.SetFloat(FrameMemory().Format("pointLights[%u].Linear", i), 0.35f);
+                shader.SetFloat(FrameMemory().Format("pointLights[%u].Quadratic", i), 0.44f);
+            }
+        }
+
+        void renderForward()
+        {
+            GLState().Viewport(0, 0, width, height);
+            baseShader->Use();
+            baseShader->SetVector3f("viewPos", cameraPosition);
+            baseShader->SetVector3f("dirLight.Direction", 0.0f, 1.0f, 0.0f);
+            baseShader->SetVector3f("dirLight.Ambient", 0.05f, 0.05f, 0.05f);
+            baseShader->SetVector3f("dirLight.Diffuse", 0.2f, 0.2f, 0.2f);
+            baseShader->SetVector3f("dirLight.Specular", 0.5f, 0.5f, 0.5f);
+            setLights(*baseShader);
+            baseShader->SetMatrix4("projection", projection);
+            baseShader->SetMatrix4("view", view);
+            for (unsigned int i = 0; i < frame->Transforms.size(); i++)
+            {
+                baseShader->SetMatrix4("model", frame->Transforms[i]);
+                frame->Models[i]->Draw(*baseShader);
+            }
+        }
+
+        void renderGeometry()
+        {
+            GLState().Viewport(0, 0, width, height);
+            geometryPassShader.Use();
+            geometryPassShader.SetMatrix4("projection", projection);
+            geometryPassShader.SetMatrix4("view", view);
+            for (unsigned int i = 0; i < frame->Transforms.size(); i++)
+            {
+                geometryPassShader.SetMatrix4("model", frame->Transforms[i]);
+                frame->Models[i]->Draw(geometryPassShader);
+            }
+        }
+
+        void renderLighting()
+        {
+            GLState().Viewport(0, 0, width, height);
+            lightingPassShader->Use();
+            GLState().BindTexture(0, GL_TEXTURE_2D, frameGraph.Texture(gPosition));
+            GLState().BindTexture(1, GL_TEXTURE_2D, frameGraph.Texture(gNormal));
+            GLState().BindTexture(2, GL_TEXTURE_2D, frameGraph.Texture(gAlbedoSpec));
+            setLights(*lightingPassShader);
+            lightingPassShader->SetVector3f("viewPos", cameraPosition);
+            renderQuad();
+        }
+
+        // the shader's light slots
+        void gatherLights()
+        {
+            cpuLights.clear();
+            for (unsigned int i = 0; i < frame->LightPositions.size() && i < BENCH_MAX_LIGHTS; i++)
+            {
+                CpuLight light;
+                light.Position = frame->LightPositions[i];
+                light.Color = frame->LightColors[i];
+                light.Linear = 0.35f;
+                light.Quadratic = 0.44f;
+                cpuLights.push_back(light);
+            }
+        }
+
+        // reads the G-buffer back, lights it on the CPU and uploads the result as the lit scene
+        void renderCpuLighting()
+        {
+            gBuffer.ReadBack(frameGraph.Texture(gPosition), frameGraph.Texture(gNormal), frameGraph.Texture(gAlbedoSpec), width, height);
+            gatherLights();
+            cpuLighting.Shade(gBuffer, cpuLights, cameraPosition, litPixels);
+            GLState().BindTexture(GL_TEXTURE_2D, frameGraph.Texture(color));
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, &litPixels[0]);
+        }
+
+        // screen filling quad, as in the viewer
+        void renderQuad()
+        {
+            if (quadVAO == 0)
+            {
+                float quadVertices[] = {
+                    // positions        // texture Coords
+                    -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+                    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+                     1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+                     1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+                };
+                glGenVertexArrays(1, &quadVAO);
+                glGenBuffers(1, &quadVBO);
+                GLState().BindVertexArray(quadVAO);
+                GLState().BindBuffer(GL_ARRAY_BUFFER, quadVBO);
+                glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+            }
+            GLState().BindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+};
+#endif
@@ -0,0 +1,253 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Default regression gate values
+const float BENCH_TOLERANCE = 0.10f;    // slower than the baseline by more than this fraction is a regression
+const float BENCH_NOISE_FLOOR = 0.05f; // milliseconds, smaller differences are never flagged
+
+// One point of a sweep
+struct BenchConfig
+{
+    std::string Mode; // "forward", "deferred" or "cpu-deferred"
+    unsigned int Instances;
+    unsigned int Lights;
+    int Width, Height;
+
+    // identifies the configuration across runs, e.g. "deferred/256i/10l/1280x720"
+    std::string Key() const
+    {
+        std::ostringstream key;
+        key << Mode << "/" << Instances << "i/" << Lights << "l/" << Width << "x" << Height;
+        return key.str();
+    }
+};
+
+// Frame times of one configuration, in milliseconds
+struct BenchResult
+{
+    BenchConfig Config;
+    unsigned int Frames;
+    float Mean, Min, Max;
+    float P50, P90, P95, P99;
+
+    BenchResult()
+        : Frames(0), Mean(0.0f), Min(0.0f), Max(0.0f), P50(0.0f), P90(0.0f), P95(0.0f), P99(0.0f)
+    {
+    }
+
+    static BenchResult FromFrameTimes(const BenchConfig &config, std::vector<float> times)
+    {
+        BenchResult result;
+        result.Config = config;
+        result.Frames = (unsigned int)times.size();
+        if (times.empty())
+            return result;
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (unsigned int i = 0; i < times.size(); i++)
+            sum += times[i];
+        result.Mean = (float)(sum / times.size());
+        result.Min = times.front();
+        result.Max = times.back();
+        result.P50 = percentile(times, 50.0f);
+        result.P90 = percentile(times, 90.0f);
+        result.P95 = percentile(times, 95.0f);
+        result.P99 = percentile(times, 99.0f);
+        return result;
+    }
+
+    // nearest rank on sorted values
+    static float percentile(const std::vector<float> &sorted, float p)
+    {
+        unsigned int rank = (unsigned int)std::ceil(p / 100.0f * sorted.size());
+        return sorted[std::min(std::max(rank, 1u), (unsigned int)sorted.size()) - 1];
+    }
+};
+
+// Results of a benchmark run and the device they were measured on
+class BenchReport
+{
+    public:
+        std::string Renderer; // GL_RENDERER of the context
+        std::vector<BenchResult> Results;
+
+        bool WriteCSV(const std::string &path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::BENCH: can't write " << path << std::endl;
+                return false;
+            }
+            file << "mode,instances,lights,width,height,frames,mean_ms,min_ms,p50_ms,p90_ms,p95_ms,p99_ms,max_ms" << std::endl;
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const BenchResult &r = Results[i];
+                file << r.Config.Mode << "," << r.Config.Instances << "," << r.Config.Lights << "," << r.Config.Width << ","
+                     << r.Config.Height << "," << r.Frames << "," << r.Mean << "," << r.Min << "," << r.P50 << "," << r.P90 << ","
+                     << r.P95 << "," << r.P99 << "," << r.Max << std::endl;
+            }
+            return true;
+        }
+
+        // one result object per line, so that Load() doesn't need a full JSON parser
+        bool WriteJSON(const std::string &path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::BENCH: can't write " << path << std::endl;
+                return false;
+            }
+            file << "{" << std::endl;
+            file << "  \"renderer\": \"" << escape(Renderer) << "\"," << std::endl;
+            file << "  \"results\": [" << std::endl;
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const BenchResult &r = Results[i];
+                file << "    {\"key\": \"" << r.Config.Key() << "\", \"mode\": \"" << r.Config.Mode << "\", \"instances\": "
+                     << r.Config.Instances << ", \"lights\": " << r.Config.Lights << ", \"width\": " << r.Config.Width
+                     << ", \"height\": " << r.Config.Height << ", \"frames\": " << r.Frames << ", \"mean_ms\": " << r.Mean
+                     << ", \"min_ms\": " << r.Min << ", \"p50_ms\": " << r.P50 << ", \"p90_ms\": " << r.P90 << ", \"p95_ms\": "
+                     << r.P95 << ", \"p99_ms\": " << r.P99 << ", \"max_ms\": " << r.Max << "}"
+                     << (i + 1 < Results.size() ? "," : "") << std::endl;
+            }
+            file << "  ]" << std::endl;
+            file << "}" << std::endl;
+            return true;
+        }
+
+        // reads a report written by WriteJSON()
+        bool Load(const std::string &path)
+        {
+            std::ifstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::BENCH: can't open " << path << std::endl;
+                return false;
+            }
+            Results.clear();
+            std::string line;
+            while (std::getline(file, line))
+            {
+                if (line.find("\"renderer\"") != std::string::npos)
+                    Renderer = stringField(line, "renderer");
+                if (line.find("\"key\"") == std::string::npos)
+                    continue;
+                BenchResult r;
+                r.Config.Mode = stringField(line, "mode");
+                r.Config.Instances = (unsigned int)numberField(line, "instances");
+                r.Config.Lights = (unsigned int)numberField(line, "lights");
+                r.Config.Width = (int)numberField(line, "width");
+                r.Config.Height = (int)numberField(line, "height");
+                r.Frames = (unsigned int)numberField(line, "frames");
+                r.Mean = numberField(line, "mean_ms");
+                r.Min = numberField(line, "min_ms");
+                r.P50 = numberField(line, "p50_ms");
+                r.P90 = numberField(line, "p90_ms");
+                r.P95 = numberField(line, "p95_ms");
+                r.P99 = numberField(line, "p99_ms");
+                r.Max = numberField(line, "max_ms");
+                Results.push_back(r);
+            }
+            return true;
+        }
+
+        // prints how every result compares to the baseline's, returns the number of regressions: a median or
+        // 95th percentile slower than the baseline's by more than the tolerance (and the noise floor)
+        unsigned int Compare(const BenchReport &baseline, float tolerance, std::ostream &out) const
+        {
+            if (baseline.Renderer != Renderer)
+                out << "warning: baseline measured on '" << baseline.Renderer << "', this run on '" << Renderer << "'" << std::endl;
+            std::map<std::string, const BenchResult*> previous;
+            for (unsigned int i = 0; i < baseline.Results.size(); i++)
+                previous[baseline.Results[i].Config.Key()] = &baseline.Results[i];
+            unsigned int regressions = 0;
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const BenchResult &r = Results[i];
+                std::map<std::string, const BenchResult*>::const_iterator found = previous.find(r.Config.Key());
+                if (found == previous.end())
+                {
+                    out << "  " << r.Config.Key() << ": not in the baseline" << std::endl;
+                    continue;
+                }
+                const BenchResult &b = *found->second;
+                bool slower = regressed(r.P50, b.P50, tolerance) || regressed(r.P95, b.P95, tolerance);
+                if (slower)
+                    regressions++;
+                char line[256];
+                snprintf(line, sizeof(line), "  %-32s p50 %8.3f ms (%+6.1f%%)  p95 %8.3f ms (%+6.1f%%)%s", r.Config.Key().c_str(),
+                         r.P50, change(r.P50, b.P50), r.P95, change(r.P95, b.P95), slower ? "  REGRESSION" : "");
+                out << line << std::endl;
+            }
+            return regressions;
+        }
+
+    private:
+        static bool regressed(float current, float baseline, float tolerance)
+        {
+            return current - baseline > BENCH_NOISE_FLOOR && current > baseline * (1.0f + tolerance);
+        }
+
+        static float change(float current, float baseline)
+        {
+            return baseline > 0.0f ? (current / baseline - 1.0f) * 100.0f : 0.0f;
+        }
+
+        static std::string escape(const std::string &text)
+        {
+            std::string escaped;
+            for (unsigned int i = 0; i < text.size(); i++)
+            {
+                if (text[i] == '"' || text[i] == '\\')
+                    escaped += '\\';
+                escaped += text[i];
+            }
+            return escaped;
+        }
+
+        static size_t valueStart(const std::string &line, const std::string &name)
+        {
+            size_t found = line.find("\"" + name + "\":");
+            if (found == std::string::npos)
+                return std::string::npos;
+            found += name.size() + 3;
+            while (found < line.size() && line[found] == ' ')
+                found++;
+            return found;
+        }
+
+        static float numberField(const std::string &line, const std::string &name)
+        {
+            size_t start = valueStart(line, name);
+            return start == std::string::npos ? 0.0f : (float)atof(line.c_str() + start);
+        }
+
+        static std::string stringField(const std::string &line, const std::string &name)
+        {
+            size_t start = valueStart(line, name);
+            if (start == std::string::npos || line[start] != '"')
+                return "";
+            std::string value;
+            for (size_t i = start + 1; i < line.size() && line[i] != '"'; i++)
+            {
+                if (line[i] == '\\' && i + 1 < line.size())
+                    i++;
+                value += line[i];
+            }
+            return value;
+        }
+};
+#endif
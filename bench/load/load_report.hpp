@@ -0,0 +1,165 @@
+#ifndef LOAD_REPORT_H
+#define LOAD_REPORT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "load_profiler.hpp"
+
+// One load of an asset: what every stage took, the whole load and the heap it needed
+struct LoadRun
+{
+    LoadStageStats Stages[LOAD_STAGE_COUNT];
+    double Total;     // milliseconds, from the first file access to the GPU being done
+    size_t PeakHeap;  // highest heap growth during the load, where the allocator reports block sizes (glibc)
+};
+
+// A stage of an asset under one file cache condition, over the iterations
+struct LoadResult
+{
+    std::string Asset;
+    std::string Cache;  // "cold" or "warm"
+    std::string Stage;  // a LoadProfiler stage, or "total"
+    unsigned int Iterations;
+    double Median, Min, Max; // milliseconds
+    size_t Bytes;            // per load; for the total, the bytes read from the asset's files
+    double Throughput;       // MB/s at the median time
+    double PeakHeap;         // MB, the highest of the iterations
+    double PeakResident;     // MB, of the process once the iterations are done
+
+    // medians over the runs of every stage that ran, then the total
+    static std::vector<LoadResult> FromRuns(const std::string &asset, const std::string &cache, const std::vector<LoadRun> &runs,
+                                            size_t peakResident)
+    {
+        std::vector<LoadResult> results;
+        if (runs.empty())
+            return results;
+        size_t peakHeap = 0;
+        for (unsigned int r = 0; r < runs.size(); r++)
+            peakHeap = std::max(peakHeap, runs[r].PeakHeap);
+        std::vector<double> times(runs.size());
+        for (unsigned int s = 0; s <= LOAD_STAGE_COUNT; s++)
+        {
+            bool total = s == LOAD_STAGE_COUNT;
+            if (!total && runs[0].Stages[s].Calls == 0)
+                continue;
+            LoadResult result;
+            result.Asset = asset;
+            result.Cache = cache;
+            result.Stage = total ? "total" : LoadProfiler::StageName((LoadStage)s);
+            result.Iterations = (unsigned int)runs.size();
+            for (unsigned int r = 0; r < runs.size(); r++)
+                times[r] = total ? runs[r].Total : runs[r].Stages[s].Time;
+            std::sort(times.begin(), times.end());
+            result.Median = times[(times.size() - 1) / 2];
+            result.Min = times.front();
+            result.Max = times.back();
+            const LoadStageStats *stages = runs[0].Stages;
+            result.Bytes = total ? stages[LOAD_IMPORT].Bytes + stages[LOAD_FILE_READ].Bytes + stages[LOAD_SHADER_READ].Bytes
+                                 : stages[s].Bytes;
+            result.Throughput = result.Median > 0.0 ? result.Bytes / (1024.0 * 1024.0) / (result.Median / 1000.0) : 0.0;
+            result.PeakHeap = peakHeap / (1024.0 * 1024.0);
+            result.PeakResident = peakResident / (1024.0 * 1024.0);
+            results.push_back(result);
+        }
+        return results;
+    }
+};
+
+// Results of a load benchmark run
+class LoadReport
+{
+    public:
+        std::string Renderer; // GL_RENDERER of the context
+        std::string PostProcess; // "native" or "assimp", who welded the meshes and computed their tangent space
+        bool ColdCache;       // whether the file cache could be dropped for the cold runs
+        std::vector<LoadResult> Results;
+
+        LoadReport()
+            : ColdCache(false)
+        {
+        }
+
+        void Print(std::ostream &out) const
+        {
+            char line[256];
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const LoadResult &r = Results[i];
+                snprintf(line, sizeof(line), "  %-10s %-5s %-15s %9.2f ms (%8.2f - %8.2f) %9.2f MB %9.1f MB/s", r.Asset.c_str(),
+                         r.Cache.c_str(), r.Stage.c_str(), r.Median, r.Min, r.Max, r.Bytes / (1024.0 * 1024.0), r.Throughput);
+                out << line;
+                if (r.Stage == "total")
+                {
+                    snprintf(line, sizeof(line), "  peak heap %.1f MB, peak RSS %.1f MB", r.PeakHeap, r.PeakResident);
+                    out << line;
+                }
+                out << std::endl;
+            }
+        }
+
+        bool WriteCSV(const std::string &path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::LOADBENCH: can't write " << path << std::endl;
+                return false;
+            }
+            file << "asset,cache,stage,iterations,median_ms,min_ms,max_ms,bytes,mb_per_s,peak_heap_mb,peak_rss_mb" << std::endl;
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const LoadResult &r = Results[i];
+                file << r.Asset << "," << r.Cache << "," << r.Stage << "," << r.Iterations << "," << r.Median << "," << r.Min << ","
+                     << r.Max << "," << r.Bytes << "," << r.Throughput << "," << r.PeakHeap << "," << r.PeakResident << std::endl;
+            }
+            return true;
+        }
+
+        // one result object per line, like the rendering benchmark's reports
+        bool WriteJSON(const std::string &path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::LOADBENCH: can't write " << path << std::endl;
+                return false;
+            }
+            file << "{" << std::endl;
+            file << "  \"renderer\": \"" << escape(Renderer) << "\"," << std::endl;
+            file << "  \"postprocess\": \"" << PostProcess << "\"," << std::endl;
+            file << "  \"cold_cache\": " << (ColdCache ? "true" : "false") << "," << std::endl;
+            file << "  \"results\": [" << std::endl;
+            for (unsigned int i = 0; i < Results.size(); i++)
+            {
+                const LoadResult &r = Results[i];
+                file << "    {\"key\": \"" << escape(r.Asset) << "/" << r.Cache << "/" << r.Stage << "\", \"asset\": \"" << escape(r.Asset)
+                     << "\", \"cache\": \"" << r.Cache << "\", \"stage\": \"" << r.Stage << "\", \"iterations\": " << r.Iterations
+                     << ", \"median_ms\": " << r.Median << ", \"min_ms\": " << r.Min << ", \"max_ms\": " << r.Max << ", \"bytes\": "
+                     << r.Bytes << ", \"mb_per_s\": " << r.Throughput << ", \"peak_heap_mb\": " << r.PeakHeap << ", \"peak_rss_mb\": "
+                     << r.PeakResident << "}" << (i + 1 < Results.size() ? "," : "") << std::endl;
+            }
+            file << "  ]" << std::endl;
+            file << "}" << std::endl;
+            return true;
+        }
+
+    private:
+        static std::string escape(const std::string &text)
+        {
+            std::string escaped;
+            for (unsigned int i = 0; i < text.size(); i++)
+            {
+                if (text[i] == '"' || text[i] == '\\')
+                    escaped += '\\';
+                escaped += text[i];
+            }
+            return escaped;
+        }
+};
+
+#endif
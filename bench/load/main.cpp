@@ -0,0 +1,359 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../bench_context.hpp"
+#include "alloc_stats.hpp"
+#include "gl_state.hpp"
+#include "load_profiler.hpp"
+#include "load_report.hpp"
+#include "mesh_processing.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+// Loads the bundled models and the viewer's shaders over and over and reports what every stage of the load costs
+// (see LoadProfiler): with a cold file cache, the asset's files are dropped from the OS page cache before every
+// load; with a warm one, the asset is loaded once untimed first. GL stages are synchronized with glFinish() so
+// they measure the upload rather than queuing it, and Mesa's shader cache is disabled so that every compile is one.
+//
+// usage: basegl-loadbench [--models name=path,...] [--shaders dir] [--caches cold,warm] [--iterations N]
+//                         [--postprocess native|assimp] [--validate-postprocess] [--hardware] [--csv file] [--json file]
+// --shaders "" leaves the shaders out. --postprocess assimp has assimp weld the vertices and compute the normals and
+// tangents instead of MeshProcessor, to compare the two. --validate-postprocess first imports every model with
+// MeshProcessor on 1 to LOAD_BENCH_VALIDATE_THREADS threads and exits with 1 unless the vertices and indices are
+// identical to the byte. Cold runs need posix_fadvise(); where it's missing or fails they are
+// skipped and the report says so ("cold_cache": false).
+
+// settings
+const unsigned int LOAD_BENCH_ITERATIONS = 5;
+const unsigned int LOAD_BENCH_VALIDATE_THREADS = 8;
+const std::string LOAD_BENCH_SHADERS = "../src/shaders/";
+// the vertex/fragment pairs the viewer compiles at startup
+const char *LOAD_BENCH_PROGRAMS[] = { "base_shader", "depth_prepass", "geometry_pass", "lighting_pass", "light_box", "upscale" };
+
+struct LoadAsset
+{
+    std::string Name;
+    std::string Path; // model file, or the shader directory
+    bool Shaders;
+};
+
+std::vector<LoadAsset> parseModels(const std::string &text);
+bool evictFromCache(const std::string &path);
+std::string assetDirectory(const LoadAsset &asset);
+LoadRun loadOnce(const LoadAsset &asset);
+bool validatePostProcess(const LoadAsset &asset);
+
+int main(int argc, char **argv)
+{
+    // command line
+    // ------------
+    std::vector<LoadAsset> assets = parseModels("ship=../assets/models/SF_Light-Fighter_X6/SF_Light_Fighter-X6.obj,"
+                                                "nanosuit=../assets/models/nanosuit/nanosuit.obj");
+    std::string shaders = LOAD_BENCH_SHADERS;
+    bool cold = true, warm = true;
+    unsigned int iterations = LOAD_BENCH_ITERATIONS;
+    bool software = true;
+    bool validate = false;
+    std::string csvFile, jsonFile;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--models" && hasValue)
+            assets = parseModels(argv[++i]);
+        else if (argument == "--shaders" && hasValue)
+        {
+            shaders = argv[++i];
+            if (!shaders.empty() && shaders[shaders.size() - 1] != '/')
+                shaders += '/';
+        }
+        else if (argument == "--caches" && hasValue)
+        {
+            std::string caches = argv[++i];
+            cold = caches.find("cold") != std::string::npos;
+            warm = caches.find("warm") != std::string::npos;
+        }
+        else if (argument == "--iterations" && hasValue)
+            iterations = (unsigned int)atoi(argv[++i]);
+        else if (argument == "--postprocess" && hasValue)
+            MeshProcessing().Native = std::string(argv[++i]) != "assimp";
+        else if (argument == "--validate-postprocess")
+            validate = true;
+        else if (argument == "--hardware")
+            software = false;
+        else if (argument == "--csv" && hasValue)
+            csvFile = argv[++i];
+        else if (argument == "--json" && hasValue)
+            jsonFile = argv[++i];
+        else
+        {
+            std::cout << "unknown option " << argument << std::endl;
+            return -1;
+        }
+    }
+    if (validate)
+    {
+        // the post-processing doesn't need a context, it runs before any load is timed
+        bool identical = true;
+        for (unsigned int a = 0; a < assets.size(); a++)
+            identical = validatePostProcess(assets[a]) && identical;
+        if (!identical)
+            return 1;
+    }
+    if (!shaders.empty())
+    {
+        LoadAsset asset;
+        asset.Name = "shaders";
+        asset.Path = shaders;
+        asset.Shaders = true;
+        assets.push_back(asset);
+    }
+    if (assets.empty() || iterations == 0 || (!cold && !warm))
+    {
+        std::cout << "nothing to run" << std::endl;
+        return -1;
+    }
+
+    // headless context
+    // ----------------
+#ifndef _WIN32
+    setenv("MESA_SHADER_CACHE_DISABLE", "true", 0);
+#endif
+    GLFWwindow *window = CreateBenchContext(software, "basegl-loadbench");
+    if (window == NULL)
+    {
+        std::cout << "Failed to create a GL context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    LoadReport report;
+    report.Renderer = (const char*)glGetString(GL_RENDERER);
+    report.PostProcess = MeshProcessing().Native ? "native" : "assimp";
+    std::cout << "renderer: " << report.Renderer << ", " << report.PostProcess << " mesh post-processing" << std::endl;
+    LoadProfile().Enabled = true;
+    LoadProfile().Synchronize = true;
+
+    // loads
+    // -----
+    report.ColdCache = cold;
+    for (unsigned int a = 0; a < assets.size(); a++)
+    {
+        const LoadAsset &asset = assets[a];
+        std::vector<LoadRun> runs;
+        if (cold)
+        {
+            for (unsigned int i = 0; i < iterations && report.ColdCache; i++)
+            {
+                if (!evictFromCache(assetDirectory(asset)))
+                {
+                    std::cout << "can't drop " << assetDirectory(asset) << " from the file cache, cold runs skipped" << std::endl;
+                    report.ColdCache = false;
+                    runs.clear();
+                    break;
+                }
+                runs.push_back(loadOnce(asset));
+            }
+            std::vector<LoadResult> results = LoadResult::FromRuns(asset.Name, "cold", runs, PeakResidentBytes());
+            report.Results.insert(report.Results.end(), results.begin(), results.end());
+        }
+        if (warm)
+        {
+            runs.clear();
+            loadOnce(asset);
+            for (unsigned int i = 0; i < iterations; i++)
+                runs.push_back(loadOnce(asset));
+            std::vector<LoadResult> results = LoadResult::FromRuns(asset.Name, "warm", runs, PeakResidentBytes());
+            report.Results.insert(report.Results.end(), results.begin(), results.end());
+        }
+    }
+    LoadProfile().Enabled = false;
+
+    // results
+    // -------
+    std::cout << "median of " << iterations << " loads (min - max):" << std::endl;
+    report.Print(std::cout);
+    if (!csvFile.empty() && report.WriteCSV(csvFile))
+        std::cout << "wrote " << csvFile << std::endl;
+    if (!jsonFile.empty() && report.WriteJSON(jsonFile))
+        std::cout << "wrote " << jsonFile << std::endl;
+
+    glfwTerminate();
+    return 0;
+}
+
+// loadOnce() loads the asset and releases it again, with the profiler and the heap statistics reset before
+// -----------------------------------------------------------------------------------------------------------
+LoadRun loadOnce(const LoadAsset &asset)
+{
+    LoadProfile().Reset();
+    Allocations().Reset();
+    size_t heapBefore = Allocations().LiveBytes;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    Model *model = NULL;
+    std::vector<Shader> programs;
+    if (asset.Shaders)
+    {
+        for (unsigned int p = 0; p < sizeof(LOAD_BENCH_PROGRAMS) / sizeof(LOAD_BENCH_PROGRAMS[0]); p++)
+        {
+            std::string name = asset.Path + LOAD_BENCH_PROGRAMS[p];
+            programs.push_back(Shader((name + ".vs").c_str(), (name + ".fs").c_str()));
+        }
+    }
+    else
+        model = new Model(asset.Path);
+    glFinish();
+
+    LoadRun run;
+    run.Total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    run.PeakHeap = Allocations().PeakBytes > heapBefore ? Allocations().PeakBytes - heapBefore : 0;
+    for (unsigned int s = 0; s < LOAD_STAGE_COUNT; s++)
+        run.Stages[s] = LoadProfile().Stage((LoadStage)s);
+
+    for (unsigned int p = 0; p < programs.size(); p++)
+        GLState().DeleteProgram(programs[p].ID);
+    if (model)
+    {
+        model->Release();
+        delete model;
+    }
+    return run;
+}
+
+// validatePostProcess() imports a model with MeshProcessor on 1, 2, 4... threads and compares the processed vertex
+// and index streams with the single-threaded ones; prints the first difference
+// ---------------------------------------------------------------------------------------------------------------
+bool validatePostProcess(const LoadAsset &asset)
+{
+    bool native = MeshProcessing().Native;
+    unsigned int threadCount = MeshProcessing().ThreadCount;
+    MeshProcessing().Native = true;
+    ModelData reference;
+    bool identical = true;
+    for (unsigned int threads = 1; threads <= LOAD_BENCH_VALIDATE_THREADS && identical; threads *= 2)
+    {
+        MeshProcessing().ThreadCount = threads;
+        ModelData data;
+        if (!ImportModel(asset.Path, data))
+        {
+            identical = false;
+            break;
+        }
+        if (threads == 1)
+        {
+            std::swap(reference.meshes, data.meshes);
+            continue;
+        }
+        identical = data.meshes.size() == reference.meshes.size();
+        for (unsigned int m = 0; m < data.meshes.size() && identical; m++)
+        {
+            const MeshData &mesh = data.meshes[m], &expected = reference.meshes[m];
+            identical = mesh.vertices.size() == expected.vertices.size() && mesh.indices.size() == expected.indices.size() &&
+                        (mesh.vertices.empty() || std::memcmp(&mesh.vertices[0], &expected.vertices[0],
+                                                              mesh.vertices.size() * sizeof(Vertex)) == 0) &&
+                        (mesh.indices.empty() || std::memcmp(&mesh.indices[0], &expected.indices[0],
+                                                             mesh.indices.size() * sizeof(unsigned int)) == 0);
+            if (!identical)
+                std::cout << asset.Name << ": mesh " << m << " differs on " << threads << " threads from 1 thread" << std::endl;
+        }
+    }
+    if (identical)
+        std::cout << asset.Name << ": post-processing identical on 1 to " << LOAD_BENCH_VALIDATE_THREADS << " threads" << std::endl;
+    MeshProcessing().Native = native;
+    MeshProcessing().ThreadCount = threadCount;
+    return identical;
+}
+
+// assetDirectory() is what a cold load drops from the file cache: the model's directory with its textures and
+// material files, or the shader directory
+// ------------------------------------------------------------------------------------------------------------
+std::string assetDirectory(const LoadAsset &asset)
+{
+    if (asset.Shaders)
+        return asset.Path;
+    size_t slash = asset.Path.find_last_of('/');
+    return slash == std::string::npos ? "." : asset.Path.substr(0, slash);
+}
+
+// evictFromCache() drops a file, or every file below a directory, from the OS page cache; false if it can't
+// ---------------------------------------------------------------------------------------------------------
+bool evictFromCache(const std::string &path)
+{
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    if (S_ISDIR(info.st_mode))
+    {
+        DIR *directory = opendir(path.c_str());
+        if (!directory)
+            return false;
+        bool evicted = true;
+        while (struct dirent *entry = readdir(directory))
+        {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                evicted = evictFromCache(path + "/" + name) && evicted;
+        }
+        closedir(directory);
+        return evicted;
+    }
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return false;
+    // the assets are only read, so their pages are clean and can be dropped right away
+    bool evicted = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(file);
+    return evicted;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// parseModels() reads "name=path,name=path"
+// -----------------------------------------
+std::vector<LoadAsset> parseModels(const std::string &text)
+{
+    std::vector<LoadAsset> assets;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos || equals == 0 || equals + 1 == item.size())
+        {
+            std::cout << "ignoring model '" << item << "', expected name=path" << std::endl;
+            continue;
+        }
+        LoadAsset asset;
+        asset.Name = item.substr(0, equals);
+        asset.Path = item.substr(equals + 1);
+        asset.Shaders = false;
+        assets.push_back(asset);
+    }
+    return assets;
+}
@@ -0,0 +1,365 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_context.hpp"
+#include "bench_renderer.hpp"
+#include "bench_report.hpp"
+#include "camera.hpp"
+#include "camera_path.hpp"
+#include "gl_state.hpp"
+#include "model.hpp"
+#include "scene.hpp"
+
+// Renders procedural stress scenes made of the bundled models offscreen and reports frame-time percentiles for
+// every point of a sweep over instance count, light count, resolution and shading mode. Frame i is rendered with
+// the camera at time i / BENCH_FRAME_RATE along the path, however long frames take, so runs are reproducible.
+//
+// usage: basegl-bench [--instances 16,64,256,1024] [--lights 1,5,10] [--resolutions 640x360,1280x720,1920x1080]
+//                     [--modes forward,deferred,cpu-deferred] [--full] [--frames N] [--warmup N] [--camera-path file]
+//                     [--hardware] [--csv file] [--json file] [--baseline file] [--tolerance percent]
+//                     [--lighting-threads N] [--validate-lighting]
+// cpu-deferred lights the G-buffer on the CPU (CpuLighting) instead of the lighting shader. --validate-lighting
+// compares the lighting shader's result with the CPU reference on the last frame of every deferred run.
+// Without --full every axis is swept on its own with the others at their middle value. The JSON output can be
+// stored and passed back with --baseline: the run then fails (exit code 1) if a median or 95th percentile frame
+// time got slower than the baseline's by more than the tolerance.
+
+// settings
+const unsigned int BENCH_FRAMES = 120;
+const unsigned int BENCH_WARMUP_FRAMES = 10;
+const float BENCH_FRAME_RATE = 60.0f;      // camera path time step
+const float BENCH_SPACING = 6.0f;          // between instances, as in the viewer's generated scenes
+const float BENCH_MODEL_SCALE = 0.05f;
+const unsigned int BENCH_SEED = 1337;
+const std::string BENCH_SHADERS = "../src/shaders/";
+const float BENCH_LIGHTING_TOLERANCE = 1.0f / 256.0f; // shader vs CPU reference, per color channel
+
+std::vector<unsigned int> parseList(const std::string &text);
+std::vector<std::pair<int, int> > parseResolutions(const std::string &text);
+std::vector<BenchConfig> buildSweep(const std::vector<std::string> &modes, const std::vector<unsigned int> &instances,
+                                    const std::vector<unsigned int> &lights, const std::vector<std::pair<int, int> > &resolutions,
+                                    bool full);
+Scene buildScene(const std::vector<SceneModel> &models, unsigned int instances, unsigned int lights);
+CameraPath orbitPath(const Scene &scene, float duration);
+
+int main(int argc, char **argv)
+{
+    // command line
+    // ------------
+    std::vector<std::string> modes;
+    modes.push_back("forward");
+    modes.push_back("deferred");
+    modes.push_back("cpu-deferred");
+    std::vector<unsigned int> instances = parseList("16,64,256,1024");
+    std::vector<unsigned int> lights = parseList("1,5,10");
+    std::vector<std::pair<int, int> > resolutions = parseResolutions("640x360,1280x720,1920x1080");
+    bool full = false;
+    bool software = true;
+    bool validateLighting = false;
+    unsigned int lightingThreads = 0; // CpuLighting's default, one per core
+    unsigned int frames = BENCH_FRAMES;
+    unsigned int warmup = BENCH_WARMUP_FRAMES;
+    float tolerance = BENCH_TOLERANCE;
+    std::string cameraPathFile, csvFile, jsonFile, baselineFile;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--instances" && hasValue)
+            instances = parseList(argv[++i]);
+        else if (argument == "--lights" && hasValue)
+            lights = parseList(argv[++i]);
+        else if (argument == "--resolutions" && hasValue)
+            resolutions = parseResolutions(argv[++i]);
+        else if (argument == "--modes" && hasValue)
+        {
+            modes.clear();
+            std::istringstream in(argv[++i]);
+            std::string mode;
+            while (std::getline(in, mode, ','))
+                if (mode == "forward" || mode == "deferred" || mode == "cpu-deferred")
+                    modes.push_back(mode);
+        }
+        else if (argument == "--full")
+            full = true;
+        else if (argument == "--frames" && hasValue)
+            frames = (unsigned int)atoi(argv[++i]);
+        else if (argument == "--warmup" && hasValue)
+            warmup = (unsigned int)atoi(argv[++i]);
+        else if (argument == "--camera-path" && hasValue)
+            cameraPathFile = argv[++i];
+        else if (argument == "--hardware")
+            software = false;
+        else if (argument == "--csv" && hasValue)
+            csvFile = argv[++i];
+        else if (argument == "--json" && hasValue)
+            jsonFile = argv[++i];
+        else if (argument == "--baseline" && hasValue)
+            baselineFile = argv[++i];
+        else if (argument == "--tolerance" && hasValue)
+            tolerance = (float)atof(argv[++i]) / 100.0f;
+        else if (argument == "--lighting-threads" && hasValue)
+            lightingThreads = (unsigned int)atoi(argv[++i]);
+        else if (argument == "--validate-lighting")
+            validateLighting = true;
+        else
+        {
+            std::cout << "unknown option " << argument << std::endl;
+            return -1;
+        }
+    }
+    if (modes.empty() || instances.empty() || lights.empty() || resolutions.empty() || frames == 0)
+    {
+        std::cout << "nothing to run" << std::endl;
+        return -1;
+    }
+    BenchReport baseline;
+    if (!baselineFile.empty() && !baseline.Load(baselineFile))
+        return -1;
+    CameraPath cameraPath;
+    if (!cameraPathFile.empty() && !cameraPath.Load(cameraPathFile))
+        return -1;
+
+    // headless context
+    // ----------------
+    GLFWwindow *window = CreateBenchContext(software, "basegl-bench");
+    if (window == NULL)
+    {
+        std::cout << "Failed to create a GL context" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    GLState().Enable(GL_DEPTH_TEST);
+
+    BenchReport report;
+    report.Renderer = (const char*)glGetString(GL_RENDERER);
+    std::cout << "renderer: " << report.Renderer << std::endl;
+
+    {
+        // the bundled models, loaded once for every configuration
+        // --------------------------------------------------------
+        std::vector<SceneModel> sceneModels(2);
+        sceneModels[0].Name = "ship";
+        sceneModels[0].Path = "../assets/models/SF_Light-Fighter_X6/SF_Light_Fighter-X6.obj";
+        sceneModels[1].Name = "nanosuit";
+        sceneModels[1].Path = "../assets/models/nanosuit/nanosuit.obj";
+        std::vector<Model*> models;
+        for (unsigned int m = 0; m < sceneModels.size(); m++)
+            models.push_back(new Model(sceneModels[m].Path));
+
+        BenchRenderer renderer;
+        renderer.Init(BENCH_SHADERS);
+        if (lightingThreads > 0)
+            renderer.Lighting().ThreadCount = lightingThreads;
+        std::vector<BenchConfig> sweep = buildSweep(modes, instances, lights, resolutions, full);
+        std::vector<float> frameTimes;
+        BenchFrame frame;
+        for (unsigned int c = 0; c < sweep.size(); c++)
+        {
+            const BenchConfig &config = sweep[c];
+            Scene scene = buildScene(sceneModels, config.Instances, config.Lights);
+            CameraPath path = cameraPath.Empty() ? orbitPath(scene, frames / BENCH_FRAME_RATE) : cameraPath;
+            BenchShading shading = config.Mode == "forward" ? BENCH_FORWARD : config.Mode == "deferred" ? BENCH_DEFERRED : BENCH_DEFERRED_CPU;
+            renderer.Configure(shading, config.Width, config.Height);
+
+            frame.Transforms.resize(scene.Instances.size());
+            frame.Models.clear();
+            for (unsigned int i = 0; i < scene.Instances.size(); i++)
+                frame.Models.push_back(models[scene.Instances[i].Model]);
+            frame.LightPositions.clear();
+            frame.LightColors.clear();
+            for (unsigned int l = 0; l < scene.Lights.size(); l++)
+            {
+                frame.LightPositions.push_back(scene.Lights[l].Position);
+                frame.LightColors.push_back(scene.Lights[l].Color);
+            }
+
+            frameTimes.clear();
+            Camera camera;
+            for (unsigned int f = 0; f < warmup + frames; f++)
+            {
+                // the warm-up frames replay the start of the path
+                float time = (f < warmup ? f : f - warmup) / BENCH_FRAME_RATE;
+                path.Apply(camera, time);
+                for (unsigned int i = 0; i < scene.Instances.size(); i++)
+                {
+                    const SceneInstance &instance = scene.Instances[i];
+                    glm::mat4 model = glm::translate(glm::mat4(1.0f), instance.Position);
+                    model = glm::scale(model, glm::vec3(instance.Scale));
+                    if (instance.Rotate)
+                        model = glm::rotate(model, -time, glm::normalize(glm::vec3(-0.5, -0.6, 0.8)));
+                    frame.Transforms[i] = model;
+                }
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                renderer.Render(camera, frame);
+                glFinish();
+                float elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (f >= warmup)
+                    frameTimes.push_back(elapsed);
+            }
+
+            BenchResult result = BenchResult::FromFrameTimes(config, frameTimes);
+            report.Results.push_back(result);
+            char line[256];
+            snprintf(line, sizeof(line), "[%u/%u] %-32s mean %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f ms", c + 1,
+                     (unsigned int)sweep.size(), config.Key().c_str(), result.Mean, result.P50, result.P95, result.P99);
+            std::cout << line << std::endl;
+            if (shading == BENCH_DEFERRED_CPU)
+                std::cout << "    cpu lighting: " << renderer.Lighting().ThreadCount << " threads, " << renderer.Lighting().TileCount
+                          << " tiles, " << renderer.Lighting().LightsPerTile << " lights per tile, " << renderer.Lighting().Time
+                          << " ms last frame" << std::endl;
+            if (validateLighting && shading == BENCH_DEFERRED)
+            {
+                BenchLightingCheck check = renderer.ValidateLighting(frame, BENCH_LIGHTING_TOLERANCE);
+                std::cout << "    lighting shader vs CPU reference: max error " << check.MaxError << ", " << check.Mismatches << "/"
+                          << check.Pixels << " pixels off by more than " << BENCH_LIGHTING_TOLERANCE << std::endl;
+            }
+        }
+
+        for (unsigned int m = 0; m < models.size(); m++)
+        {
+            models[m]->Release();
+            delete models[m];
+        }
+    }
+
+    // results
+    // -------
+    if (!csvFile.empty() && report.WriteCSV(csvFile))
+        std::cout << "wrote " << csvFile << std::endl;
+    if (!jsonFile.empty() && report.WriteJSON(jsonFile))
+        std::cout << "wrote " << jsonFile << std::endl;
+    int status = 0;
+    if (!baselineFile.empty())
+    {
+        std::cout << "compared to " << baselineFile << " (tolerance " << tolerance * 100.0f << "%):" << std::endl;
+        unsigned int regressions = report.Compare(baseline, tolerance, std::cout);
+        std::cout << regressions << " regressions" << std::endl;
+        if (regressions > 0)
+            status = 1;
+    }
+
+    glfwTerminate();
+    return status;
+}
+
+// parseList() reads "1,2,3"
+// -------------------------
+std::vector<unsigned int> parseList(const std::string &text)
+{
+    std::vector<unsigned int> values;
+    std::istringstream in(text);
+    std::string value;
+    while (std::getline(in, value, ','))
+        if (atoi(value.c_str()) > 0)
+            values.push_back((unsigned int)atoi(value.c_str()));
+    return values;
+}
+
+// parseResolutions() reads "640x360,1280x720"
+// -------------------------------------------
+std::vector<std::pair<int, int> > parseResolutions(const std::string &text)
+{
+    std::vector<std::pair<int, int> > values;
+    std::istringstream in(text);
+    std::string value;
+    while (std::getline(in, value, ','))
+    {
+        int width = 0, height = 0;
+        if (sscanf(value.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0)
+            values.push_back(std::make_pair(width, height));
+    }
+    return values;
+}
+
+// buildSweep() lists the configurations to run: every combination with full, otherwise each axis on its own
+// with the other axes at their middle value
+// -------------------------------------------------------------------------------------------------------------
+std::vector<BenchConfig> buildSweep(const std::vector<std::string> &modes, const std::vector<unsigned int> &instances,
+                                    const std::vector<unsigned int> &lights, const std::vector<std::pair<int, int> > &resolutions,
+                                    bool full)
+{
+    std::vector<BenchConfig> sweep;
+    std::vector<std::string> keys;
+    unsigned int baseInstances = instances.size() / 2, baseLights = lights.size() / 2, baseResolution = resolutions.size() / 2;
+    for (unsigned int m = 0; m < modes.size(); m++)
+        for (unsigned int i = 0; i < instances.size(); i++)
+            for (unsigned int l = 0; l < lights.size(); l++)
+                for (unsigned int r = 0; r < resolutions.size(); r++)
+                {
+                    unsigned int offAxis = (i != baseInstances) + (l != baseLights) + (r != baseResolution);
+                    if (!full && offAxis > 1)
+                        continue;
+                    BenchConfig config;
+                    config.Mode = modes[m];
+                    config.Instances = instances[i];
+                    config.Lights = std::min(lights[l], BENCH_MAX_LIGHTS);
+                    config.Width = resolutions[r].first;
+                    config.Height = resolutions[r].second;
+                    if (std::find(keys.begin(), keys.end(), config.Key()) != keys.end())
+                        continue; // light counts capped to the same value
+                    keys.push_back(config.Key());
+                    sweep.push_back(config);
+                }
+    return sweep;
+}
+
+// buildScene() lays out the instances on a square grid centered on the origin and the lights on a ring above it
+// ----------------------------------------------------------------------------------------------------------------
+Scene buildScene(const std::vector<SceneModel> &models, unsigned int instances, unsigned int lights)
+{
+    unsigned int size = (unsigned int)std::ceil(std::sqrt((float)instances));
+    Scene scene = Scene::Generate(size, BENCH_SPACING, models, BENCH_MODEL_SCALE, 0, BENCH_SEED);
+    scene.Instances.resize(instances);
+    float radius = 0.35f * BENCH_SPACING * size;
+    for (unsigned int l = 0; l < lights; l++)
+    {
+        float angle = 2.0f * glm::pi<float>() * l / lights;
+        SceneLight light;
+        light.Position = glm::vec3(radius * std::cos(angle), 3.0f, radius * std::sin(angle));
+        light.Color = glm::vec3(0.5f + 0.5f * std::cos(angle), 0.5f + 0.5f * std::sin(angle), 0.8f);
+        scene.Lights.push_back(light);
+    }
+    return scene;
+}
+
+// orbitPath() circles once around the grid in the given time, looking at its center
+// -----------------------------------------------------------------------------------
+CameraPath orbitPath(const Scene &scene, float duration)
+{
+    unsigned int size = (unsigned int)std::ceil(std::sqrt((float)scene.Instances.size()));
+    float radius = std::max(0.6f * BENCH_SPACING * size, 10.0f);
+    const unsigned int steps = 12;
+    CameraPath path;
+    for (unsigned int k = 0; k <= steps; k++)
+    {
+        float angle = 360.0f * k / steps;
+        CameraPath::Keyframe key;
+        key.Time = duration * k / steps;
+        key.Position = glm::vec3(radius * std::cos(glm::radians(angle)), 0.3f * radius, radius * std::sin(glm::radians(angle)));
+        key.Yaw = angle + 180.0f; // towards the center
+        key.Pitch = -16.7f;       // atan(0.3)
+        path.Keyframes.push_back(key);
+    }
+    return path;
+}
@@ -0,0 +1,133 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Counts the heap allocations of the process by replacing the global operator new/delete. The replacements
+// are defined in this header, so it must be included by exactly one translation unit (main.cpp).
+struct AllocationStats
+{
+    std::atomic<size_t> Count;      // allocations since the last Reset()
+    std::atomic<size_t> Bytes;      // bytes requested since the last Reset()
+    std::atomic<size_t> LiveBytes;  // currently allocated, only tracked where the allocator reports block sizes (glibc)
+    std::atomic<size_t> PeakBytes;  // highest LiveBytes since the last Reset()
+
+    AllocationStats()
+        : Count(0), Bytes(0), LiveBytes(0), PeakBytes(0)
+    {
+    }
+
+    void Reset()
+    {
+        Count = 0;
+        Bytes = 0;
+        PeakBytes = LiveBytes.load();
+    }
+};
+
+inline AllocationStats &Allocations()
+{
+    // never destroyed: operator delete may still run during static destruction
+    static AllocationStats *stats = new (std::malloc(sizeof(AllocationStats))) AllocationStats();
+    return *stats;
+}
+
+// allocations made by the calling thread since it started, e.g. to check that a frame of the render thread
+// doesn't allocate while the loader threads do
+inline size_t &ThreadAllocations()
+{
+    static thread_local size_t count = 0;
+    return count;
+}
+
+// Counts the allocations of the calling thread between its construction and Count(); with
+// BASEGL_CHECK_FRAME_ALLOCATIONS defined, Expect() aborts if there were more than allowed.
+class AllocationScope
+{
+    public:
+        AllocationScope()
+            : start(ThreadAllocations())
+        {
+        }
+
+        size_t Count() const
+        {
+            return ThreadAllocations() - start;
+        }
+
+        void Expect(size_t allowed, const char *what) const
+        {
+#ifdef BASEGL_CHECK_FRAME_ALLOCATIONS
+            size_t count = Count();
+            if (count > allowed)
+            {
+                std::fprintf(stderr, "%s: %zu heap allocations, expected at most %zu\n", what, count, allowed);
+                std::abort();
+            }
+#else
+            (void)allowed;
+            (void)what;
+#endif
+        }
+
+    private:
+        size_t start;
+};
+
+// peak resident set size of the process in bytes, 0 where it can't be queried
+inline size_t PeakResidentBytes()
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;        // bytes
+#else
+    return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#else
+    return 0;
+#endif
+}
+
+void *operator new(std::size_t size)
+{
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    AllocationStats &stats = Allocations();
+    stats.Count++;
+    ThreadAllocations()++;
+    stats.Bytes += size;
+#ifdef __GLIBC__
+    size_t live = stats.LiveBytes += malloc_usable_size(p);
+    size_t peak = stats.PeakBytes.load();
+    while (live > peak && !stats.PeakBytes.compare_exchange_weak(peak, live))
+        ;
+#endif
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    if (!p)
+        return;
+#ifdef __GLIBC__
+    Allocations().LiveBytes -= malloc_usable_size(p);
+#endif
+    std::free(p);
+}
+
+#endif
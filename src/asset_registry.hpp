@@ -0,0 +1,179 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <climits>
+#endif
+
+#include "hash.hpp"
+
+// Textures shared by every model of the process. A texture is found by the canonical path of its file, or by the
+// hash of the file's content when the same image is stored under another name; each model using it holds a
+// reference and the last one to release it deletes the GL texture. Thread safe: workers check what is already
+// resident to skip decoding it, the render thread acquires and releases.
+class AssetRegistry
+{
+    public:
+        // statistics; only DecodesSkipped changes on worker threads
+        unsigned int TextureCount;
+        unsigned int TextureReferences;
+        std::atomic<unsigned int> DecodesSkipped; // images not decoded because the texture was already resident
+        unsigned int ContentHits;                 // textures shared because their content matched another file
+
+        AssetRegistry()
+            : TextureCount(0), TextureReferences(0), DecodesSkipped(0), ContentHits(0)
+        {
+        }
+
+        // absolute path with symbolic links resolved if the file exists (POSIX), otherwise the path without ".",
+        // ".." or duplicate separators
+        static std::string CanonicalPath(const std::string &path)
+        {
+            if (path.empty())
+                return path;
+#ifndef _WIN32
+            char resolved[PATH_MAX];
+            if (realpath(path.c_str(), resolved))
+                return std::string(resolved);
+#endif
+            std::string normalized = path;
+            for (unsigned int i = 0; i < normalized.size(); i++)
+                if (normalized[i] == '\\')
+                    normalized[i] = '/';
+            std::vector<std::string> parts;
+            size_t start = 0;
+            while (start <= normalized.size())
+            {
+                size_t end = normalized.find('/', start);
+                if (end == std::string::npos)
+                    end = normalized.size();
+                std::string part = normalized.substr(start, end - start);
+                if (part == "..")
+                {
+                    if (!parts.empty() && parts.back() != "..")
+                        parts.pop_back();
+                    else if (normalized[0] != '/')
+                        parts.push_back(part);
+                }
+                else if (!part.empty() && part != ".")
+                    parts.push_back(part);
+                start = end + 1;
+            }
+            std::string result = normalized[0] == '/' ? "/" : "";
+            for (unsigned int i = 0; i < parts.size(); i++)
+                result += (i ? "/" : "") + parts[i];
+            return result;
+        }
+
+        // identifies a file's content
+        static uint64_t Hash(const unsigned char *data, size_t size)
+        {
+            return HashBytes(data, size);
+        }
+
+        // true if a texture for this file is resident, checked before the file is read
+        bool HasTexture(const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bool found = byPath.count(path) > 0;
+            if (found)
+                DecodesSkipped++;
+            return found;
+        }
+
+        // true if a texture for this file, or for a file with the same content, is resident
+        bool HasTexture(const std::string &path, uint64_t hash)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bool found = byPath.count(path) || byHash.count(hash);
+            if (found)
+                DecodesSkipped++;
+            return found;
+        }
+
+        // takes a reference on the texture of this file (or of the same content), 0 if none is resident
+        GLuint AcquireTexture(const std::string &path, uint64_t hash)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<std::string, GLuint>::iterator found = byPath.find(path);
+            if (found == byPath.end())
+            {
+                std::unordered_map<uint64_t, GLuint>::iterator same = byHash.find(hash);
+                if (same == byHash.end())
+                    return 0;
+                // remember this name as well
+                found = byPath.insert(std::make_pair(path, same->second)).first;
+                textures[same->second].Paths.push_back(path);
+                ContentHits++;
+            }
+            textures[found->second].References++;
+            TextureReferences++;
+            return found->second;
+        }
+
+        // registers a texture just created from the file, with one reference
+        void AddTexture(GLuint id, const std::string &path, uint64_t hash)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TextureEntry &entry = textures[id];
+            entry.Paths.assign(1, path);
+            entry.Hash = hash;
+            entry.References = 1;
+            byPath[path] = id;
+            byHash[hash] = id;
+            TextureCount++;
+            TextureReferences++;
+        }
+
+        // drops a reference, returns true if it was the last one: the caller deletes the GL texture then
+        bool ReleaseTexture(GLuint id)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::unordered_map<GLuint, TextureEntry>::iterator found = textures.find(id);
+            if (found == textures.end())
+                return true; // not shared
+            TextureReferences--;
+            if (--found->second.References > 0)
+                return false;
+            for (unsigned int i = 0; i < found->second.Paths.size(); i++)
+                byPath.erase(found->second.Paths[i]);
+            std::unordered_map<uint64_t, GLuint>::iterator same = byHash.find(found->second.Hash);
+            if (same != byHash.end() && same->second == id)
+                byHash.erase(same);
+            textures.erase(found);
+            TextureCount--;
+            return true;
+        }
+
+    private:
+        struct TextureEntry
+        {
+            std::vector<std::string> Paths;
+            uint64_t Hash;
+            unsigned int References;
+        };
+
+        std::mutex mutex;
+        std::unordered_map<GLuint, TextureEntry> textures;
+        std::unordered_map<std::string, GLuint> byPath;
+        std::unordered_map<uint64_t, GLuint> byHash;
+};
+
+// The registry of the process
+inline AssetRegistry &Assets()
+{
+    static AssetRegistry registry;
+    return registry;
+}
+
+#endif
@@ -115,6 +115,15 @@ class Camera
             updateCameraVectors();
         }
 
+        // Places the camera directly, e.g. when it follows a scripted path
+        void SetPose(glm::vec3 position, float yaw, float pitch)
+        {
+            Position = position;
+            Yaw = yaw;
+            Pitch = pitch;
+            updateCameraVectors();
+        }
+
         // Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
         void ProcessMouseScroll(float yoffset)
         {
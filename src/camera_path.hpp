@@ -0,0 +1,95 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A scripted camera flight: keyframes of "time x y z yaw pitch" (seconds, world units, degrees), one per line,
+// '#' starts a comment. The camera is linearly interpolated between keyframes and the path loops.
+class CameraPath
+{
+    public:
+        struct Keyframe
+        {
+            float Time;
+            glm::vec3 Position;
+            float Yaw;
+            float Pitch;
+        };
+
+        std::vector<Keyframe> Keyframes;
+
+        bool Load(const std::string &path)
+        {
+            std::ifstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::CAMERA_PATH: can't open " << path << std::endl;
+                return false;
+            }
+            Keyframes.clear();
+            std::string line;
+            unsigned int lineNumber = 0;
+            while (std::getline(file, line))
+            {
+                lineNumber++;
+                line = line.substr(0, line.find('#'));
+                std::istringstream in(line);
+                Keyframe key;
+                if (!(in >> key.Time))
+                    continue; // blank line
+                if (!(in >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch))
+                {
+                    std::cout << "ERROR::CAMERA_PATH: " << path << ":" << lineNumber << ": expected 'time x y z yaw pitch'" << std::endl;
+                    return false;
+                }
+                if (!Keyframes.empty() && key.Time <= Keyframes.back().Time)
+                {
+                    std::cout << "ERROR::CAMERA_PATH: " << path << ":" << lineNumber << ": keyframe times must increase" << std::endl;
+                    return false;
+                }
+                Keyframes.push_back(key);
+            }
+            return !Keyframes.empty();
+        }
+
+        bool Empty() const
+        {
+            return Keyframes.empty();
+        }
+
+        // seconds until the path starts over
+        float Duration() const
+        {
+            return Keyframes.empty() ? 0.0f : Keyframes.back().Time;
+        }
+
+        // moves the camera to where the path is at the given time
+        void Apply(Camera &camera, float time) const
+        {
+            if (Keyframes.empty())
+                return;
+            if (Keyframes.size() == 1 || Duration() <= 0.0f)
+            {
+                camera.SetPose(Keyframes[0].Position, Keyframes[0].Yaw, Keyframes[0].Pitch);
+                return;
+            }
+            time = std::fmod(time, Duration());
+            unsigned int next = 1;
+            while (next < Keyframes.size() - 1 && Keyframes[next].Time < time)
+                next++;
+            const Keyframe &a = Keyframes[next - 1];
+            const Keyframe &b = Keyframes[next];
+            float t = glm::clamp((time - a.Time) / (b.Time - a.Time), 0.0f, 1.0f);
+            camera.SetPose(glm::mix(a.Position, b.Position, t), glm::mix(a.Yaw, b.Yaw, t), glm::mix(a.Pitch, b.Pitch, t));
+        }
+};
+#endif
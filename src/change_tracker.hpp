@@ -0,0 +1,104 @@
+#ifndef CHANGE_TRACKER_H
+#define CHANGE_TRACKER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "hash.hpp"
+
+// What the passes of a frame depend on, see ChangeTracker
+enum ChangeCategory
+{
+    CHANGE_GEOMETRY, // camera, transforms, models, render size, textures: the G-buffer
+    CHANGE_LIGHTING, // lights and lighting options
+    CHANGE_OVERLAY,  // what is drawn over the lit scene and how it is presented
+    CHANGE_CATEGORY_COUNT
+};
+
+// Default change tracking values
+const unsigned int CHANGE_SETTLE_FRAMES = 2; // some inputs (previous frame's Hi-Z, GPU timers) lag a frame behind
+
+// Tells which parts of a frame have to be rendered again. Every frame the inputs of each category are hashed
+// between Begin() and End(); a category is changed if its hash differs from the last frame's, and stays so for
+// a few more frames so that inputs derived from the previous frame can settle before its result is reused.
+class ChangeTracker
+{
+    public:
+        unsigned int SettleFrames;
+
+        ChangeTracker()
+            : SettleFrames(CHANGE_SETTLE_FRAMES), current(CHANGE_CATEGORY_COUNT, 0), previous(CHANGE_CATEGORY_COUNT, 0),
+              settling(CHANGE_CATEGORY_COUNT, 0), invalidated(true),
+              touches(0)
+        {
+        }
+
+        void Begin()
+        {
+            for (unsigned int i = 0; i < CHANGE_CATEGORY_COUNT; i++)
+                current[i] = HASH_SEED;
+        }
+
+        // hashes the bytes of a plain value (matrices, vectors, flags, pointers)
+        template <typename T>
+        void Add(ChangeCategory category, const T &value)
+        {
+            current[category] = HashBytes(&value, sizeof(T), current[category]);
+        }
+
+        template <typename T>
+        void Add(ChangeCategory category, const std::vector<T> &values)
+        {
+            Add(category, values.size());
+            if (!values.empty())
+                current[category] = HashBytes(&values[0], values.size() * sizeof(T), current[category]);
+        }
+
+        // marks a category changed this frame without hashing anything, e.g. when textures were restreamed
+        void Touch(ChangeCategory category)
+        {
+            Add(category, ++touches);
+        }
+
+        // everything is changed this frame, e.g. after rebuilding the render targets or when the window was damaged
+        void Invalidate()
+        {
+            invalidated = true;
+        }
+
+        void End()
+        {
+            for (unsigned int i = 0; i < CHANGE_CATEGORY_COUNT; i++)
+            {
+                if (invalidated || current[i] != previous[i])
+                    settling[i] = SettleFrames + 1;
+                else if (settling[i] > 0)
+                    settling[i]--;
+                previous[i] = current[i];
+            }
+            invalidated = false;
+        }
+
+        // true if the category changed this frame (or recently enough to be still settling); valid after End()
+        bool Changed(ChangeCategory category) const
+        {
+            return settling[category] > 0;
+        }
+
+        bool AnyChanged() const
+        {
+            for (unsigned int i = 0; i < CHANGE_CATEGORY_COUNT; i++)
+                if (settling[i] > 0)
+                    return true;
+            return false;
+        }
+
+    private:
+        std::vector<uint64_t> current;
+        std::vector<uint64_t> previous;
+        std::vector<unsigned int> settling;
+        bool invalidated;
+        uint64_t touches;
+};
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef CPU_LIGHTING_H
+#define CPU_LIGHTING_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_LIGHTING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CPU_LIGHTING_SSE2
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "gl_state.hpp"
+#include "worker_pool.hpp"
+
+// Default CPU lighting values
+const unsigned int CPU_LIGHTING_TILE_SIZE = 16;  // pixels per tile side
+const float CPU_LIGHTING_CUTOFF = 1.0f / 512.0f; // a light contributing less than this to a tile is left out of its list
+
+// Point light as the lighting pass shader takes it
+struct CpuLight
+{
+    glm::vec3 Position;
+    glm::vec3 Color;
+    float Linear;
+    float Quadratic;
+};
+
+// A G-buffer in main memory, one plane per channel (structure of arrays). Planes are stored tile after tile,
+// CPU_LIGHTING_TILE_SIZE squared pixels each, row by row inside a tile, so a tile is contiguous in every plane.
+// The edges are padded to whole tiles. Rows go bottom to top as in GL textures.
+class CpuGBuffer
+{
+    public:
+        int Width, Height;
+        int TilesX, TilesY;
+        std::vector<float> PositionX, PositionY, PositionZ;
+        std::vector<float> NormalX, NormalY, NormalZ;
+        std::vector<float> AlbedoR, AlbedoG, AlbedoB, Specular;
+
+        CpuGBuffer()
+            : Width(0), Height(0), TilesX(0), TilesY(0)
+        {
+        }
+
+        void Resize(int width, int height)
+        {
+            Width = width;
+            Height = height;
+            TilesX = (width + CPU_LIGHTING_TILE_SIZE - 1) / CPU_LIGHTING_TILE_SIZE;
+            TilesY = (height + CPU_LIGHTING_TILE_SIZE - 1) / CPU_LIGHTING_TILE_SIZE;
+            size_t size = (size_t)TilesX * TilesY * CPU_LIGHTING_TILE_SIZE * CPU_LIGHTING_TILE_SIZE;
+            std::vector<float> *planes[] = { &PositionX, &PositionY, &PositionZ, &NormalX, &NormalY, &NormalZ,
+                                             &AlbedoR, &AlbedoG, &AlbedoB, &Specular };
+            for (unsigned int p = 0; p < sizeof(planes) / sizeof(planes[0]); p++)
+                planes[p]->assign(size, 0.0f);
+        }
+
+        // index of pixel (x, y) in the planes
+        size_t Index(int x, int y) const
+        {
+            int tile = (y / CPU_LIGHTING_TILE_SIZE) * TilesX + x / CPU_LIGHTING_TILE_SIZE;
+            return (size_t)tile * CPU_LIGHTING_TILE_SIZE * CPU_LIGHTING_TILE_SIZE +
+                   (y % CPU_LIGHTING_TILE_SIZE) * CPU_LIGHTING_TILE_SIZE + x % CPU_LIGHTING_TILE_SIZE;
+        }
+
+        // fills the planes from interleaved rows: positions and normals as 3 floats, albedo and specular as 4
+        void Set(const float *positions, const float *normals, const float *albedoSpec)
+        {
+            for (int y = 0; y < Height; y++)
+                for (int x = 0; x < Width; x++)
+                {
+                    size_t source = (size_t)y * Width + x;
+                    size_t i = Index(x, y);
+                    PositionX[i] = positions[source * 3];
+                    PositionY[i] = positions[source * 3 + 1];
+                    PositionZ[i] = positions[source * 3 + 2];
+                    NormalX[i] = normals[source * 3];
+                    NormalY[i] = normals[source * 3 + 1];
+                    NormalZ[i] = normals[source * 3 + 2];
+                    AlbedoR[i] = albedoSpec[source * 4];
+                    AlbedoG[i] = albedoSpec[source * 4 + 1];
+                    AlbedoB[i] = albedoSpec[source * 4 + 2];
+                    Specular[i] = albedoSpec[source * 4 + 3];
+                }
+        }
+
+        // reads the G-buffer textures of the deferred path back, they must be width x height. Needs the context.
+        void ReadBack(GLuint position, GLuint normal, GLuint albedoSpec, int width, int height)
+        {
+            if (width != Width || height != Height)
+                Resize(width, height);
+            positions.resize((size_t)width * height * 3);
+            normals.resize((size_t)width * height * 3);
+            albedoSpecs.resize((size_t)width * height * 4);
+            GLState().BindTexture(GL_TEXTURE_2D, position);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &positions[0]);
+            GLState().BindTexture(GL_TEXTURE_2D, normal);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &normals[0]);
+            GLState().BindTexture(GL_TEXTURE_2D, albedoSpec);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &albedoSpecs[0]);
+            Set(&positions[0], &normals[0], &albedoSpecs[0]);
+        }
+
+    private:
+        // readback scratch
+        std::vector<float> positions, normals, albedoSpecs;
+};
+
+// Per-lane arithmetic of the lighting kernel, for a single float and for the SIMD registers compiled in. Only
+// correctly rounded IEEE operations are used (no reciprocal estimates, no fused multiply-add), so every width
+// produces the same bits for the same pixel.
+inline void lightingStore(float *p, float v) { *p = v; }
+inline float lightingAdd(float a, float b) { return a + b; }
+inline float lightingSub(float a, float b) { return a - b; }
+inline float lightingMul(float a, float b) { return a * b; }
+inline float lightingDiv(float a, float b) { return a / b; }
+inline float lightingSqrt(float a) { return std::sqrt(a); }
+inline float lightingMax(float a, float b) { return a > b ? a : b; } // as maxps: b if either is NaN or both are zero
+#ifdef CPU_LIGHTING_AVX2
+typedef __m256 CpuLightingLanes;
+inline __m256 lightingSet(float v, __m256) { return _mm256_set1_ps(v); }
+inline __m256 lightingLoad(const float *p, __m256) { return _mm256_loadu_ps(p); }
+inline void lightingStore(float *p, __m256 v) { _mm256_storeu_ps(p, v); }
+inline __m256 lightingAdd(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+inline __m256 lightingSub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+inline __m256 lightingMul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+inline __m256 lightingDiv(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+inline __m256 lightingSqrt(__m256 a) { return _mm256_sqrt_ps(a); }
+inline __m256 lightingMax(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+#elif defined(CPU_LIGHTING_SSE2)
+typedef __m128 CpuLightingLanes;
+inline __m128 lightingSet(float v, __m128) { return _mm_set1_ps(v); }
+inline __m128 lightingLoad(const float *p, __m128) { return _mm_loadu_ps(p); }
+inline void lightingStore(float *p, __m128 v) { _mm_storeu_ps(p, v); }
+inline __m128 lightingAdd(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+inline __m128 lightingSub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+inline __m128 lightingMul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+inline __m128 lightingDiv(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+inline __m128 lightingSqrt(__m128 a) { return _mm_sqrt_ps(a); }
+inline __m128 lightingMax(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+#else
+typedef float CpuLightingLanes;
+#endif
+inline float lightingSet(float v, float) { return v; }
+inline float lightingLoad(const float *p, float) { return *p; }
+
+// The lighting pass on the CPU: the Blinn-Phong point lights of lighting_pass.fs evaluated on a CpuGBuffer, tile by
+// tile on the shared worker threads, CpuLightingLanes pixels at a time (8 with AVX2, 4 with SSE2). Each tile only
+// goes through the lights whose attenuated contribution can reach it, from the bounding box of its positions.
+// Only the per-pixel variant of the shader is mirrored: every light given is a point light (POINT_LIGHTS is the
+// size of the list), there is no BAKED_LIGHTING irradiance grid and no baked slot.
+//  - As the headless lighting path: read the G-buffer back, Shade(), upload the result to the lit scene texture.
+//  - As a reference for the shader: with CullLights off the result is bit for bit what ShadePixel() computes,
+//    whatever the thread count or instruction set. The shader itself only matches up to its own precision
+//    (inversesqrt, pow), see the benchmark's --validate-lighting.
+class CpuLighting
+{
+    public:
+        unsigned int ThreadCount;
+        bool CullLights;
+        float Cutoff;
+        // statistics of the last Shade()
+        unsigned int TileCount;
+        float LightsPerTile; // average length of the tile light lists
+        float Time;          // milliseconds
+
+        CpuLighting()
+            : CullLights(true), Cutoff(CPU_LIGHTING_CUTOFF), TileCount(0), LightsPerTile(0.0f), Time(0.0f), nextTile(0), lightChecks(0)
+        {
+            ThreadCount = WorkerPool::HardwareThreads();
+        }
+
+        // lights the G-buffer into rgba, 4 floats per pixel in rows bottom to top, alpha 1
+        void Shade(const CpuGBuffer &gBuffer, const std::vector<CpuLight> &lights, const glm::vec3 &viewPos,
+                   std::vector<float> &rgba)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            rgba.resize((size_t)gBuffer.Width * gBuffer.Height * 4);
+            if (rgba.empty())
+                return;
+            radii.resize(lights.size());
+            for (unsigned int l = 0; l < lights.size(); l++)
+                radii[l] = CullLights ? lightRadius(lights[l]) : FLT_MAX;
+            TileCount = (unsigned int)(gBuffer.TilesX * gBuffer.TilesY);
+            nextTile = 0;
+            lightChecks = 0;
+            job.GBuffer = &gBuffer;
+            job.Lights = &lights;
+            job.ViewPos = viewPos;
+            job.Output = &rgba[0];
+
+            Workers().Run(std::min(ThreadCount, TileCount), [this]() { shadeTiles(); });
+
+            LightsPerTile = TileCount > 0 ? (float)lightChecks / TileCount : 0.0f;
+            Time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // the lighting of one pixel, as the shader writes it
+        static glm::vec3 ShadePixel(const glm::vec3 &position, const glm::vec3 &normal, const glm::vec3 &albedo, float specular,
+                                    const std::vector<CpuLight> &lights, const glm::vec3 &viewPos)
+        {
+            float p[3] = { position.x, position.y, position.z }, n[3] = { normal.x, normal.y, normal.z };
+            float a[3] = { albedo.x, albedo.y, albedo.z };
+            float out[3];
+            std::vector<unsigned int> all(lights.size());
+            for (unsigned int l = 0; l < lights.size(); l++)
+                all[l] = l;
+            shadeLanes<float>(p, p + 1, p + 2, n, n + 1, n + 2, a, a + 1, a + 2, &specular, lights,
+                              all.empty() ? 0 : &all[0], (unsigned int)all.size(), viewPos, out, out + 1, out + 2);
+            return glm::vec3(out[0], out[1], out[2]);
+        }
+
+        // distance beyond which a light adds less than the cutoff to any pixel: albedo and specular are at most 1,
+        // so ambient, diffuse and specular together are at most 3 * color * attenuation
+        float lightRadius(const CpuLight &light) const
+        {
+            float brightest = std::max(std::max(light.Color.x, light.Color.y), light.Color.z);
+            if (brightest <= 0.0f)
+                return 0.0f;
+            // 1 / (1 + linear d + quadratic d^2) = cutoff / (3 brightest)
+            float inverse = 3.0f * brightest / Cutoff;
+            if (inverse <= 1.0f)
+                return 0.0f;
+            if (light.Quadratic > 0.0f)
+                return (-light.Linear + std::sqrt(light.Linear * light.Linear + 4.0f * light.Quadratic * (inverse - 1.0f))) /
+                       (2.0f * light.Quadratic);
+            if (light.Linear > 0.0f)
+                return (inverse - 1.0f) / light.Linear;
+            return FLT_MAX;
+        }
+
+    private:
+        struct Job
+        {
+            const CpuGBuffer *GBuffer;
+            const std::vector<CpuLight> *Lights;
+            glm::vec3 ViewPos;
+            float *Output;
+        };
+
+        Job job;
+        std::vector<float> radii;
+        std::atomic<unsigned int> nextTile;
+        std::atomic<unsigned int> lightChecks;
+
+        // takes tiles until none is left
+        void shadeTiles()
+        {
+            const CpuGBuffer &g = *job.GBuffer;
+            const std::vector<CpuLight> &lights = *job.Lights;
+            const unsigned int tilePixels = CPU_LIGHTING_TILE_SIZE * CPU_LIGHTING_TILE_SIZE;
+            const unsigned int lanes = sizeof(CpuLightingLanes) / sizeof(float);
+            std::vector<unsigned int> list;
+            float r[tilePixels], gr[tilePixels], b[tilePixels];
+            unsigned int checks = 0;
+            for (;;)
+            {
+                unsigned int tile = nextTile++;
+                if (tile >= TileCount)
+                    break;
+                size_t base = (size_t)tile * tilePixels;
+                int tileX = (int)(tile % g.TilesX) * CPU_LIGHTING_TILE_SIZE, tileY = (int)(tile / g.TilesX) * CPU_LIGHTING_TILE_SIZE;
+
+                // light list: lights whose sphere of influence touches the bounding box of the tile's positions
+                glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+                for (unsigned int i = 0; i < tilePixels; i++)
+                {
+                    glm::vec3 p(g.PositionX[base + i], g.PositionY[base + i], g.PositionZ[base + i]);
+                    boundsMin = glm::min(boundsMin, p);
+                    boundsMax = glm::max(boundsMax, p);
+                }
+                list.clear();
+                for (unsigned int l = 0; l < lights.size(); l++)
+                {
+                    if (radii[l] == FLT_MAX)
+                    {
+                        list.push_back(l);
+                        continue;
+                    }
+                    glm::vec3 nearest = glm::min(glm::max(lights[l].Position, boundsMin), boundsMax);
+                    glm::vec3 offset = lights[l].Position - nearest;
+                    if (glm::dot(offset, offset) <= radii[l] * radii[l])
+                        list.push_back(l);
+                }
+                checks += (unsigned int)list.size();
+
+                for (unsigned int i = 0; i < tilePixels; i += lanes)
+                    shadeLanes<CpuLightingLanes>(&g.PositionX[base + i], &g.PositionY[base + i], &g.PositionZ[base + i],
+                                                 &g.NormalX[base + i], &g.NormalY[base + i], &g.NormalZ[base + i],
+                                                 &g.AlbedoR[base + i], &g.AlbedoG[base + i], &g.AlbedoB[base + i],
+                                                 &g.Specular[base + i], lights, list.empty() ? 0 : &list[0],
+                                                 (unsigned int)list.size(), job.ViewPos, r + i, gr + i, b + i);
+
+                // back to interleaved rows, without the padding
+                for (unsigned int y = 0; y < CPU_LIGHTING_TILE_SIZE && tileY + (int)y < g.Height; y++)
+                    for (unsigned int x = 0; x < CPU_LIGHTING_TILE_SIZE && tileX + (int)x < g.Width; x++)
+                    {
+                        unsigned int i = y * CPU_LIGHTING_TILE_SIZE + x;
+                        float *out = job.Output + ((size_t)(tileY + y) * g.Width + tileX + x) * 4;
+                        out[0] = r[i];
+                        out[1] = gr[i];
+                        out[2] = b[i];
+                        out[3] = 1.0f;
+                    }
+            }
+            lightChecks += checks;
+        }
+
+        // lighting_pass.fs without BAKED_LIGHTING for a group of pixels, operation for operation
+        template <typename V>
+        static void shadeLanes(const float *px, const float *py, const float *pz, const float *nx, const float *ny, const float *nz,
+                               const float *ar, const float *ag, const float *ab, const float *sp,
+                               const std::vector<CpuLight> &lights, const unsigned int *list, unsigned int count,
+                               const glm::vec3 &viewPos, float *outR, float *outG, float *outB)
+        {
+            const V kind = V();
+            const V zero = lightingSet(0.0f, kind), one = lightingSet(1.0f, kind);
+            V x = lightingLoad(px, kind), y = lightingLoad(py, kind), z = lightingLoad(pz, kind);
+            V normalX = lightingLoad(nx, kind), normalY = lightingLoad(ny, kind), normalZ = lightingLoad(nz, kind);
+            V diffuseR = lightingLoad(ar, kind), diffuseG = lightingLoad(ag, kind), diffuseB = lightingLoad(ab, kind);
+            V specular = lightingLoad(sp, kind);
+
+            // viewDir = normalize(viewPos - FragPos)
+            V viewX = lightingSub(lightingSet(viewPos.x, kind), x);
+            V viewY = lightingSub(lightingSet(viewPos.y, kind), y);
+            V viewZ = lightingSub(lightingSet(viewPos.z, kind), z);
+            V viewLength = lightingSqrt(dot(viewX, viewY, viewZ, viewX, viewY, viewZ));
+            viewX = lightingDiv(viewX, viewLength);
+            viewY = lightingDiv(viewY, viewLength);
+            viewZ = lightingDiv(viewZ, viewLength);
+
+            V lightingR = lightingSet(0.01f, kind), lightingG = lightingR, lightingB = lightingR; // hard-coded ambient
+            for (unsigned int l = 0; l < count; l++)
+            {
+                const CpuLight &light = lights[list[l]];
+                V colorR = lightingSet(light.Color.x, kind), colorG = lightingSet(light.Color.y, kind), colorB = lightingSet(light.Color.z, kind);
+                // ambient
+                V ambientR = lightingMul(diffuseR, colorR), ambientG = lightingMul(diffuseG, colorG), ambientB = lightingMul(diffuseB, colorB);
+                // diffuse
+                V toLightX = lightingSub(lightingSet(light.Position.x, kind), x);
+                V toLightY = lightingSub(lightingSet(light.Position.y, kind), y);
+                V toLightZ = lightingSub(lightingSet(light.Position.z, kind), z);
+                V distance = lightingSqrt(dot(toLightX, toLightY, toLightZ, toLightX, toLightY, toLightZ));
+                V lightDirX = lightingDiv(toLightX, distance), lightDirY = lightingDiv(toLightY, distance), lightDirZ = lightingDiv(toLightZ, distance);
+                V lambert = lightingMax(dot(normalX, normalY, normalZ, lightDirX, lightDirY, lightDirZ), zero);
+                V diffR = lightingMul(lightingMul(lambert, diffuseR), colorR);
+                V diffG = lightingMul(lightingMul(lambert, diffuseG), colorG);
+                V diffB = lightingMul(lightingMul(lambert, diffuseB), colorB);
+                // specular
+                V halfX = lightingAdd(lightDirX, viewX), halfY = lightingAdd(lightDirY, viewY), halfZ = lightingAdd(lightDirZ, viewZ);
+                V halfLength = lightingSqrt(dot(halfX, halfY, halfZ, halfX, halfY, halfZ));
+                halfX = lightingDiv(halfX, halfLength);
+                halfY = lightingDiv(halfY, halfLength);
+                halfZ = lightingDiv(halfZ, halfLength);
+                V spec = lightingMax(dot(normalX, normalY, normalZ, halfX, halfY, halfZ), zero);
+                spec = lightingMul(spec, spec); // pow(spec, 16.0)
+                spec = lightingMul(spec, spec);
+                spec = lightingMul(spec, spec);
+                spec = lightingMul(spec, spec);
+                V specR = lightingMul(lightingMul(colorR, spec), specular);
+                V specG = lightingMul(lightingMul(colorG, spec), specular);
+                V specB = lightingMul(lightingMul(colorB, spec), specular);
+                // attenuation
+                V attenuation = lightingDiv(one, lightingAdd(lightingAdd(one, lightingMul(lightingSet(light.Linear, kind), distance)),
+                                                             lightingMul(lightingMul(lightingSet(light.Quadratic, kind), distance), distance)));
+                lightingR = lightingAdd(lightingR, lightingAdd(lightingAdd(lightingMul(ambientR, attenuation), lightingMul(diffR, attenuation)),
+                                                               lightingMul(specR, attenuation)));
+                lightingG = lightingAdd(lightingG, lightingAdd(lightingAdd(lightingMul(ambientG, attenuation), lightingMul(diffG, attenuation)),
+                                                               lightingMul(specG, attenuation)));
+                lightingB = lightingAdd(lightingB, lightingAdd(lightingAdd(lightingMul(ambientB, attenuation), lightingMul(diffB, attenuation)),
+                                                               lightingMul(specB, attenuation)));
+            }
+            lightingStore(outR, lightingR);
+            lightingStore(outG, lightingG);
+            lightingStore(outB, lightingB);
+        }
+
+        template <typename V>
+        static V dot(V ax, V ay, V az, V bx, V by, V bz)
+        {
+            return lightingAdd(lightingAdd(lightingMul(ax, bx), lightingMul(ay, by)), lightingMul(az, bz));
+        }
+};
+#endif
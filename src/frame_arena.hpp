@@ -0,0 +1,131 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Default frame arena values
+const size_t FRAME_ARENA_CAPACITY = 64 * 1024;
+const size_t FRAME_ARENA_ALIGNMENT = 16;
+
+// Linear allocator for data that only lives until the end of the frame (uniform names, scratch arrays): an
+// allocation bumps an offset into one block, Reset() at the start of the next frame takes everything back at
+// once. Nothing is destroyed, so only trivially destructible types belong in it. A frame that needs more than the
+// block holds gets overflow blocks from malloc, and the next Reset() replaces the block with one large enough for
+// that frame, so a steady state never touches the heap.
+class FrameArena
+{
+    public:
+        size_t Used;      // bytes handed out since the last Reset()
+        size_t Peak;      // highest Used seen at a Reset()
+        unsigned int Overflows; // allocations that didn't fit the block since the last Reset()
+
+        explicit FrameArena(size_t capacity = FRAME_ARENA_CAPACITY)
+            : Used(0), Peak(0), Overflows(0), block(0), capacity(0), offset(0)
+        {
+            grow(capacity);
+        }
+
+        ~FrameArena()
+        {
+            releaseOverflow();
+            std::free(block);
+        }
+
+        // takes back everything allocated since the last Reset(); call once at the start of a frame
+        void Reset()
+        {
+            Peak = std::max(Peak, Used);
+            if (!overflow.empty())
+            {
+                releaseOverflow();
+                grow(std::max(capacity * 2, Used + Used / 2));
+            }
+            Used = 0;
+            offset = 0;
+            Overflows = 0;
+        }
+
+        // uninitialized memory valid until the next Reset()
+        void *Allocate(size_t bytes, size_t alignment = FRAME_ARENA_ALIGNMENT)
+        {
+            size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            Used += bytes;
+            if (start + bytes <= capacity)
+            {
+                offset = start + bytes;
+                return block + start;
+            }
+            Overflows++;
+            void *p = std::malloc(std::max(bytes, (size_t)1));
+            if (!p)
+                throw std::bad_alloc();
+            overflow.push_back(p);
+            return p;
+        }
+
+        template <typename T>
+        T *Array(size_t count)
+        {
+            return static_cast<T*>(Allocate(count * sizeof(T), std::max(alignof(T), (size_t)1)));
+        }
+
+        // printf into the arena, e.g. a uniform name for this frame
+        const char *Format(const char *format, ...)
+        {
+            va_list args, measure;
+            va_start(args, format);
+            va_copy(measure, args);
+            int length = std::vsnprintf(0, 0, format, measure);
+            va_end(measure);
+            char *text = Array<char>(length > 0 ? length + 1 : 1);
+            if (length > 0)
+                std::vsnprintf(text, length + 1, format, args);
+            else
+                text[0] = '\0';
+            va_end(args);
+            return text;
+        }
+
+        size_t Capacity() const
+        {
+            return capacity;
+        }
+
+    private:
+        char *block;
+        size_t capacity;
+        size_t offset;
+        std::vector<void*> overflow; // reserved up front, only grows past that in a pathological frame
+
+        void grow(size_t bytes)
+        {
+            std::free(block);
+            capacity = (bytes + FRAME_ARENA_ALIGNMENT - 1) & ~(FRAME_ARENA_ALIGNMENT - 1);
+            block = static_cast<char*>(std::malloc(capacity));
+            if (!block)
+                throw std::bad_alloc();
+            overflow.reserve(64);
+        }
+
+        void releaseOverflow()
+        {
+            for (unsigned int i = 0; i < overflow.size(); i++)
+                std::free(overflow[i]);
+            overflow.clear();
+        }
+};
+
+// the arena of the render thread
+inline FrameArena &FrameMemory()
+{
+    static FrameArena arena;
+    return arena;
+}
+
+#endif
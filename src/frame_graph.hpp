@@ -0,0 +1,590 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <glad/glad.h>
+
+#include "gl_caps.hpp"
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Handle to a virtual resource of the frame graph
+typedef int FrameGraphResource;
+const FrameGraphResource FRAME_GRAPH_INVALID = -1;
+
+// What happens to an attachment's previous content when a pass starts
+enum FrameGraphLoadOp
+{
+    FRAME_GRAPH_LOAD,  // keep it, an earlier pass wrote something we build on
+    FRAME_GRAPH_CLEAR  // first use in the frame, clear it
+};
+
+// What happens to an attachment's content when a pass ends
+enum FrameGraphStoreOp
+{
+    FRAME_GRAPH_STORE,    // a later pass (or the presentation engine) needs it
+    FRAME_GRAPH_DISCARD   // last use, the driver can drop it
+};
+
+struct FrameGraphTextureDesc
+{
+    int Width;
+    int Height;
+    GLenum InternalFormat;
+    GLint Filter;
+};
+
+inline bool operator==(const FrameGraphTextureDesc &a, const FrameGraphTextureDesc &b)
+{
+    return a.Width == b.Width && a.Height == b.Height && a.InternalFormat == b.InternalFormat && a.Filter == b.Filter;
+}
+
+// Rough size in bytes of one texel, drivers may pad (e.g. RGB16F stored as RGBA16F)
+inline unsigned int FrameGraphBytesPerPixel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+        case GL_R8:                 return 1;
+        case GL_R16F:               return 2;
+        case GL_RGBA8:
+        case GL_RGBA:
+        case GL_R32F:
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH24_STENCIL8:
+        case GL_DEPTH_COMPONENT32F:
+        case GL_DEPTH_COMPONENT:    return 4;
+        case GL_RGB16F:             return 6;
+        case GL_RGBA16F:            return 8;
+        case GL_RGB32F:             return 12;
+        case GL_RGBA32F:            return 16;
+        default:                    return 4;
+    }
+}
+
+inline bool FrameGraphIsDepthFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_DEPTH_COMPONENT || internalFormat == GL_DEPTH_COMPONENT24 ||
+           internalFormat == GL_DEPTH_COMPONENT32F || internalFormat == GL_DEPTH24_STENCIL8;
+}
+
+// A minimal frame graph: passes declare which textures they read and which they render to, then
+// Compile() works out what the frame actually needs:
+//  - passes whose results are never consumed (and that don't present anything) are culled,
+//  - each transient texture gets a lifetime (first to last pass using it), and textures whose
+//    lifetimes don't overlap and whose descriptions match are aliased onto the same GL texture,
+//  - attachments are cleared on first use, loaded afterwards, and invalidated after their last use.
+// The graph is meant to be built once and executed every frame; rebuild it (Reset + declare + Compile)
+// when the configuration changes, e.g. on resize. Physical textures are pooled across rebuilds.
+// Persistent textures keep their content from one frame to the next, so that a pass whose inputs didn't
+// change can be skipped and its previous results reused.
+class FrameGraph
+{
+    public:
+        typedef std::function<void()> ExecuteFunction;
+
+        // statistics of the last compile
+        unsigned int PassCount;
+        unsigned int CulledPassCount;
+        unsigned int TextureCount;        // virtual transient textures declared by live passes
+        unsigned int PhysicalTextureCount; // GL textures backing them after aliasing
+        size_t PeakBytes;                 // largest sum of simultaneously alive render targets during the frame
+        size_t AllocatedBytes;            // actual render-target memory after aliasing
+        // statistics of the last Execute()
+        unsigned int ExecutedPassCount;
+        unsigned int SkippedPassCount;
+
+        FrameGraph()
+            : PassCount(0), CulledPassCount(0), TextureCount(0), PhysicalTextureCount(0), PeakBytes(0), AllocatedBytes(0),
+              ExecutedPassCount(0), SkippedPassCount(0), invalidateSupported(false), capsQueried(false)
+        {
+        }
+
+        ~FrameGraph()
+        {
+            Reset();
+            for (unsigned int i = 0; i < physical.size(); i++)
+                GLState().DeleteTexture(physical[i].ID);
+        }
+
+        // drops every pass and resource; pooled textures are kept until the next Compile()
+        void Reset()
+        {
+            for (unsigned int i = 0; i < passes.size(); i++)
+                if (passes[i].FBO != 0)
+                    GLState().DeleteFramebuffer(passes[i].FBO);
+            passes.clear();
+            resources.clear();
+        }
+
+        // declares a transient texture; it only exists between the first and last pass using it
+        FrameGraphResource CreateTexture(const std::string &name, const FrameGraphTextureDesc &desc)
+        {
+            Resource resource;
+            resource.Name = name;
+            resource.Desc = desc;
+            resource.Imported = false;
+            resource.Persistent = false;
+            resources.push_back(resource);
+            return (FrameGraphResource)resources.size() - 1;
+        }
+
+        // declares the default framebuffer; writing to it makes a pass a side effect of the frame
+        FrameGraphResource ImportBackbuffer(const std::string &name, int width, int height)
+        {
+            Resource resource;
+            resource.Name = name;
+            resource.Desc.Width = width;
+            resource.Desc.Height = height;
+            resource.Desc.InternalFormat = GL_RGBA8;
+            resource.Desc.Filter = GL_NEAREST;
+            resource.Imported = true;
+            resource.Persistent = false;
+            resources.push_back(resource);
+            return (FrameGraphResource)resources.size() - 1;
+        }
+
+        unsigned int AddPass(const std::string &name, ExecuteFunction execute)
+        {
+            Pass pass;
+            pass.Name = name;
+            pass.Execute = execute;
+            pass.Depth = FRAME_GRAPH_INVALID;
+            pass.SideEffect = false;
+            pass.Culled = false;
+            pass.Skipped = false;
+            pass.FBO = 0;
+            passes.push_back(pass);
+            return (unsigned int)passes.size() - 1;
+        }
+
+        // the pass samples the resource
+        void Read(unsigned int pass, FrameGraphResource resource)
+        {
+            passes[pass].Reads.push_back(resource);
+        }
+
+        // the pass renders into the resource; color attachments are bound in declaration order.
+        // A pass writing the backbuffer renders into the default framebuffer and its depth buffer.
+        void Write(unsigned int pass, FrameGraphResource resource)
+        {
+            Pass &p = passes[pass];
+            if (resources[resource].Imported)
+                p.SideEffect = true;
+            if (FrameGraphIsDepthFormat(resources[resource].Desc.InternalFormat))
+                p.Depth = resource;
+            else
+                p.Colors.push_back(resource);
+        }
+
+        // keeps a pass alive even when nothing reads what it writes (e.g. readbacks)
+        void SetSideEffect(unsigned int pass)
+        {
+            passes[pass].SideEffect = true;
+        }
+
+        // the texture gets a GL texture of its own that is never aliased nor invalidated, so that what it holds at
+        // the end of a frame is still there in the next one
+        void SetPersistent(FrameGraphResource resource)
+        {
+            resources[resource].Persistent = true;
+        }
+
+        // skips the pass in the following Execute() calls, until unset. Only for passes whose outputs are
+        // persistent and still valid: later passes load them as they are.
+        void SkipPass(unsigned int pass, bool skip)
+        {
+            passes[pass].Skipped = skip;
+        }
+
+        // GL texture backing a resource, valid after Compile()
+        unsigned int Texture(FrameGraphResource resource) const
+        {
+            return resources[resource].Physical >= 0 ? physical[resources[resource].Physical].ID : 0;
+        }
+
+        void Compile()
+        {
+            if (!capsQueried)
+            {
+                invalidateSupported = HasGLVersion(4, 3);
+                capsQueried = true;
+            }
+            for (unsigned int i = 0; i < resources.size(); i++)
+            {
+                resources[i].FirstUse = -1;
+                resources[i].LastUse = -1;
+                resources[i].Physical = -1;
+            }
+
+            cullPasses();
+            computeLifetimes();
+            allocateTextures();
+            createFramebuffers();
+        }
+
+        void Execute()
+        {
+            ExecutedPassCount = 0;
+            SkippedPassCount = 0;
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                const Pass &pass = passes[i];
+                if (pass.Culled)
+                    continue;
+                if (pass.Skipped)
+                {
+                    SkippedPassCount++;
+                    continue;
+                }
+                ExecutedPassCount++;
+                GLState().BindFramebuffer(GL_FRAMEBUFFER, pass.FBO);
+                // load ops: clear what is used for the first time this frame
+                static const GLfloat clearColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                static const GLfloat clearDepth = 1.0f;
+                for (unsigned int c = 0; c < pass.Colors.size(); c++)
+                    if (pass.ColorLoad[c] == FRAME_GRAPH_CLEAR)
+                        glClearBufferfv(GL_COLOR, c, clearColor);
+                if ((pass.Depth != FRAME_GRAPH_INVALID || pass.FBO == 0) && pass.DepthLoad == FRAME_GRAPH_CLEAR)
+                    glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+                pass.Execute();
+
+                // store ops: let the driver drop attachments nobody will look at again
+                if (invalidateSupported && !pass.Discard.empty())
+                {
+                    GLState().BindFramebuffer(GL_FRAMEBUFFER, pass.FBO);
+                    glInvalidateFramebuffer(GL_FRAMEBUFFER, (GLsizei)pass.Discard.size(), &pass.Discard[0]);
+                }
+            }
+            GLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        // prints the compiled graph, one line per pass
+        void Describe(std::ostream &out) const
+        {
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                const Pass &pass = passes[i];
+                out << "  pass " << i << " '" << pass.Name << "'" << (pass.Culled ? " (culled)" : "")
+                    << (pass.Skipped ? " (skipped)" : "");
+                for (unsigned int c = 0; c < pass.Colors.size(); c++)
+                    out << " " << describeAttachment(pass.Colors[c], pass.ColorLoad.empty() ? FRAME_GRAPH_LOAD : pass.ColorLoad[c]);
+                if (pass.Depth != FRAME_GRAPH_INVALID)
+                    out << " " << describeAttachment(pass.Depth, pass.DepthLoad);
+                out << std::endl;
+            }
+            out << "  " << TextureCount << " render targets on " << PhysicalTextureCount << " textures, peak "
+                << PeakBytes / (1024 * 1024) << " MB, allocated " << AllocatedBytes / (1024 * 1024) << " MB" << std::endl;
+        }
+
+    private:
+        struct Resource
+        {
+            std::string Name;
+            FrameGraphTextureDesc Desc;
+            bool Imported;
+            bool Persistent;
+            int FirstUse;
+            int LastUse;
+            int Physical;
+        };
+
+        struct Pass
+        {
+            std::string Name;
+            ExecuteFunction Execute;
+            std::vector<FrameGraphResource> Reads;
+            std::vector<FrameGraphResource> Colors;
+            FrameGraphResource Depth;
+            bool SideEffect;
+            bool Skipped;
+            // compiled state
+            bool Culled;
+            unsigned int FBO;
+            std::vector<FrameGraphLoadOp> ColorLoad;
+            FrameGraphLoadOp DepthLoad;
+            std::vector<GLenum> Discard;
+        };
+
+        struct PhysicalTexture
+        {
+            unsigned int ID;
+            FrameGraphTextureDesc Desc;
+            int BusyUntil; // last pass of the resource currently aliased onto it, INT_MAX for a persistent one
+        };
+
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        std::vector<PhysicalTexture> physical;
+        bool invalidateSupported;
+        bool capsQueried;
+
+        bool writes(const Pass &pass, FrameGraphResource resource) const
+        {
+            return pass.Depth == resource || std::find(pass.Colors.begin(), pass.Colors.end(), resource) != pass.Colors.end();
+        }
+
+        // walks the passes backwards: a pass is needed if it presents something or if a later live pass
+        // consumes one of its outputs. Rendering into a resource written earlier also consumes it, as
+        // the previous content is loaded.
+        void cullPasses()
+        {
+            std::vector<bool> needed(resources.size(), false);
+            std::vector<bool> writtenBefore(resources.size(), false);
+            std::vector<std::vector<FrameGraphResource> > loads(passes.size());
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                Pass &pass = passes[i];
+                std::vector<FrameGraphResource> outputs = pass.Colors;
+                if (pass.Depth != FRAME_GRAPH_INVALID)
+                    outputs.push_back(pass.Depth);
+                for (unsigned int o = 0; o < outputs.size(); o++)
+                {
+                    if (writtenBefore[outputs[o]])
+                        loads[i].push_back(outputs[o]);
+                    writtenBefore[outputs[o]] = true;
+                }
+            }
+
+            PassCount = (unsigned int)passes.size();
+            CulledPassCount = 0;
+            for (int i = (int)passes.size() - 1; i >= 0; i--)
+            {
+                Pass &pass = passes[i];
+                bool live = pass.SideEffect;
+                for (unsigned int r = 0; r < resources.size() && !live; r++)
+                    if (needed[r] && writes(pass, (FrameGraphResource)r))
+                        live = true;
+                pass.Culled = !live;
+                if (!live)
+                {
+                    CulledPassCount++;
+                    continue;
+                }
+                // outputs written from scratch satisfy every later reader
+                for (unsigned int r = 0; r < resources.size(); r++)
+                    if (writes(pass, (FrameGraphResource)r))
+                        needed[r] = false;
+                for (unsigned int r = 0; r < pass.Reads.size(); r++)
+                    needed[pass.Reads[r]] = true;
+                for (unsigned int r = 0; r < loads[i].size(); r++)
+                    needed[loads[i][r]] = true;
+            }
+        }
+
+        void computeLifetimes()
+        {
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                const Pass &pass = passes[i];
+                if (pass.Culled)
+                    continue;
+                std::vector<FrameGraphResource> used = pass.Reads;
+                used.insert(used.end(), pass.Colors.begin(), pass.Colors.end());
+                if (pass.Depth != FRAME_GRAPH_INVALID)
+                    used.push_back(pass.Depth);
+                for (unsigned int u = 0; u < used.size(); u++)
+                {
+                    Resource &resource = resources[used[u]];
+                    if (resource.FirstUse < 0)
+                        resource.FirstUse = i;
+                    resource.LastUse = i;
+                }
+            }
+
+            // peak: largest total size of transient textures alive at the same pass
+            PeakBytes = 0;
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                size_t alive = 0;
+                for (unsigned int r = 0; r < resources.size(); r++)
+                    if (!resources[r].Imported && resources[r].FirstUse >= 0 && resources[r].FirstUse <= (int)i && (int)i <= resources[r].LastUse)
+                        alive += textureBytes(resources[r].Desc);
+                PeakBytes = std::max(PeakBytes, alive);
+            }
+        }
+
+        // greedy interval allocation: resources in order of first use take the first compatible pooled
+        // texture that is free by then, otherwise a new one is created. Persistent resources only take
+        // textures nobody used this frame and keep them.
+        void allocateTextures()
+        {
+            for (unsigned int p = 0; p < physical.size(); p++)
+                physical[p].BusyUntil = -2;
+            std::vector<bool> used(physical.size(), false);
+
+            std::vector<unsigned int> order;
+            for (unsigned int r = 0; r < resources.size(); r++)
+                if (!resources[r].Imported && resources[r].FirstUse >= 0)
+                    order.push_back(r);
+            std::stable_sort(order.begin(), order.end(), FirstUseLess(resources));
+
+            TextureCount = (unsigned int)order.size();
+            for (unsigned int o = 0; o < order.size(); o++)
+            {
+                Resource &resource = resources[order[o]];
+                int chosen = -1;
+                for (unsigned int p = 0; p < physical.size() && chosen < 0; p++)
+                    if (physical[p].Desc == resource.Desc &&
+                        (resource.Persistent ? physical[p].BusyUntil == -2 : physical[p].BusyUntil < resource.FirstUse))
+                        chosen = p;
+                if (chosen < 0)
+                {
+                    PhysicalTexture texture;
+                    texture.Desc = resource.Desc;
+                    texture.ID = createTexture(resource.Desc);
+                    physical.push_back(texture);
+                    used.push_back(false);
+                    chosen = (int)physical.size() - 1;
+                }
+                physical[chosen].BusyUntil = resource.Persistent ? INT_MAX : resource.LastUse;
+                used[chosen] = true;
+                resource.Physical = chosen;
+            }
+
+            // release pooled textures this configuration no longer needs
+            std::vector<PhysicalTexture> kept;
+            std::vector<int> remap(physical.size(), -1);
+            AllocatedBytes = 0;
+            for (unsigned int p = 0; p < physical.size(); p++)
+            {
+                if (!used[p])
+                {
+                    GLState().DeleteTexture(physical[p].ID);
+                    continue;
+                }
+                remap[p] = (int)kept.size();
+                kept.push_back(physical[p]);
+                AllocatedBytes += textureBytes(physical[p].Desc);
+            }
+            physical.swap(kept);
+            for (unsigned int r = 0; r < resources.size(); r++)
+                if (resources[r].Physical >= 0)
+                    resources[r].Physical = remap[resources[r].Physical];
+            PhysicalTextureCount = (unsigned int)physical.size();
+        }
+
+        void createFramebuffers()
+        {
+            for (unsigned int i = 0; i < passes.size(); i++)
+            {
+                Pass &pass = passes[i];
+                pass.ColorLoad.clear();
+                pass.Discard.clear();
+                pass.DepthLoad = FRAME_GRAPH_LOAD;
+                if (pass.Culled)
+                    continue;
+
+                bool backbuffer = false;
+                for (unsigned int c = 0; c < pass.Colors.size(); c++)
+                    backbuffer |= resources[pass.Colors[c]].Imported;
+
+                for (unsigned int c = 0; c < pass.Colors.size(); c++)
+                    pass.ColorLoad.push_back(loadOp(pass.Colors[c], i));
+                if (pass.Depth != FRAME_GRAPH_INVALID)
+                    pass.DepthLoad = loadOp(pass.Depth, i);
+                else if (backbuffer)
+                    pass.DepthLoad = loadOp(pass.Colors[0], i); // the default framebuffer comes with its own depth
+
+                if (backbuffer)
+                {
+                    // the default framebuffer can't be combined with other attachments
+                    pass.FBO = 0;
+                    continue;
+                }
+                if (pass.Colors.empty() && pass.Depth == FRAME_GRAPH_INVALID)
+                {
+                    // compute or readback only pass, nothing to render into
+                    pass.FBO = 0;
+                    continue;
+                }
+
+                glGenFramebuffers(1, &pass.FBO);
+                GLState().BindFramebuffer(GL_FRAMEBUFFER, pass.FBO);
+                std::vector<GLenum> drawBuffers;
+                for (unsigned int c = 0; c < pass.Colors.size(); c++)
+                {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D, Texture(pass.Colors[c]), 0);
+                    drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + c);
+                    if (storeOp(pass.Colors[c], i) == FRAME_GRAPH_DISCARD)
+                        pass.Discard.push_back(GL_COLOR_ATTACHMENT0 + c);
+                }
+                if (drawBuffers.empty())
+                    glDrawBuffer(GL_NONE);
+                else
+                    glDrawBuffers((GLsizei)drawBuffers.size(), &drawBuffers[0]);
+                if (pass.Depth != FRAME_GRAPH_INVALID)
+                {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, Texture(pass.Depth), 0);
+                    if (storeOp(pass.Depth, i) == FRAME_GRAPH_DISCARD)
+                        pass.Discard.push_back(GL_DEPTH_ATTACHMENT);
+                }
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                    std::cout << "Framebuffer of pass '" << pass.Name << "' not complete!" << std::endl;
+            }
+            GLState().BindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        FrameGraphLoadOp loadOp(FrameGraphResource resource, unsigned int pass) const
+        {
+            return resources[resource].FirstUse == (int)pass ? FRAME_GRAPH_CLEAR : FRAME_GRAPH_LOAD;
+        }
+
+        FrameGraphStoreOp storeOp(FrameGraphResource resource, unsigned int pass) const
+        {
+            if (resources[resource].Imported || resources[resource].Persistent || resources[resource].LastUse > (int)pass)
+                return FRAME_GRAPH_STORE;
+            return FRAME_GRAPH_DISCARD;
+        }
+
+        std::string describeAttachment(FrameGraphResource resource, FrameGraphLoadOp load) const
+        {
+            if (resource == FRAME_GRAPH_INVALID)
+                return "";
+            return resources[resource].Name + (load == FRAME_GRAPH_CLEAR ? "[clear]" : "[load]");
+        }
+
+        static size_t textureBytes(const FrameGraphTextureDesc &desc)
+        {
+            return (size_t)desc.Width * desc.Height * FrameGraphBytesPerPixel(desc.InternalFormat);
+        }
+
+        static unsigned int createTexture(const FrameGraphTextureDesc &desc)
+        {
+            GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+            switch (desc.InternalFormat)
+            {
+                case GL_RGB16F: case GL_RGB32F:      format = GL_RGB;  type = GL_FLOAT; break;
+                case GL_RGBA16F: case GL_RGBA32F:    format = GL_RGBA; type = GL_FLOAT; break;
+                case GL_R16F: case GL_R32F:          format = GL_RED;  type = GL_FLOAT; break;
+                case GL_R8:                          format = GL_RED;  type = GL_UNSIGNED_BYTE; break;
+                case GL_DEPTH_COMPONENT:
+                case GL_DEPTH_COMPONENT24:           format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; break;
+                case GL_DEPTH_COMPONENT32F:          format = GL_DEPTH_COMPONENT; type = GL_FLOAT; break;
+                case GL_DEPTH24_STENCIL8:            format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; break;
+            }
+            unsigned int texture;
+            glGenTextures(1, &texture);
+            GLState().BindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.InternalFormat, desc.Width, desc.Height, 0, format, type, NULL);
+            RenderStats().TextureAllocated(texture, GPU_MEMORY_RENDER_TARGETS, textureBytes(desc));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.Filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.Filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            return texture;
+        }
+
+        struct FirstUseLess
+        {
+            const std::vector<Resource> &resources;
+            FirstUseLess(const std::vector<Resource> &r) : resources(r) {}
+            bool operator()(unsigned int a, unsigned int b) const { return resources[a].FirstUse < resources[b].FirstUse; }
+        };
+};
+#endif
@@ -0,0 +1,189 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Default frame pacing values
+const unsigned int FRAME_PACER_FRAMES_IN_FLIGHT = 2;  // submitted and unfinished frames, counting the one starting
+const unsigned int FRAME_PACER_MAX_FRAMES = 8;        // fences tracked, also without a limit
+const GLuint64 FRAME_PACER_WAIT_SLICE = 1000000;      // nanoseconds per glClientWaitSync call
+const float FRAME_PACER_SLEEP_MARGIN = 0.5f;          // milliseconds left to the scheduler's sleep granularity
+
+// Latency control: every submitted frame is followed by a fence. With Limit on, BeginFrame() blocks until fewer
+// than MaxFramesInFlight frames are left on the GPU, so the driver can't queue frames rendered from old input; the
+// caller samples input right after it returns. With Limit on and a TargetFrameTime, frames are due one target apart
+// and BeginFrame() also sleeps until the frame has to start to be submitted on time (judging by how long the last
+// frames took from input to submit), instead of blocking in the buffer swap with input already read.
+// Latencies are averaged since ResetStats(); the GPU completion of a frame is seen when its fence is polled, at the
+// start and the submission of the following frames, so SubmitToComplete can be late by about a frame.
+class FramePacer
+{
+    public:
+        bool Limit;            // latency control on: the frames in flight cap and the target frame time apply
+        unsigned int MaxFramesInFlight;
+        float TargetFrameTime; // milliseconds from one frame start to the next, 0 to run as fast as possible
+        // averaged since ResetStats(), in milliseconds
+        float InputToSubmit;
+        float SubmitToComplete;
+        float FenceWait;       // blocked waiting for the GPU, per frame
+        float Sleep;           // slept to hit the target frame time, per frame
+        unsigned int Frames;
+        unsigned int FramesInFlight; // at the start of the last frame
+
+        FramePacer()
+            : Limit(true), MaxFramesInFlight(FRAME_PACER_FRAMES_IN_FLIGHT), TargetFrameTime(0.0f), FramesInFlight(0),
+              first(0), count(0), workEstimate(0.0f), workEstimated(false), frameStarted(false)
+        {
+            ResetStats();
+        }
+
+        ~FramePacer()
+        {
+            Release();
+        }
+
+        // deletes the fences still pending, call while the context is current
+        void Release()
+        {
+            for (; count > 0; count--, first = (first + 1) % FRAME_PACER_MAX_FRAMES)
+                glDeleteSync(frames[first].Fence);
+            first = 0;
+        }
+
+        void ResetStats()
+        {
+            InputToSubmit = SubmitToComplete = FenceWait = Sleep = 0.0f;
+            Frames = 0;
+            inputToSubmitTotal = submitToCompleteTotal = fenceWaitTotal = sleepTotal = 0.0;
+            completed = 0;
+        }
+
+        // waits for a free frame slot and the frame's start time; sample input right after this returns
+        void BeginFrame()
+        {
+            Clock::time_point start = Clock::now();
+            retire(false);
+            if (Limit)
+                while (count > 0 && count >= std::max(MaxFramesInFlight, 1u))
+                    retire(true);
+            FramesInFlight = count;
+            Clock::time_point waited = Clock::now();
+            fenceWaitTotal += milliseconds(start, waited);
+
+            if (Limit && TargetFrameTime > 0.0f)
+            {
+                // the frame is due one target frame time after the last one; a frame that can't make it any more
+                // starts the schedule over
+                Clock::duration target = std::chrono::microseconds((long long)(TargetFrameTime * 1000.0f));
+                Clock::duration work = std::chrono::microseconds((long long)(workEstimate * 1000.0f));
+                deadline = frameStarted ? deadline + target : waited + target;
+                if (deadline < waited + work)
+                    deadline = waited + work;
+                // start as late as still makes it, so the input is as fresh as possible
+                float wait = milliseconds(waited, deadline) - workEstimate - FRAME_PACER_SLEEP_MARGIN;
+                if (wait > 0.0f)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds((long long)(wait * 1000.0f)));
+                    sleepTotal += milliseconds(waited, Clock::now());
+                }
+            }
+            inputTime = Clock::now();
+            frameStarted = true;
+        }
+
+        // the frame's commands are issued, call right before the buffer swap
+        void Submitting()
+        {
+            submitTime = Clock::now();
+            float work = milliseconds(inputTime, submitTime);
+            inputToSubmitTotal += work;
+            // smoothed, a single slow frame shouldn't shift the start of the next ones much
+            workEstimate = workEstimated ? workEstimate * 0.9f + work * 0.1f : work;
+            workEstimated = true;
+            Frames++;
+        }
+
+        // fences the frame, call right after the buffer swap
+        void Submitted()
+        {
+            if (count == FRAME_PACER_MAX_FRAMES)
+            {
+                // unlimited and far behind: the oldest frame won't be measured
+                glDeleteSync(frames[first].Fence);
+                first = (first + 1) % FRAME_PACER_MAX_FRAMES;
+                count--;
+            }
+            Frame &frame = frames[(first + count) % FRAME_PACER_MAX_FRAMES];
+            frame.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame.Submit = submitTime;
+            count++;
+            // flushed, so the fence is sure to signal without anyone waiting on it
+            glFlush();
+            retire(false);
+            updateAverages();
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Frame
+        {
+            GLsync Fence;
+            Clock::time_point Submit;
+        };
+
+        Frame frames[FRAME_PACER_MAX_FRAMES]; // ring, oldest at first
+        unsigned int first;
+        unsigned int count;
+        Clock::time_point inputTime;
+        Clock::time_point submitTime;
+        Clock::time_point deadline; // submission of the frame, when pacing to a target
+        float workEstimate; // milliseconds from input to submit, kept across ResetStats()
+        bool workEstimated;
+        bool frameStarted;
+        double inputToSubmitTotal, submitToCompleteTotal, fenceWaitTotal, sleepTotal;
+        unsigned int completed;
+
+        static float milliseconds(Clock::time_point from, Clock::time_point to)
+        {
+            return std::chrono::duration<float, std::milli>(to - from).count();
+        }
+
+        // retires the frames the GPU has finished, oldest first; with block, waits for the oldest one
+        void retire(bool block)
+        {
+            while (count > 0)
+            {
+                Frame &frame = frames[first];
+                GLenum status = glClientWaitSync(frame.Fence, 0, 0);
+                while (block && status == GL_TIMEOUT_EXPIRED)
+                    status = glClientWaitSync(frame.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_PACER_WAIT_SLICE);
+                if (status == GL_TIMEOUT_EXPIRED)
+                    return;
+                // a failed wait is retired too, it would block the limit forever
+                if (status != GL_WAIT_FAILED)
+                {
+                    submitToCompleteTotal += milliseconds(frame.Submit, Clock::now());
+                    completed++;
+                }
+                glDeleteSync(frame.Fence);
+                first = (first + 1) % FRAME_PACER_MAX_FRAMES;
+                count--;
+                block = false;
+            }
+        }
+
+        void updateAverages()
+        {
+            InputToSubmit = Frames > 0 ? (float)(inputToSubmitTotal / Frames) : 0.0f;
+            FenceWait = Frames > 0 ? (float)(fenceWaitTotal / Frames) : 0.0f;
+            Sleep = Frames > 0 ? (float)(sleepTotal / Frames) : 0.0f;
+            SubmitToComplete = completed > 0 ? (float)(submitToCompleteTotal / completed) : 0.0f;
+        }
+};
+
+#endif
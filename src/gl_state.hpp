@@ -0,0 +1,368 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include "render_stats.hpp"
+
+// Number of texture units shadowed by the cache, GL guarantees at least 16 per stage
+const unsigned int GL_STATE_TEXTURE_UNITS = 32;
+
+// Thin layer shadowing the OpenGL state the engine touches (program, vertex array, buffers, per-unit
+// textures, framebuffers, depth/blend state and viewport). Calls that would not change anything are
+// dropped before they reach the driver. Every engine GL state change must go through here, otherwise
+// the shadow copy goes stale; use Invalidate() after handing the context to code that doesn't.
+class GLStateCache
+{
+    public:
+        // counters since the last ResetCounters()
+        unsigned int Issued;
+        unsigned int Skipped;
+        // counters of the previous frame
+        unsigned int LastIssued;
+        unsigned int LastSkipped;
+
+        GLStateCache()
+            : Issued(0), Skipped(0), LastIssued(0), LastSkipped(0)
+        {
+            Invalidate();
+        }
+
+        // forget everything, the next call of each kind always reaches the driver
+        void Invalidate()
+        {
+            program = UNKNOWN;
+            vertexArray = UNKNOWN;
+            arrayBuffer = UNKNOWN;
+            elementBuffer = UNKNOWN;
+            uniformBuffer = UNKNOWN;
+            shaderStorageBuffer = UNKNOWN;
+            drawIndirectBuffer = UNKNOWN;
+            drawFramebuffer = UNKNOWN;
+            readFramebuffer = UNKNOWN;
+            renderbuffer = UNKNOWN;
+            activeUnit = UNKNOWN;
+            for (unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+            {
+                textures2D[i] = UNKNOWN;
+                textures3D[i] = UNKNOWN;
+            }
+            depthTest = blend = cullFace = UNKNOWN;
+            depthFunc = UNKNOWN;
+            depthMask = UNKNOWN;
+            colorMask = UNKNOWN;
+            blendSrc = blendDst = UNKNOWN;
+            viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+        }
+
+        // call at the start of every frame
+        void ResetCounters()
+        {
+            LastIssued = Issued;
+            LastSkipped = Skipped;
+            Issued = 0;
+            Skipped = 0;
+        }
+
+        void UseProgram(GLuint id)
+        {
+            if (skip(program, id))
+                return;
+            RenderStats().Count(STAT_PROGRAM_SWITCHES);
+            glUseProgram(id);
+        }
+
+        void BindVertexArray(GLuint id)
+        {
+            if (skip(vertexArray, id))
+                return;
+            glBindVertexArray(id);
+            // the element buffer binding is part of the vertex array object
+            elementBuffer = UNKNOWN;
+        }
+
+        void BindBuffer(GLenum target, GLuint id)
+        {
+            unsigned int *cached = bufferBinding(target);
+            if (cached && skip(*cached, id))
+                return;
+            if (!cached)
+                Issued++;
+            glBindBuffer(target, id);
+        }
+
+        // binds a buffer to an indexed binding point; like the driver, this also changes the generic binding
+        void BindBufferBase(GLenum target, GLuint index, GLuint id)
+        {
+            unsigned int *cached = bufferBinding(target);
+            if (cached)
+                *cached = id;
+            Issued++;
+            glBindBufferBase(target, index, id);
+        }
+
+        void ActiveTexture(unsigned int unit)
+        {
+            if (skip(activeUnit, unit))
+                return;
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+
+        // binds a texture to the given unit, only switching the active unit when something changes
+        void BindTexture(unsigned int unit, GLenum target, GLuint id)
+        {
+            unsigned int *cached = textureBinding(unit, target);
+            if (cached && *cached == id)
+            {
+                Skipped++;
+                return;
+            }
+            ActiveTexture(unit);
+            Issued++;
+            RenderStats().Count(STAT_TEXTURE_BINDS);
+            glBindTexture(target, id);
+            if (cached)
+                *cached = id;
+        }
+
+        // binds a texture on the currently active unit, e.g. to upload or configure it
+        void BindTexture(GLenum target, GLuint id)
+        {
+            BindTexture(activeUnit == UNKNOWN ? 0 : activeUnit, target, id);
+        }
+
+        void BindFramebuffer(GLenum target, GLuint id)
+        {
+            if (target == GL_FRAMEBUFFER)
+            {
+                if (drawFramebuffer == id && readFramebuffer == id)
+                {
+                    Skipped++;
+                    return;
+                }
+                Issued++;
+                drawFramebuffer = readFramebuffer = id;
+            }
+            else if (target == GL_DRAW_FRAMEBUFFER)
+            {
+                if (skip(drawFramebuffer, id))
+                    return;
+            }
+            else if (skip(readFramebuffer, id))
+                return;
+            glBindFramebuffer(target, id);
+        }
+
+        void BindRenderbuffer(GLuint id)
+        {
+            if (skip(renderbuffer, id))
+                return;
+            glBindRenderbuffer(GL_RENDERBUFFER, id);
+        }
+
+        void Enable(GLenum capability)
+        {
+            setCapability(capability, true);
+        }
+
+        void Disable(GLenum capability)
+        {
+            setCapability(capability, false);
+        }
+
+        void DepthFunc(GLenum func)
+        {
+            if (skip(depthFunc, func))
+                return;
+            glDepthFunc(func);
+        }
+
+        void DepthMask(GLboolean flag)
+        {
+            if (skip(depthMask, flag ? 1u : 0u))
+                return;
+            glDepthMask(flag);
+        }
+
+        void ColorMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+        {
+            unsigned int mask = (r ? 1u : 0u) | (g ? 2u : 0u) | (b ? 4u : 0u) | (a ? 8u : 0u);
+            if (skip(colorMask, mask))
+                return;
+            glColorMask(r, g, b, a);
+        }
+
+        void BlendFunc(GLenum src, GLenum dst)
+        {
+            if (blendSrc == src && blendDst == dst)
+            {
+                Skipped++;
+                return;
+            }
+            Issued++;
+            blendSrc = src;
+            blendDst = dst;
+            glBlendFunc(src, dst);
+        }
+
+        void Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+            {
+                Skipped++;
+                return;
+            }
+            Issued++;
+            viewport[0] = x;
+            viewport[1] = y;
+            viewport[2] = width;
+            viewport[3] = height;
+            glViewport(x, y, width, height);
+        }
+
+        // sets one viewport of the viewport array (GL 4.1); viewport 0 is the one Viewport() sets, and as glViewport()
+        // sets every viewport of the array, set it before the others
+        void ViewportIndexed(GLuint index, GLint x, GLint y, GLsizei width, GLsizei height)
+        {
+            if (index == 0)
+            {
+                Viewport(x, y, width, height);
+                return;
+            }
+            Issued++;
+            glViewportIndexedf(index, (GLfloat)x, (GLfloat)y, (GLfloat)width, (GLfloat)height);
+        }
+
+        // deleting a bound object implicitly binds 0, keep the shadow copy in sync
+        void DeleteTexture(GLuint id)
+        {
+            for (unsigned int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+            {
+                if (textures2D[i] == id)
+                    textures2D[i] = 0;
+                if (textures3D[i] == id)
+                    textures3D[i] = 0;
+            }
+            RenderStats().TextureDeleted(id);
+            glDeleteTextures(1, &id);
+        }
+
+        void DeleteFramebuffer(GLuint id)
+        {
+            if (drawFramebuffer == id)
+                drawFramebuffer = 0;
+            if (readFramebuffer == id)
+                readFramebuffer = 0;
+            glDeleteFramebuffers(1, &id);
+        }
+
+        void DeleteBuffer(GLuint id)
+        {
+            unsigned int *bindings[] = { &arrayBuffer, &elementBuffer, &uniformBuffer, &shaderStorageBuffer, &drawIndirectBuffer };
+            for (unsigned int i = 0; i < sizeof(bindings) / sizeof(bindings[0]); i++)
+                if (*bindings[i] == id)
+                    *bindings[i] = 0;
+            RenderStats().BufferDeleted(id);
+            glDeleteBuffers(1, &id);
+        }
+
+        void DeleteVertexArray(GLuint id)
+        {
+            if (vertexArray == id)
+            {
+                vertexArray = 0;
+                elementBuffer = UNKNOWN;
+            }
+            glDeleteVertexArrays(1, &id);
+        }
+
+        void DeleteProgram(GLuint id)
+        {
+            if (program == id)
+                program = UNKNOWN; // a deleted program stays in use until another one is bound
+            glDeleteProgram(id);
+        }
+
+    private:
+        static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+        unsigned int program;
+        unsigned int vertexArray;
+        unsigned int arrayBuffer, elementBuffer, uniformBuffer, shaderStorageBuffer, drawIndirectBuffer;
+        unsigned int drawFramebuffer, readFramebuffer;
+        unsigned int renderbuffer;
+        unsigned int activeUnit;
+        unsigned int textures2D[GL_STATE_TEXTURE_UNITS];
+        unsigned int textures3D[GL_STATE_TEXTURE_UNITS];
+        unsigned int depthTest, blend, cullFace;
+        unsigned int depthFunc;
+        unsigned int depthMask;
+        unsigned int colorMask;
+        unsigned int blendSrc, blendDst;
+        GLint viewport[4];
+
+        // returns true (and counts it) if the cached value already matches, otherwise records the new one
+        bool skip(unsigned int &cached, unsigned int value)
+        {
+            if (cached == value)
+            {
+                Skipped++;
+                return true;
+            }
+            Issued++;
+            cached = value;
+            return false;
+        }
+
+        unsigned int *bufferBinding(GLenum target)
+        {
+            switch (target)
+            {
+                case GL_ARRAY_BUFFER:          return &arrayBuffer;
+                case GL_ELEMENT_ARRAY_BUFFER:  return &elementBuffer;
+                case GL_UNIFORM_BUFFER:        return &uniformBuffer;
+                case GL_SHADER_STORAGE_BUFFER: return &shaderStorageBuffer;
+                case GL_DRAW_INDIRECT_BUFFER:  return &drawIndirectBuffer;
+                default:                       return 0; // not shadowed, always issued
+            }
+        }
+
+        unsigned int *textureBinding(unsigned int unit, GLenum target)
+        {
+            if (unit >= GL_STATE_TEXTURE_UNITS)
+                return 0;
+            if (target == GL_TEXTURE_2D)
+                return &textures2D[unit];
+            if (target == GL_TEXTURE_3D)
+                return &textures3D[unit];
+            return 0;
+        }
+
+        void setCapability(GLenum capability, bool enabled)
+        {
+            unsigned int *cached = 0;
+            if (capability == GL_DEPTH_TEST)
+                cached = &depthTest;
+            else if (capability == GL_BLEND)
+                cached = &blend;
+            else if (capability == GL_CULL_FACE)
+                cached = &cullFace;
+            if (cached && skip(*cached, enabled ? 1u : 0u))
+                return;
+            if (!cached)
+                Issued++;
+            if (enabled)
+                glEnable(capability);
+            else
+                glDisable(capability);
+        }
+};
+
+// The cache of the current context, the engine only uses one
+inline GLStateCache &GLState()
+{
+    static GLStateCache state;
+    return state;
+}
+
+#endif
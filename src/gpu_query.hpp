@@ -0,0 +1,135 @@
+#ifndef GPU_QUERY_H
+#define GPU_QUERY_H
+
+#include <glad/glad.h>
+
+#include "gl_caps.hpp"
+
+// GL_ARB_pipeline_statistics_query tokens, not every glad profile exports them
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+// Counts fragment shader invocations between Begin() and End() using GL_ARB_pipeline_statistics_query.
+// Queries are double buffered so reading the result never stalls the pipeline: the value returned
+// by Result() lags one frame behind.
+class FragmentInvocationsQuery
+{
+    public:
+        bool Supported;
+
+        FragmentInvocationsQuery()
+            : Supported(false), current(0), result(0), pending(false)
+        {
+            queries[0] = queries[1] = 0;
+        }
+
+        // must be called once a context is current
+        void Init()
+        {
+            Supported = HasGLExtension("GL_ARB_pipeline_statistics_query");
+            if (Supported)
+                glGenQueries(2, queries);
+        }
+
+        void Begin()
+        {
+            if (!Supported)
+                return;
+            glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[current]);
+        }
+
+        void End()
+        {
+            if (!Supported)
+                return;
+            glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+            // collect the query issued in the previous frame, if the GPU is done with it
+            unsigned int previous = 1 - current;
+            if (pending)
+            {
+                GLuint available = 0;
+                glGetQueryObjectuiv(queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                    glGetQueryObjectui64v(queries[previous], GL_QUERY_RESULT, &result);
+            }
+            pending = true;
+            current = previous;
+        }
+
+        GLuint64 Result() const
+        {
+            return result;
+        }
+
+    private:
+        GLuint queries[2];
+        unsigned int current;
+        GLuint64 result;
+        bool pending;
+};
+
+// Measures GPU time spent between Begin() and End() with GL_TIME_ELAPSED queries (core since 3.3).
+// Same double buffering as above, Milliseconds() reports the previous completed measurement.
+class GpuTimer
+{
+    public:
+        GpuTimer()
+            : current(0), milliseconds(0.0f), pending(false), valid(false)
+        {
+            queries[0] = queries[1] = 0;
+        }
+
+        // must be called once a context is current
+        void Init()
+        {
+            glGenQueries(2, queries);
+        }
+
+        void Begin()
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+        }
+
+        // returns true when a new measurement became available
+        bool End()
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            unsigned int previous = 1 - current;
+            bool updated = false;
+            if (pending)
+            {
+                GLuint available = 0;
+                glGetQueryObjectuiv(queries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                {
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(queries[previous], GL_QUERY_RESULT, &nanoseconds);
+                    milliseconds = nanoseconds / 1000000.0f;
+                    valid = updated = true;
+                }
+            }
+            pending = true;
+            current = previous;
+            return updated;
+        }
+
+        float Milliseconds() const
+        {
+            return milliseconds;
+        }
+
+        bool Valid() const
+        {
+            return valid;
+        }
+
+    private:
+        GLuint queries[2];
+        unsigned int current;
+        float milliseconds;
+        bool pending;
+        bool valid;
+};
+
+#endif
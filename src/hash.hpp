@@ -0,0 +1,20 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit FNV-1a
+const uint64_t HASH_SEED = 14695981039346656037ULL;  // offset basis
+const uint64_t HASH_PRIME = 1099511628211ULL;
+
+// Hashes size bytes; pass the result of a previous call as hash to continue over several blocks
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t hash = HASH_SEED)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    return hash;
+}
+
+#endif
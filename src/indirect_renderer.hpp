@@ -0,0 +1,467 @@
+#ifndef INDIRECT_RENDERER_H
+#define INDIRECT_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frame_arena.hpp"
+#include "gl_caps.hpp"
+#include "gl_state.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Work group sizes, must match the local_size declared by the compute shaders
+const unsigned int INDIRECT_CULL_GROUP_SIZE = 64;
+const unsigned int INDIRECT_HIZ_GROUP_SIZE = 8;
+// Vertex attribute carrying the instance index, after the Mesh attributes 0-4
+const GLuint INDIRECT_INSTANCE_ATTRIBUTE = 5;
+
+// Layout of glMultiDrawElementsIndirect records
+struct DrawElementsIndirectCommand
+{
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;
+    GLint BaseVertex;
+    GLuint BaseInstance;
+};
+
+// std430 layout of one instance in the instance SSBO
+struct IndirectInstance
+{
+    glm::mat4 Model;
+    glm::vec4 BoundingSphere; // model space center and radius
+    GLuint FirstCommand;      // commands of the instance's model
+    GLuint CommandCount;
+    GLuint Padding[2];
+};
+
+// GPU-driven rendering of model instances, needs a 4.3 context (compute shaders, SSBOs, multi-draw indirect).
+// All meshes of all models share one vertex/index buffer and own one DrawElementsIndirectCommand. Every frame
+// a compute shader tests each instance against the frustum and the previous frame's depth pyramid (Hi-Z) and
+// appends the survivors to the commands of their model with an atomic add; the index of the instance goes to
+// a visible list read back as an instanced vertex attribute. The CPU then issues one glMultiDrawElementsIndirect
+// per material batch, no matter how many instances or meshes there are.
+class IndirectRenderer
+{
+    public:
+        bool Supported;
+        bool HiZCulling; // also test against the previous frame's depth pyramid
+        unsigned int ModelCount;
+        unsigned int MeshCount;
+        unsigned int BatchCount;      // multi-draw calls per Draw()
+        unsigned int InstanceCount;   // instances submitted by the last SetInstances()
+        unsigned int VisibleCount;    // instances that survived culling, read back without stalling so a few frames old
+
+        IndirectRenderer()
+            : Supported(false), HiZCulling(true), ModelCount(0), MeshCount(0), BatchCount(0), InstanceCount(0), VisibleCount(0),
+              capacity(0), vao(0), vbo(0), ebo(0), instanceBuffer(0), visibleBuffer(0), commandBuffer(0),
+              commandTemplateBuffer(0), counterBuffer(0), readbackBuffer(0), readbackFence(0),
+              hiZTexture(0), hiZWidth(0), hiZHeight(0), hiZMaxLevels(0), hiZLevels(0), hiZRenderWidth(0), hiZRenderHeight(0),
+              hiZValid(false)
+        {
+        }
+
+        ~IndirectRenderer()
+        {
+            if (!Supported)
+                return;
+            if (readbackFence)
+                glDeleteSync(readbackFence);
+            GLState().DeleteVertexArray(vao);
+            GLuint buffers[] = { vbo, ebo, instanceBuffer, visibleBuffer, commandBuffer, commandTemplateBuffer, counterBuffer, readbackBuffer };
+            for (unsigned int i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++)
+                GLState().DeleteBuffer(buffers[i]);
+            if (hiZTexture)
+                GLState().DeleteTexture(hiZTexture);
+            GLState().DeleteProgram(cullShader.ID);
+            GLState().DeleteProgram(hiZShader.ID);
+        }
+
+        // must be called once a context is current; returns false (and stays unusable) below OpenGL 4.3
+        bool Init()
+        {
+            Supported = HasGLVersion(4, 3);
+            if (!Supported)
+                return false;
+            cullShader = Shader("../src/shaders/cull_instances.cs");
+            hiZShader = Shader("../src/shaders/hiz_build.cs");
+
+            glGenVertexArrays(1, &vao);
+            glGenBuffers(1, &vbo);
+            glGenBuffers(1, &ebo);
+            glGenBuffers(1, &instanceBuffer);
+            glGenBuffers(1, &visibleBuffer);
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &commandTemplateBuffer);
+            glGenBuffers(1, &counterBuffer);
+            glGenBuffers(1, &readbackBuffer);
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+            RenderStats().BufferAllocated(counterBuffer, GPU_MEMORY_OTHER, sizeof(GLuint));
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, readbackBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+            RenderStats().BufferAllocated(readbackBuffer, GPU_MEMORY_OTHER, sizeof(GLuint));
+
+            GLState().BindVertexArray(vao);
+            // same attribute layout as Mesh::setupMesh, the buffers are filled by SetModels()
+            GLState().BindBuffer(GL_ARRAY_BUFFER, vbo);
+            GLState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+            // the visible list feeds the instance index, BaseInstance offsets the fetch per command
+            GLState().BindBuffer(GL_ARRAY_BUFFER, visibleBuffer);
+            glEnableVertexAttribArray(INDIRECT_INSTANCE_ATTRIBUTE);
+            glVertexAttribIPointer(INDIRECT_INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+            glVertexAttribDivisor(INDIRECT_INSTANCE_ATTRIBUTE, 1);
+            GLState().BindVertexArray(0);
+            return true;
+        }
+
+        // merges the geometry of the models into the shared buffers; call again whenever the set of models changes,
+        // instances then refer to a model by its index in this list
+        void SetModels(const std::vector<Model*> &models)
+        {
+            ModelCount = (unsigned int)models.size();
+            std::vector<MeshRef> meshes;
+            for (unsigned int m = 0; m < models.size(); m++)
+                for (unsigned int i = 0; i < models[m]->meshes.size(); i++)
+                    meshes.push_back(MeshRef(models[m], m, i));
+            MeshCount = (unsigned int)meshes.size();
+
+            // meshes with the same material are drawn by one multi-draw, so their commands must be adjacent;
+            // the sort key starts with the model so that each model's commands stay contiguous as well
+            std::stable_sort(meshes.begin(), meshes.end(), MaterialLess());
+            commandMeshes.clear();
+            batches.clear();
+            modelCommands.assign(ModelCount, std::make_pair(0u, 0u));
+            for (unsigned int i = 0; i < MeshCount; i++)
+            {
+                commandMeshes.push_back(&meshes[i].model->meshes[meshes[i].mesh]);
+                if (batches.empty() || !sameMaterial(*commandMeshes[batches.back().FirstCommand], *commandMeshes[i]))
+                {
+                    Batch batch;
+                    batch.FirstCommand = i;
+                    batch.CommandCount = 0;
+                    batches.push_back(batch);
+                }
+                batches.back().CommandCount++;
+                std::pair<unsigned int, unsigned int> &range = modelCommands[meshes[i].index];
+                if (range.second == 0)
+                    range.first = i;
+                range.second++;
+            }
+            BatchCount = (unsigned int)batches.size();
+            modelSpheres.clear();
+            for (unsigned int m = 0; m < models.size(); m++)
+                modelSpheres.push_back(glm::vec4((models[m]->BoundsMin + models[m]->BoundsMax) * 0.5f,
+                                                 glm::length(models[m]->BoundsMax - models[m]->BoundsMin) * 0.5f));
+
+            // one vertex and index buffer for everything, commands address their part of it; the meshes are
+            // copied from their own buffers on the GPU, so models may have released their CPU geometry
+            GLuint vertexCount = 0, indexCount = 0;
+            commands.resize(MeshCount);
+            for (unsigned int i = 0; i < MeshCount; i++)
+            {
+                const Mesh &mesh = *commandMeshes[i];
+                commands[i].Count = mesh.IndexCount;
+                commands[i].InstanceCount = 0;
+                commands[i].FirstIndex = indexCount;
+                commands[i].BaseVertex = (GLint)vertexCount;
+                vertexCount += mesh.VertexCount;
+                indexCount += mesh.IndexCount;
+            }
+            // allocated through the copy target: binding the element buffer would change whatever VAO is bound
+            GLState().BindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+            RenderStats().BufferAllocated(vbo, GPU_MEMORY_MESHES, vertexCount * sizeof(Vertex));
+            for (unsigned int i = 0; i < MeshCount; i++)
+            {
+                GLState().BindBuffer(GL_COPY_READ_BUFFER, commandMeshes[i]->VBO);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, commands[i].BaseVertex * sizeof(Vertex),
+                                    commandMeshes[i]->VertexCount * sizeof(Vertex));
+            }
+            GLState().BindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+            glBufferData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+            RenderStats().BufferAllocated(ebo, GPU_MEMORY_MESHES, indexCount * sizeof(unsigned int));
+            for (unsigned int i = 0; i < MeshCount; i++)
+            {
+                GLState().BindBuffer(GL_COPY_READ_BUFFER, commandMeshes[i]->EBO);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, commands[i].FirstIndex * sizeof(unsigned int),
+                                    commandMeshes[i]->IndexCount * sizeof(unsigned int));
+            }
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, MeshCount * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+            RenderStats().BufferAllocated(commandBuffer, GPU_MEMORY_OTHER, MeshCount * sizeof(DrawElementsIndirectCommand));
+            reserve(std::max(capacity, 1u));
+        }
+
+        // uploads this frame's instance transforms and the index (in the SetModels() list) of their model
+        void SetInstances(const std::vector<glm::mat4> &transforms, const std::vector<unsigned int> &modelIndices)
+        {
+            InstanceCount = (unsigned int)transforms.size();
+            if (InstanceCount > capacity)
+                reserve(std::max(InstanceCount, capacity * 2));
+            for (unsigned int i = 0; i < InstanceCount; i++)
+            {
+                unsigned int model = modelIndices[i];
+                instances[i].Model = transforms[i];
+                instances[i].BoundingSphere = modelSpheres[model];
+                instances[i].FirstCommand = modelCommands[model].first;
+                instances[i].CommandCount = modelCommands[model].second;
+            }
+            if (InstanceCount == 0)
+                return;
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, InstanceCount * sizeof(IndirectInstance), &instances[0]);
+            RenderStats().Count(STAT_BUFFER_BYTES, InstanceCount * sizeof(IndirectInstance));
+        }
+
+        // resets the draw commands and runs the culling compute shader
+        void Cull(const glm::mat4 &viewProjection)
+        {
+            if (MeshCount == 0)
+                return;
+            // restart every command at zero instances, a GPU side copy
+            GLState().BindBuffer(GL_COPY_READ_BUFFER, commandTemplateBuffer);
+            GLState().BindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, MeshCount * sizeof(DrawElementsIndirectCommand));
+            GLuint zero = 0;
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+            cullShader.Use();
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform1ui(glGetUniformLocation(cullShader.ID, "instanceCount"), InstanceCount);
+            setFrustumPlanes(viewProjection);
+            bool hiZ = HiZCulling && hiZValid;
+            cullShader.SetInteger("hiZEnabled", hiZ);
+            if (hiZ)
+            {
+                cullShader.SetInteger("hiZ", 0);
+                cullShader.SetMatrix4("hiZViewProjection", hiZViewProjection);
+                RenderStats().Count(STAT_UNIFORM_UPLOADS);
+                glUniform2i(glGetUniformLocation(cullShader.ID, "hiZSize"), hiZRenderWidth, hiZRenderHeight);
+                cullShader.SetInteger("hiZLevels", hiZLevels);
+                GLState().BindTexture(0, GL_TEXTURE_2D, hiZTexture);
+            }
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, commandBuffer);
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer);
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+            RenderStats().Count(STAT_DISPATCHES);
+            glDispatchCompute((InstanceCount + INDIRECT_CULL_GROUP_SIZE - 1) / INDIRECT_CULL_GROUP_SIZE, 1, 1);
+            // the commands are consumed as draw arguments, the visible list as a vertex attribute
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+            readbackVisibleCount();
+        }
+
+        // issues one multi-draw per material batch; the shader reads its model matrices from the instance SSBO (binding 0)
+        void Draw(Shader & /* shader */)
+        {
+            if (MeshCount == 0)
+                return;
+            GLState().BindVertexArray(vao);
+            GLState().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            GLState().BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+            for (unsigned int b = 0; b < batches.size(); b++)
+            {
+                commandMeshes[batches[b].FirstCommand]->material.Bind();
+                RenderStats().Draw(0); // the surviving instances are only known on the GPU
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                            (void*)(batches[b].FirstCommand * sizeof(DrawElementsIndirectCommand)),
+                                            batches[b].CommandCount, 0);
+            }
+        }
+
+        // builds the depth pyramid from this frame's depth buffer, the next Cull() tests against it.
+        // width/height is the rendered region, textureWidth/textureHeight the size of the depth texture.
+        void BuildHiZ(GLuint depthTexture, int width, int height, int textureWidth, int textureHeight, const glm::mat4 &viewProjection)
+        {
+            if (textureWidth != hiZWidth || textureHeight != hiZHeight)
+                allocateHiZ(textureWidth, textureHeight);
+
+            hiZShader.Use();
+            hiZShader.SetInteger("source", 0);
+            int sourceWidth = width, sourceHeight = height;
+            int levels = 1;
+            // level 0: copy of the rendered region of the depth buffer
+            GLState().BindTexture(0, GL_TEXTURE_2D, depthTexture);
+            dispatchHiZ(-1, 0, width, height, width, height);
+            // next levels: farthest depth of each 2x2 footprint
+            GLState().BindTexture(0, GL_TEXTURE_2D, hiZTexture);
+            while ((sourceWidth > 1 || sourceHeight > 1) && levels < hiZMaxLevels)
+            {
+                int levelWidth = std::max(sourceWidth / 2, 1);
+                int levelHeight = std::max(sourceHeight / 2, 1);
+                dispatchHiZ(levels - 1, levels, sourceWidth, sourceHeight, levelWidth, levelHeight);
+                sourceWidth = levelWidth;
+                sourceHeight = levelHeight;
+                levels++;
+            }
+            hiZLevels = levels;
+            hiZRenderWidth = width;
+            hiZRenderHeight = height;
+            hiZViewProjection = viewProjection;
+            hiZValid = true;
+        }
+
+        // forgets the depth pyramid, e.g. when the depth buffer isn't produced by the current pipeline
+        void InvalidateHiZ()
+        {
+            hiZValid = false;
+        }
+
+    private:
+        struct Batch
+        {
+            unsigned int FirstCommand;
+            unsigned int CommandCount;
+        };
+
+        struct MeshRef
+        {
+            Model *model;
+            unsigned int index; // of the model in the SetModels() list
+            unsigned int mesh;
+            MeshRef(Model *m, unsigned int i, unsigned int k) : model(m), index(i), mesh(k) {}
+        };
+
+        struct MaterialLess
+        {
+            bool operator()(const MeshRef &a, const MeshRef &b) const
+            {
+                if (a.index != b.index)
+                    return a.index < b.index;
+                return a.model->meshes[a.mesh].material.ID < b.model->meshes[b.mesh].material.ID;
+            }
+        };
+
+        std::vector<Mesh*> commandMeshes; // command index -> mesh
+        std::vector<Batch> batches;
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<std::pair<unsigned int, unsigned int> > modelCommands; // first command and count per model
+        std::vector<glm::vec4> modelSpheres;
+        std::vector<IndirectInstance> instances;
+        unsigned int capacity;
+
+        Shader cullShader;
+        Shader hiZShader;
+        GLuint vao, vbo, ebo;
+        GLuint instanceBuffer, visibleBuffer, commandBuffer, commandTemplateBuffer, counterBuffer, readbackBuffer;
+        GLsync readbackFence;
+
+        GLuint hiZTexture;
+        int hiZWidth, hiZHeight;
+        int hiZMaxLevels;
+        int hiZLevels;
+        int hiZRenderWidth, hiZRenderHeight;
+        glm::mat4 hiZViewProjection;
+        bool hiZValid;
+
+        static bool sameMaterial(const Mesh &a, const Mesh &b)
+        {
+            return a.material.ID == b.material.ID;
+        }
+
+        // (re)creates the per-instance buffers; every mesh owns a range of maxInstances entries in the visible list
+        void reserve(unsigned int maxInstances)
+        {
+            capacity = maxInstances;
+            instances.resize(capacity);
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(IndirectInstance), NULL, GL_DYNAMIC_DRAW);
+            RenderStats().BufferAllocated(instanceBuffer, GPU_MEMORY_OTHER, capacity * sizeof(IndirectInstance));
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, MeshCount * capacity * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+            RenderStats().BufferAllocated(visibleBuffer, GPU_MEMORY_OTHER, MeshCount * capacity * sizeof(GLuint));
+
+            for (unsigned int i = 0; i < MeshCount; i++)
+                commands[i].BaseInstance = i * capacity;
+            GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, commandTemplateBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, MeshCount * sizeof(DrawElementsIndirectCommand), commands.empty() ? NULL : &commands[0], GL_STATIC_DRAW);
+            RenderStats().BufferAllocated(commandTemplateBuffer, GPU_MEMORY_OTHER, MeshCount * sizeof(DrawElementsIndirectCommand));
+            RenderStats().Count(STAT_BUFFER_BYTES, MeshCount * sizeof(DrawElementsIndirectCommand));
+        }
+
+        // Gribb-Hartmann plane extraction, normalized so the distances can be compared against radii
+        void setFrustumPlanes(const glm::mat4 &m)
+        {
+            glm::vec4 rows[4];
+            for (int r = 0; r < 4; r++)
+                rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+            glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                    rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+            for (int i = 0; i < 6; i++)
+            {
+                planes[i] /= glm::length(glm::vec3(planes[i]));
+                cullShader.SetVector4f(FrameMemory().Format("frustumPlanes[%d]", i), planes[i]);
+            }
+        }
+
+        // copies the surviving instance count aside and picks it up once a fence says the GPU is past it
+        void readbackVisibleCount()
+        {
+            if (readbackFence)
+            {
+                GLenum status = glClientWaitSync(readbackFence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    return;
+                GLState().BindBuffer(GL_SHADER_STORAGE_BUFFER, readbackBuffer);
+                glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &VisibleCount);
+                glDeleteSync(readbackFence);
+                readbackFence = 0;
+            }
+            GLState().BindBuffer(GL_COPY_READ_BUFFER, counterBuffer);
+            GLState().BindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint));
+            readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        void allocateHiZ(int width, int height)
+        {
+            if (hiZTexture)
+                GLState().DeleteTexture(hiZTexture);
+            hiZWidth = width;
+            hiZHeight = height;
+            hiZMaxLevels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+            glGenTextures(1, &hiZTexture);
+            GLState().BindTexture(GL_TEXTURE_2D, hiZTexture);
+            glTexStorage2D(GL_TEXTURE_2D, hiZMaxLevels, GL_R32F, width, height);
+            RenderStats().TextureAllocated(hiZTexture, GPU_MEMORY_OTHER, EstimatedTextureBytes(width, height));
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            hiZValid = false;
+        }
+
+        void dispatchHiZ(int sourceLevel, int destinationLevel, int sourceWidth, int sourceHeight, int width, int height)
+        {
+            hiZShader.SetInteger("sourceLevel", sourceLevel);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS, 2);
+            glUniform2i(glGetUniformLocation(hiZShader.ID, "sourceSize"), sourceWidth, sourceHeight);
+            glUniform2i(glGetUniformLocation(hiZShader.ID, "destinationSize"), width, height);
+            glBindImageTexture(0, hiZTexture, destinationLevel, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            RenderStats().Count(STAT_DISPATCHES);
+            glDispatchCompute((width + INDIRECT_HIZ_GROUP_SIZE - 1) / INDIRECT_HIZ_GROUP_SIZE,
+                              (height + INDIRECT_HIZ_GROUP_SIZE - 1) / INDIRECT_HIZ_GROUP_SIZE, 1);
+            // the next level (or the next frame's culling) reads what was just written
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+};
+#endif
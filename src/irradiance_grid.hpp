@@ -0,0 +1,353 @@
+#ifndef IRRADIANCE_GRID_H
+#define IRRADIANCE_GRID_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.hpp"
+#include "hash.hpp"
+#include "scene.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Default irradiance grid values
+const float IRRADIANCE_GRID_SPACING = 0.5f;             // distance between probes, grown to stay within the probe budget
+const unsigned int IRRADIANCE_GRID_MAX_PROBES = 1 << 20;
+const float IRRADIANCE_GRID_MARGIN = 4.0f;              // around the instance positions, model bounds aren't known before loading
+const float IRRADIANCE_GRID_CUTOFF = 1.0f / 256.0f;     // light contributions below this aren't baked
+const unsigned int IRRADIANCE_GRID_TEXTURE_UNIT = 8;    // first of three, above the units the meshes bind
+const uint32_t IRRADIANCE_GRID_MAGIC = 0x31445249;      // "IRD1"
+const uint32_t IRRADIANCE_GRID_VERSION = 1;             // bump when the baked content changes meaning
+
+// The diffuse light of the scene's static point lights, baked into a 3D grid of probes that the lighting passes
+// sample by position. Per color channel a probe stores the attenuated light reaching it (the shaders' ambient
+// term) and the sum of the attenuated light directions; the diffuse term is then max(dot(normal, sum), 0), which
+// is exact wherever one light dominates. Specular depends on the view and stays per-pixel.
+class IrradianceGrid
+{
+    public:
+        glm::vec3 Origin;  // position of the first probe
+        float Spacing;
+        glm::ivec3 Size;   // probes per axis, zero when nothing is baked
+        uint64_t Key;      // of the inputs the content was baked from
+        unsigned int ThreadCount;
+        float BakeTime;    // milliseconds, of the last Bake()
+
+        IrradianceGrid()
+            : Origin(0.0f), Spacing(IRRADIANCE_GRID_SPACING), Size(0), Key(0), BakeTime(0.0f)
+        {
+            ThreadCount = WorkerPool::HardwareThreads();
+            textures[0] = textures[1] = textures[2] = 0;
+        }
+
+        ~IrradianceGrid()
+        {
+            Release();
+        }
+
+        bool Empty() const
+        {
+            return Size.x == 0;
+        }
+
+        // identifies what a bake depends on: the static lights, their attenuation and the instance layout that
+        // bounds the grid
+        static uint64_t ComputeKey(const Scene &scene, float linear, float quadratic)
+        {
+            uint64_t hash = HASH_SEED;
+            const uint32_t version = IRRADIANCE_GRID_VERSION;
+            const float settings[6] = { IRRADIANCE_GRID_SPACING, (float)IRRADIANCE_GRID_MAX_PROBES, IRRADIANCE_GRID_MARGIN,
+                                        IRRADIANCE_GRID_CUTOFF, linear, quadratic };
+            hash = HashBytes(&version, sizeof(version), hash);
+            hash = HashBytes(settings, sizeof(settings), hash);
+            for (unsigned int i = 0; i < scene.Lights.size(); i++)
+            {
+                if (!scene.Lights[i].Static)
+                    continue;
+                hash = HashBytes(&scene.Lights[i].Position, sizeof(glm::vec3), hash);
+                hash = HashBytes(&scene.Lights[i].Color, sizeof(glm::vec3), hash);
+            }
+            for (unsigned int i = 0; i < scene.Instances.size(); i++)
+            {
+                hash = HashBytes(&scene.Instances[i].Position, sizeof(glm::vec3), hash);
+                hash = HashBytes(&scene.Instances[i].Scale, sizeof(float), hash);
+            }
+            return hash;
+        }
+
+        // bakes the static lights of the scene into a grid covering its instances, slices of the grid are spread
+        // over ThreadCount of the shared worker threads
+        void Bake(const Scene &scene, float linear, float quadratic)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Key = ComputeKey(scene, linear, quadratic);
+            Size = glm::ivec3(0);
+            lights.clear();
+            for (unsigned int i = 0; i < scene.Lights.size(); i++)
+            {
+                if (!scene.Lights[i].Static)
+                    continue;
+                BakeLight light;
+                light.Position = scene.Lights[i].Position;
+                light.Color = scene.Lights[i].Color;
+                light.Radius = lightRadius(light.Color, linear, quadratic);
+                if (light.Radius > 0.0f)
+                    lights.push_back(light);
+            }
+            if (lights.empty() || scene.Instances.empty())
+            {
+                clearProbes();
+                return;
+            }
+
+            // where both the geometry and the light are
+            glm::vec3 geometryMin(scene.Instances[0].Position), geometryMax(scene.Instances[0].Position);
+            for (unsigned int i = 1; i < scene.Instances.size(); i++)
+            {
+                geometryMin = glm::min(geometryMin, scene.Instances[i].Position);
+                geometryMax = glm::max(geometryMax, scene.Instances[i].Position);
+            }
+            glm::vec3 lightMin(lights[0].Position - lights[0].Radius), lightMax(lights[0].Position + lights[0].Radius);
+            for (unsigned int i = 1; i < lights.size(); i++)
+            {
+                lightMin = glm::min(lightMin, lights[i].Position - lights[i].Radius);
+                lightMax = glm::max(lightMax, lights[i].Position + lights[i].Radius);
+            }
+            glm::vec3 boundsMin = glm::max(geometryMin - IRRADIANCE_GRID_MARGIN, lightMin);
+            glm::vec3 boundsMax = glm::min(geometryMax + IRRADIANCE_GRID_MARGIN, lightMax);
+            if (boundsMin.x > boundsMax.x || boundsMin.y > boundsMax.y || boundsMin.z > boundsMax.z)
+            {
+                clearProbes();
+                return;
+            }
+
+            Spacing = IRRADIANCE_GRID_SPACING;
+            glm::vec3 extent = boundsMax - boundsMin;
+            for (;;)
+            {
+                Size = glm::ivec3((int)std::ceil(extent.x / Spacing) + 1, (int)std::ceil(extent.y / Spacing) + 1,
+                                  (int)std::ceil(extent.z / Spacing) + 1);
+                double count = (double)Size.x * Size.y * Size.z;
+                if (count <= IRRADIANCE_GRID_MAX_PROBES)
+                    break;
+                Spacing *= (float)std::cbrt(count / IRRADIANCE_GRID_MAX_PROBES) * 1.01f;
+            }
+            Origin = (boundsMin + boundsMax - glm::vec3(Size - 1) * Spacing) * 0.5f;
+            size_t count = (size_t)Size.x * Size.y * Size.z;
+            for (unsigned int c = 0; c < 3; c++)
+                probes[c].assign(count * 4, 0.0f);
+
+            nextSlice.store(0);
+            Workers().Run(ThreadCount, [&]() { bakeSlices(linear, quadratic); });
+            BakeTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        bool Save(const std::string &path) const
+        {
+            std::ofstream file(path.c_str(), std::ios::binary);
+            if (!file)
+            {
+                std::cout << "ERROR::IRRADIANCE_GRID: can't write " << path << std::endl;
+                return false;
+            }
+            const uint32_t header[2] = { IRRADIANCE_GRID_MAGIC, IRRADIANCE_GRID_VERSION };
+            const int32_t size[3] = { Size.x, Size.y, Size.z };
+            file.write((const char*)header, sizeof(header));
+            file.write((const char*)&Key, sizeof(Key));
+            file.write((const char*)&Origin, sizeof(glm::vec3));
+            file.write((const char*)&Spacing, sizeof(Spacing));
+            file.write((const char*)size, sizeof(size));
+            for (unsigned int c = 0; c < 3 && !Empty(); c++)
+                file.write((const char*)&probes[c][0], probes[c].size() * sizeof(float));
+            return (bool)file;
+        }
+
+        // reads a grid written by Save(), fails if the file is missing, damaged or was baked from other inputs
+        bool Load(const std::string &path, uint64_t key)
+        {
+            std::ifstream file(path.c_str(), std::ios::binary);
+            if (!file)
+                return false;
+            uint32_t header[2] = { 0, 0 };
+            uint64_t fileKey = 0;
+            int32_t size[3] = { 0, 0, 0 };
+            file.read((char*)header, sizeof(header));
+            file.read((char*)&fileKey, sizeof(fileKey));
+            if (!file || header[0] != IRRADIANCE_GRID_MAGIC || header[1] != IRRADIANCE_GRID_VERSION || fileKey != key)
+                return false;
+            file.read((char*)&Origin, sizeof(glm::vec3));
+            file.read((char*)&Spacing, sizeof(Spacing));
+            file.read((char*)size, sizeof(size));
+            if (!file || size[0] < 0 || size[1] < 0 || size[2] < 0 ||
+                (double)size[0] * size[1] * size[2] > IRRADIANCE_GRID_MAX_PROBES)
+                return false;
+            Size = glm::ivec3(size[0], size[1], size[2]);
+            size_t count = (size_t)Size.x * Size.y * Size.z;
+            for (unsigned int c = 0; c < 3; c++)
+            {
+                probes[c].resize(count * 4);
+                if (count > 0)
+                    file.read((char*)&probes[c][0], probes[c].size() * sizeof(float));
+            }
+            if (!file)
+            {
+                clearProbes();
+                return false;
+            }
+            Key = key;
+            return true;
+        }
+
+        // loads the cached bake of the scene, or bakes it and updates the cache when the inputs changed
+        void LoadOrBake(const Scene &scene, float linear, float quadratic, const std::string &cachePath)
+        {
+            if (Load(cachePath, ComputeKey(scene, linear, quadratic)))
+            {
+                std::cout << "irradiance grid: " << Size.x << "x" << Size.y << "x" << Size.z << " probes loaded from "
+                          << cachePath << std::endl;
+                return;
+            }
+            Bake(scene, linear, quadratic);
+            std::cout << "irradiance grid: " << lights.size() << " static lights baked into " << Size.x << "x" << Size.y << "x"
+                      << Size.z << " probes, " << Spacing << " apart, in " << BakeTime << " ms on " << ThreadCount
+                      << " threads" << std::endl;
+            Save(cachePath);
+        }
+
+        // creates (or refreshes) the three textures, one per color channel
+        void Upload()
+        {
+            if (Empty())
+            {
+                Release();
+                return;
+            }
+            for (unsigned int c = 0; c < 3; c++)
+            {
+                if (textures[c] == 0)
+                    glGenTextures(1, &textures[c]);
+                GLState().BindTexture(GL_TEXTURE_3D, textures[c]);
+                glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, Size.x, Size.y, Size.z, 0, GL_RGBA, GL_FLOAT, &probes[c][0]);
+                RenderStats().Count(STAT_TEXTURE_BYTES, probes[c].size() * sizeof(float));
+                RenderStats().TextureAllocated(textures[c], GPU_MEMORY_OTHER, (size_t)Size.x * Size.y * Size.z * 8);
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                // surfaces past the grid keep the light of its border
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            }
+        }
+
+        // binds the red, green and blue probe textures to three units starting at firstUnit
+        void Bind(unsigned int firstUnit) const
+        {
+            for (unsigned int c = 0; c < 3; c++)
+                GLState().BindTexture(firstUnit + c, GL_TEXTURE_3D, textures[c]);
+        }
+
+        // the box the textures span: texel centers fall on the probes
+        glm::vec3 TextureMin() const
+        {
+            return Origin - 0.5f * Spacing;
+        }
+
+        glm::vec3 TextureExtent() const
+        {
+            return glm::vec3(Size) * Spacing;
+        }
+
+        void Release()
+        {
+            for (unsigned int c = 0; c < 3; c++)
+            {
+                if (textures[c] != 0)
+                    GLState().DeleteTexture(textures[c]);
+                textures[c] = 0;
+            }
+        }
+
+    private:
+        struct BakeLight
+        {
+            glm::vec3 Position;
+            glm::vec3 Color;
+            float Radius;
+        };
+
+        std::vector<BakeLight> lights;
+        std::vector<float> probes[3]; // per channel, 4 floats a probe: light, direction sum
+        GLuint textures[3];
+        std::atomic<int> nextSlice;
+
+        // threads take z slices until none are left, every slice splats the lights that reach it
+        void bakeSlices(float linear, float quadratic)
+        {
+            for (int z = nextSlice.fetch_add(1); z < Size.z; z = nextSlice.fetch_add(1))
+            {
+                float pz = Origin.z + z * Spacing;
+                for (unsigned int l = 0; l < lights.size(); l++)
+                {
+                    const BakeLight &light = lights[l];
+                    float dz = light.Position.z - pz;
+                    if (std::fabs(dz) >= light.Radius)
+                        continue;
+                    int y0 = std::max(0, (int)std::floor((light.Position.y - light.Radius - Origin.y) / Spacing));
+                    int y1 = std::min(Size.y - 1, (int)std::ceil((light.Position.y + light.Radius - Origin.y) / Spacing));
+                    int x0 = std::max(0, (int)std::floor((light.Position.x - light.Radius - Origin.x) / Spacing));
+                    int x1 = std::min(Size.x - 1, (int)std::ceil((light.Position.x + light.Radius - Origin.x) / Spacing));
+                    for (int y = y0; y <= y1; y++)
+                    {
+                        for (int x = x0; x <= x1; x++)
+                        {
+                            glm::vec3 toLight = light.Position - (Origin + glm::vec3((float)x, (float)y, (float)z) * Spacing);
+                            float distance = glm::length(toLight);
+                            if (distance >= light.Radius)
+                                continue;
+                            // the shaders' attenuation
+                            float attenuation = 1.0f / (1.0f + linear * distance + quadratic * distance * distance);
+                            glm::vec3 direction = distance > 0.0f ? toLight / distance : glm::vec3(0.0f);
+                            size_t probe = (((size_t)z * Size.y + y) * Size.x + x) * 4;
+                            for (unsigned int c = 0; c < 3; c++)
+                            {
+                                float received = light.Color[c] * attenuation;
+                                probes[c][probe] += received;
+                                probes[c][probe + 1] += received * direction.x;
+                                probes[c][probe + 2] += received * direction.y;
+                                probes[c][probe + 3] += received * direction.z;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // distance past which a light adds less than the cutoff: ambient plus diffuse reach twice its attenuated color
+        static float lightRadius(const glm::vec3 &color, float linear, float quadratic)
+        {
+            float brightest = std::max(color.x, std::max(color.y, color.z));
+            float c = 1.0f - 2.0f * brightest / IRRADIANCE_GRID_CUTOFF;
+            if (c >= 0.0f)
+                return 0.0f;
+            return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+        }
+
+        void clearProbes()
+        {
+            Size = glm::ivec3(0);
+            for (unsigned int c = 0; c < 3; c++)
+                std::vector<float>().swap(probes[c]);
+        }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef LOAD_PROFILER_H
+#define LOAD_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+// The stages an asset goes through from its file to the GPU
+enum LoadStage
+{
+    LOAD_IMPORT,          // assimp reading the model file, and post-processing it unless MeshProcessor does
+    LOAD_CONVERT,         // assimp meshes to our vertices and indices
+    LOAD_POSTPROCESS,     // welding, normals and tangents, see MeshProcessor
+    LOAD_MESHLETS,        // splitting the meshes into meshlets
+    LOAD_FILE_READ,       // reading an image file
+    LOAD_DECODE,          // decoding an image with stb_image
+    LOAD_TEXTURE_UPLOAD,  // glTexImage2D of the base level
+    LOAD_MIPMAPS,         // glGenerateMipmap
+    LOAD_MESH_UPLOAD,     // vertex and index buffers
+    LOAD_SHADER_READ,     // reading the shader sources
+    LOAD_SHADER_COMPILE,  // compiling and linking a program
+    LOAD_STAGE_COUNT
+};
+
+// Time and data of one stage, summed over every call
+struct LoadStageStats
+{
+    double Time;    // milliseconds
+    size_t Bytes;   // what the stage read, produced or uploaded
+    unsigned int Calls;
+
+    LoadStageStats()
+        : Time(0.0), Bytes(0), Calls(0)
+    {
+    }
+
+    double MegabytesPerSecond() const
+    {
+        return Time > 0.0 ? Bytes / (1024.0 * 1024.0) / (Time / 1000.0) : 0.0;
+    }
+};
+
+// The stages of one asset (a model, image or shader file)
+struct LoadAssetStats
+{
+    LoadStageStats Stages[LOAD_STAGE_COUNT];
+};
+
+// Collects where loading time goes, per stage and per asset, while Enabled; disabled it costs a flag check per
+// LoadTimer. Thread safe, the import stages run on the streaming workers. GL calls return before the driver is
+// done with them: with Synchronize, the GL stages start and end with a glFinish() so that they measure the upload itself
+// rather than queuing it.
+class LoadProfiler
+{
+    public:
+        std::atomic<bool> Enabled;
+        bool Synchronize;
+
+        LoadProfiler()
+            : Enabled(false), Synchronize(false)
+        {
+        }
+
+        static const char *StageName(LoadStage stage)
+        {
+            static const char *names[LOAD_STAGE_COUNT] = { "import", "convert", "postprocess", "meshlets", "file_read", "decode",
+                                                           "texture_upload", "mipmaps", "mesh_upload", "shader_read",
+                                                           "shader_compile" };
+            return names[stage];
+        }
+
+        void Reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int s = 0; s < LOAD_STAGE_COUNT; s++)
+                stages[s] = LoadStageStats();
+            assets.clear();
+        }
+
+        void Record(LoadStage stage, const std::string &asset, double milliseconds, size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            add(stages[stage], milliseconds, bytes);
+            add(assets[asset].Stages[stage], milliseconds, bytes);
+        }
+
+        LoadStageStats Stage(LoadStage stage) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stages[stage];
+        }
+
+        // copy of the per-asset statistics, by file
+        std::map<std::string, LoadAssetStats> AssetStats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return assets;
+        }
+
+        // table of the stages that ran, e.g. for --import-stats
+        void Report(std::ostream &out) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            char line[160];
+            for (unsigned int s = 0; s < LOAD_STAGE_COUNT; s++)
+            {
+                if (stages[s].Calls == 0)
+                    continue;
+                std::snprintf(line, sizeof(line), "    %-15s %9.2f ms %9.2f MB %9.1f MB/s %6u calls", StageName((LoadStage)s),
+                              stages[s].Time, stages[s].Bytes / (1024.0 * 1024.0), stages[s].MegabytesPerSecond(), stages[s].Calls);
+                out << line << std::endl;
+            }
+        }
+
+    private:
+        mutable std::mutex mutex;
+        LoadStageStats stages[LOAD_STAGE_COUNT];
+        std::map<std::string, LoadAssetStats> assets;
+
+        static void add(LoadStageStats &stats, double milliseconds, size_t bytes)
+        {
+            stats.Time += milliseconds;
+            stats.Bytes += bytes;
+            stats.Calls++;
+        }
+};
+
+inline LoadProfiler &LoadProfile()
+{
+    static LoadProfiler profiler;
+    return profiler;
+}
+
+// Times a stage from its construction to Stop() or its destruction and records it for the asset, with the bytes
+// given to Bytes(). Does nothing when the profiler was disabled at construction.
+class LoadTimer
+{
+    public:
+        // gl: the stage issues GL commands, waited for when the profiler synchronizes
+        LoadTimer(LoadStage stage, const std::string &asset, bool gl = false)
+            : stage(stage), gl(gl), active(LoadProfile().Enabled), bytes(0)
+        {
+            if (!active)
+                return;
+            this->asset = asset;
+            // GL work queued before isn't part of the stage
+            if (gl && LoadProfile().Synchronize)
+                glFinish();
+            start = Clock::now();
+        }
+
+        ~LoadTimer()
+        {
+            Stop();
+        }
+
+        bool Active() const
+        {
+            return active;
+        }
+
+        void Bytes(size_t bytes)
+        {
+            this->bytes += bytes;
+        }
+
+        void Stop()
+        {
+            if (!active)
+                return;
+            active = false;
+            if (gl && LoadProfile().Synchronize)
+                glFinish();
+            double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            LoadProfile().Record(stage, asset, elapsed, bytes);
+        }
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        LoadStage stage;
+        bool gl;
+        bool active;
+        size_t bytes;
+        std::string asset;
+        Clock::time_point start;
+};
+
+#endif
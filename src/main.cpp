@@ -1,23 +1,61 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 
+#include "alloc_stats.hpp"
 #include "camera.hpp"
+#include "camera_path.hpp"
+#include "change_tracker.hpp"
 #include "shader.hpp"
+#include "shader_variants.hpp"
 #include "model.hpp"
+#include "frame_arena.hpp"
+#include "frame_graph.hpp"
+#include "frame_pacer.hpp"
+#include "gl_state.hpp"
+#include "gpu_query.hpp"
+#include "indirect_renderer.hpp"
+#include "irradiance_grid.hpp"
+#include "load_profiler.hpp"
+#include "meshlet.hpp"
+#include "multi_view.hpp"
+#include "occlusion_culler.hpp"
+#include "render_stats.hpp"
+#include "resolution_manager.hpp"
+#include "scene.hpp"
+#include "scene_streamer.hpp"
+#include "texture_residency.hpp"
 
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
+void window_refresh_callback(GLFWwindow *window);
 
 void renderCube();
 void renderQuad();
+void renderLightBoxes(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view,
+                      const std::vector<glm::vec3> &lightPositions, const std::vector<glm::vec3> &lightColors);
+void renderPlaceholders(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view,
+                        const std::vector<glm::mat4> &transforms, const std::vector<glm::vec3> &colors);
+glm::mat4 instanceTransform(const SceneInstance &instance, float rotationAngle);
+void drawObject(Model &model, Shader &shader, const glm::mat4 &transform, const glm::mat4 &viewProjection, MeshletCuller &culler);
 
 // settings
 const unsigned int WINDOW_WIDTH = 1280;
 const unsigned int WINDOW_HEIGHT = 720;
+// actual framebuffer size in pixels, kept up to date by framebuffer_size_callback
+int framebufferWidth = WINDOW_WIDTH;
+int framebufferHeight = WINDOW_HEIGHT;
+// set by window_refresh_callback when the window content was damaged and must be rendered again
+bool windowDamaged = false;
+// while nothing changes, frames aren't rendered and the loop waits for events this long (seconds)
+const double IDLE_WAIT = 0.1;
+const double IDLE_LOADING_WAIT = 1.0 / 60.0; // models are still loading
 
 // camera
 Camera camera(glm::vec3(-5.0f, 5.0f, 5.0f), glm::vec3(0.0f, 1.0f, 0.0f), -35.0f, -40.0f);
@@ -39,12 +77,152 @@ bool deferredShadingFlagPressed = false;
 bool rotateModelFlag = true;
 bool rotateModelFlagPressed = false;
 
-int main()
+bool depthPrepassFlag = false;
+bool depthPrepassFlagPressed = false;
+
+bool dynamicResolutionFlag = true;
+bool dynamicResolutionFlagPressed = false;
+
+bool edgeAwareUpscaleFlag = false;
+bool edgeAwareUpscaleFlagPressed = false;
+
+bool occlusionCullingFlag = true;
+bool occlusionCullingFlagPressed = false;
+
+bool gpuDrivenFlag = true;
+bool gpuDrivenFlagPressed = false;
+
+bool incrementalFlag = true;
+bool incrementalFlagPressed = false;
+
+bool bakedLightingFlag = true;
+bool bakedLightingFlagPressed = false;
+
+bool meshletCullingFlag = true;
+bool meshletCullingFlagPressed = false;
+
+bool latencyControlFlag = false;
+bool latencyControlFlagPressed = false;
+
+bool multiViewFlag = false;
+bool multiViewFlagPressed = false;
+MultiViewLayout multiViewLayout = MULTI_VIEW_STEREO;
+
+int main(int argc, char **argv)
 {
+    // command line: [scene file] [--camera-path file] [--release-geometry] [--upload-budget milliseconds]
+    //               [--import-stats] [--generate-scene file [grid size]]
+    //               [--frames-in-flight count] [--target-frame-time milliseconds] [--views stereo|split]
+    //               [--metrics file]
+    // --------------------------------------------------------------------------------------
+    std::string scenePath = "../assets/scenes/default.scene";
+    std::string cameraPathFile;
+    bool releaseGeometry = false; // drop the CPU copy of the geometry once a model is resident
+    bool importStats = false;
+    float uploadBudget = MODEL_LOADER_UPLOAD_BUDGET;
+    FramePacer framePacer;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--camera-path" && i + 1 < argc)
+            cameraPathFile = argv[++i];
+        else if (argument == "--release-geometry")
+            releaseGeometry = true;
+        else if (argument == "--upload-budget" && i + 1 < argc)
+            uploadBudget = (float)atof(argv[++i]);
+        else if (argument == "--import-stats")
+            importStats = true;
+        else if (argument == "--frames-in-flight" && i + 1 < argc)
+        {
+            framePacer.MaxFramesInFlight = (unsigned int)std::max(1, atoi(argv[++i]));
+            latencyControlFlag = true;
+        }
+        else if (argument == "--target-frame-time" && i + 1 < argc)
+        {
+            framePacer.TargetFrameTime = (float)atof(argv[++i]);
+            latencyControlFlag = true;
+        }
+        else if (argument == "--views" && i + 1 < argc)
+        {
+            std::string layout = argv[++i];
+            multiViewLayout = layout == "split" ? MULTI_VIEW_SPLIT : MULTI_VIEW_STEREO;
+            multiViewFlag = true;
+        }
+        else if (argument == "--metrics" && i + 1 < argc)
+        {
+            // a JSON line of the rolling render statistics every second
+            if (!RenderStats().OpenMetrics(argv[++i]))
+                return -1;
+        }
+        else if (argument == "--generate-scene" && i + 1 < argc)
+        {
+            // writes a large grid of the bundled models for streaming tests, then exits
+            std::string output = argv[++i];
+            unsigned int size = (i + 1 < argc && argv[i + 1][0] != '-') ? (unsigned int)atoi(argv[++i]) : 64;
+            std::vector<SceneModel> models(2);
+            models[0].Name = "ship";
+            models[0].Path = "../assets/models/SF_Light-Fighter_X6/SF_Light_Fighter-X6.obj";
+            models[1].Name = "nanosuit";
+            models[1].Path = "../assets/models/nanosuit/nanosuit.obj";
+            Scene generated = Scene::Generate(size, 6.0f, models, 0.05f, 8, 1337);
+            if (!generated.Save(output))
+                return -1;
+            std::cout << "wrote " << generated.Instances.size() << " instances and " << generated.Lights.size()
+                      << " lights in " << generated.Cells.size() << " cells to " << output << std::endl;
+            return 0;
+        }
+        else
+            scenePath = argument;
+    }
+    if (importStats)
+    {
+        // imports every model of the scene once and reports what it cost, then exits
+        Scene scene;
+        if (!scene.Load(scenePath))
+            return -1;
+        LoadProfile().Enabled = true;
+        for (unsigned int m = 0; m < scene.Models.size(); m++)
+        {
+            LoadProfile().Reset();
+            Allocations().Reset();
+            size_t heapBefore = Allocations().LiveBytes;
+            ModelData data;
+            if (!ImportModel(scene.Models[m].Path, data))
+                return -1;
+            std::cout << scene.Models[m].Name << ": " << Allocations().Count << " allocations, "
+                      << Allocations().Bytes / (1024.0 * 1024.0) << " MB allocated, peak heap growth "
+                      << (Allocations().PeakBytes - heapBefore) / (1024.0 * 1024.0) << " MB, geometry "
+                      << data.GeometryBytes() / (1024.0 * 1024.0) << " MB, images " << data.ImageBytes() / (1024.0 * 1024.0)
+                      << " MB, peak RSS " << PeakResidentBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+            size_t meshlets = 0, triangles = 0;
+            for (unsigned int i = 0; i < data.meshes.size(); i++)
+            {
+                meshlets += data.meshes[i].Meshlets.Count;
+                triangles += data.meshes[i].indices.size() / 3;
+            }
+            if (meshlets > 0)
+                std::cout << "    " << meshlets << " meshlets, " << (double)triangles / meshlets << " triangles per meshlet" << std::endl;
+            LoadProfile().Report(std::cout);
+        }
+        return 0;
+    }
+
+    // load the scene: models are streamed in and out around the camera, cell by cell
+    // -------------------------------------------------------------------------------
+    Scene scene;
+    if (!scene.Load(scenePath))
+        return -1;
+    std::cout << "scene " << scenePath << ": " << scene.Models.size() << " models, " << scene.Instances.size() << " instances, "
+              << scene.Lights.size() << " lights in " << scene.Cells.size() << " cells" << std::endl;
+    CameraPath cameraPath;
+    if (!cameraPathFile.empty() && !cameraPath.Load(cameraPathFile))
+        return -1;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // ask for 4.3 first (compute shaders and multi-draw indirect for the GPU-driven path), 3.3 is enough for the rest
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -56,16 +234,25 @@ int main()
     // --------------------
     GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "BaseOpenGL", NULL, NULL);
     if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "BaseOpenGL", NULL, NULL);
+    }
+    if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // on HiDPI displays the framebuffer is larger than the window
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -80,272 +267,805 @@ int main()
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
-
-    // build and compile our shader program
-    // ------------------------------------
-    Shader baseShader("../src/shaders/base_shader.vs", "../src/shaders/base_shader.fs");
-    Shader geometryPassShader("../src/shaders/geometry_pass.vs", "../src/shaders/geometry_pass.fs");
-    Shader lightingPassShader("../src/shaders/lighting_pass.vs", "../src/shaders/lighting_pass.fs");
-    Shader lightBoxShader("../src/shaders/light_box.vs", "../src/shaders/light_box.fs");
-
-    // load models
-    // -----------
-    // Model charModel("../assets/models/nanosuit/nanosuit.obj");
-    Model shipModel("../assets/models/SF_Light-Fighter_X6/SF_Light_Fighter-X6.obj");
-    std::vector<glm::vec3> objectPositions;
-    objectPositions.push_back(glm::vec3(-5.0,  0.0, -8.0));
-    objectPositions.push_back(glm::vec3( 0.0,  0.0, -8.0));
-    objectPositions.push_back(glm::vec3( 5.0,  0.0, -8.0));
-    objectPositions.push_back(glm::vec3(-5.0,  0.0,  0.0));
-    objectPositions.push_back(glm::vec3( 0.0,  0.0,  0.0));
-    objectPositions.push_back(glm::vec3( 5.0,  0.0,  0.0));
-    objectPositions.push_back(glm::vec3(-5.0,  0.0,  8.0));
-    objectPositions.push_back(glm::vec3( 0.0,  0.0,  8.0));
-    objectPositions.push_back(glm::vec3( 5.0,  0.0,  8.0));
-
-    // configure g-buffer framebuffer
-    // ------------------------------
-    unsigned int gBuffer;
-    glGenFramebuffers(1, &gBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-    unsigned int gPosition, gNormal, gAlbedoSpec;
-    // position color buffer
-    glGenTextures(1, &gPosition);
-    glBindTexture(GL_TEXTURE_2D, gPosition);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
-    // normal color buffer
-    glGenTextures(1, &gNormal);
-    glBindTexture(GL_TEXTURE_2D, gNormal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
-    // color + specular + emission color buffer
-    glGenTextures(1, &gAlbedoSpec);
-    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, WINDOW_WIDTH, WINDOW_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gAlbedoSpec, 0);
-    // tell OpenGL which color attachments we'll use (of this framebuffer) for rendering
-    unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, attachments);
-    // create and attach depth buffer (renderbuffer)
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, WINDOW_WIDTH, WINDOW_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    // finally check if framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // lighting info
-    // -------------
-    const unsigned int NR_LIGHTS = 10;
-    std::vector<glm::vec3> lightPositions;
-    std::vector<glm::vec3> lightColors;
-    srand(1337);
-    for (unsigned int i = 0; i < NR_LIGHTS; i++)
-    {
-        // calculate slightly random offsets
-        float xPos = ((rand() % 100) / 100.0) * 16.0 - 8.0;
-        float yPos = ((rand() % 100) / 100.0) * 8.0 - 2.0;
-        float zPos = ((rand() % 100) / 100.0) * 10.0 - 5.0;
-        lightPositions.push_back(glm::vec3(xPos, yPos, zPos));
-        // also calculate random color
-        float rColor = ((rand() % 100) / 200.0) + 0.2;
-        float gColor = ((rand() % 100) / 200.0) + 0.2;
-        float bColor = ((rand() % 100) / 200.0) + 0.2;
-        lightColors.push_back(glm::vec3(rColor, gColor, bColor));
-    }
+    GLState().Enable(GL_DEPTH_TEST);
 
-    // shader configuration
-    // --------------------
-    lightingPassShader.Use();
-    lightingPassShader.SetInteger("gPosition", 0);
-    lightingPassShader.SetInteger("gNormal", 1);
-    lightingPassShader.SetInteger("gAlbedoSpec", 2);
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // the render objects own GL resources: they are destroyed at the end of this block, while the context still exists
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // build and compile our shader program
+        // ------------------------------------
+        // the lit passes are specialised per light setup, see ShaderVariants
+        ShaderVariants baseShaderVariants("../src/shaders/base_shader.vs", "../src/shaders/base_shader.fs");
+        Shader depthPrepassShader("../src/shaders/depth_prepass.vs", "../src/shaders/depth_prepass.fs");
+        Shader geometryPassShader("../src/shaders/geometry_pass.vs", "../src/shaders/geometry_pass.fs");
+        ShaderVariants lightingPassShaderVariants("../src/shaders/lighting_pass.vs", "../src/shaders/lighting_pass.fs");
+        Shader lightBoxShader("../src/shaders/light_box.vs", "../src/shaders/light_box.fs");
+        Shader upscaleShader("../src/shaders/upscale.vs", "../src/shaders/upscale.fs");
+
+        // baked lighting: the diffuse light of the static lights, cached next to the scene file until they change
+        // ---------------------------------------------------------------------------------------------------------
+        IrradianceGrid irradiance;
+        irradiance.LoadOrBake(scene, 0.35f, 0.44f, scenePath + ".irradiance"); // the lighting passes' attenuation
+        irradiance.Upload();
+        SceneStreamer streamer(scene);
+        streamer.Loader().UploadBudget = uploadBudget;
+        // per-frame list of the streamed instances
+        std::vector<glm::mat4> objectTransforms;
+        std::vector<Model*> objectModels;
+        std::vector<unsigned int> objectModelIndices; // into Scene::Models
+        // bounding boxes standing in for the instances of cells still loading, colored by upload progress
+        std::vector<glm::mat4> placeholderTransforms;
+        std::vector<glm::vec3> placeholderColors;
+
+        // texture residency: the largest on-screen size of each scene model decides the mips its textures need
+        // ------------------------------------------------------------------------------------------------------
+        std::vector<float> modelScreenSizes(scene.Models.size());
+
+        // occlusion culling: each model's largest triangles make its occluder, built the first time it is resident
+        // ---------------------------------------------------------------------------------------------------------
+        std::vector<OccluderMesh> occluders(scene.Models.size());
+        OcclusionCuller occlusionCuller;
+        std::vector<unsigned int> visibleObjects;
+        std::vector<std::pair<float, unsigned int> > occluderCandidates;
+
+        // meshlet culling: the meshlets of each drawn instance are tested against the frustum and their normal cones
+        // -----------------------------------------------------------------------------------------------------------
+        MeshletCuller meshletCuller;
 
-        // input
-        // -----
-        processInput(window);
+        // GPU-driven culling: instances culled by a compute shader and drawn with multi-draw indirect (GL 4.3+)
+        // -------------------------------------------------------------------------------------------------------
+        IndirectRenderer indirectRenderer;
+        Shader geometryPassIndirectShader;
+        std::vector<Model*> indirectModels;
+        std::vector<unsigned int> indirectModelSlots(scene.Models.size()); // scene model -> index in indirectModels
+        std::vector<unsigned int> indirectInstanceModels;
+        if (indirectRenderer.Init())
+            geometryPassIndirectShader = Shader("../src/shaders/geometry_pass_indirect.vs", "../src/shaders/geometry_pass.fs");
+        else
+            std::cout << "OpenGL 4.3 not available, GPU-driven culling disabled" << std::endl;
 
-        // render
-        // ------
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // multi-view: the forward pass renders several views at once, one instance per view (see MultiView)
+        // ---------------------------------------------------------------------------------------------------
+        MultiView multiView;
+        multiView.Init();
+        ShaderDefines multiViewDefines;
+        multiView.AddDefines(multiViewDefines);
+        Shader depthPrepassMultiViewShader("../src/shaders/depth_prepass.vs", "../src/shaders/depth_prepass.fs", multiViewDefines);
+        if (!multiView.ViewportIndex)
+            std::cout << "no vertex shader viewport index, multi-view draws the views one after the other" << std::endl;
 
-        if (!deferredShadingFlag)
+        // render targets: sized by the resolution manager, allocated by the frame graph
+        // ------------------------------------------------------------------------------
+        ResolutionManager resolution;
+        resolution.Init(framebufferWidth, framebufferHeight);
+        FrameGraph frameGraph;
+        bool frameGraphDirty = true;
+        bool frameGraphDeferred = deferredShadingFlag;
+        bool frameGraphDepthPrepass = depthPrepassFlag;
+        bool frameGraphGpuDriven = false;
+        FrameGraphResource gPosition = FRAME_GRAPH_INVALID;
+        FrameGraphResource gNormal = FRAME_GRAPH_INVALID;
+        FrameGraphResource gAlbedoSpec = FRAME_GRAPH_INVALID;
+        FrameGraphResource sceneDepth = FRAME_GRAPH_INVALID;
+        FrameGraphResource sceneColor = FRAME_GRAPH_INVALID;
+        int geometryPassIndex = -1;
+        int hiZPassIndex = -1;
+
+        // incremental rendering: passes whose inputs didn't change are skipped, an unchanged frame isn't rendered at all
+        // ---------------------------------------------------------------------------------------------------------------
+        ChangeTracker changes;
+        unsigned int fullFrames = 0;     // since the last stats report
+        unsigned int lightingFrames = 0; // lit from the previous G-buffer
+        unsigned int idleFrames = 0;
+        unsigned int passesExecuted = 0;
+        unsigned int passesReused = 0;
+        unsigned int steadyFrames = 0;          // rendering only, nothing streamed or rebuilt
+        size_t steadyFrameAllocations = 0;      // made by those frames on this thread
+
+        // per-frame values shared by the frame graph passes
+        glm::mat4 projection;
+        glm::mat4 view;
+        float rotationAngle = 0.0f;
+        bool geometryRendered = true;
+
+        // lighting info: the shaders take NR_LIGHTS point lights, the nearest resident ones are used
+        // ------------------------------------------------------------------------------------------
+        const unsigned int NR_LIGHTS = 10;
+        std::vector<glm::vec3> lightPositions;
+        std::vector<glm::vec3> lightColors;
+        std::vector<std::pair<float, unsigned int> > lightCandidates;
+        bool bakedLighting = false;
+        unsigned int bakedLightCount = 0; // last slots, static lights in the irradiance grid: only their specular is per pixel
+        // the per-frame lists never hold more than the scene has, sized up front so that a steady frame doesn't grow them
+        visibleObjects.reserve(scene.Instances.size());
+        occluderCandidates.reserve(scene.Instances.size());
+        placeholderTransforms.reserve(scene.Instances.size());
+        placeholderColors.reserve(scene.Instances.size());
+        lightCandidates.reserve(scene.Lights.size());
+        lightPositions.reserve(NR_LIGHTS);
+        lightColors.reserve(NR_LIGHTS);
+        // the variants of this frame's light setup
+        ShaderDefines lightingDefines;
+        unsigned int lastLightingSetup = ~0u;
+        Shader *baseShader = 0;
+        Shader *lightingPassShader = 0;
+
+        // shader configuration
+        // --------------------
+        // every variant of the lit passes gets its constant uniforms when it is compiled
+        lightingPassShaderVariants.OnCompile([&](Shader &shader)
+        {
+            shader.SetInteger("gPosition", 0);
+            shader.SetInteger("gNormal", 1);
+            shader.SetInteger("gAlbedoSpec", 2);
+            shader.SetInteger("irradianceRed", IRRADIANCE_GRID_TEXTURE_UNIT);
+            shader.SetInteger("irradianceGreen", IRRADIANCE_GRID_TEXTURE_UNIT + 1);
+            shader.SetInteger("irradianceBlue", IRRADIANCE_GRID_TEXTURE_UNIT + 2);
+            shader.SetVector3f("irradianceMin", irradiance.TextureMin());
+            shader.SetVector3f("irradianceExtent", irradiance.TextureExtent());
+        });
+        baseShaderVariants.OnCompile([&](Shader &shader)
         {
-            // ------------------- FORWARD SHADING START --------------- //
-            baseShader.Use();
-
-            // set lighting uniforms
-            baseShader.SetVector3f("viewPos", camera.Position);
-            baseShader.SetInteger("dirLightFlag", dirLightFlag);
-
-            // light properties
-            // directional light
-            baseShader.SetVector3f("dirLight.Direction", 0.0f, 1.0f, 0.0f);
-            baseShader.SetVector3f("dirLight.Ambient", 0.05f, 0.05f, 0.05f);
-            baseShader.SetVector3f("dirLight.Diffuse", 0.2f, 0.2f, 0.2f);
-            baseShader.SetVector3f("dirLight.Specular", 0.5f, 0.5f, 0.5f);
-
-            // light properties
-            for (unsigned int i = 0; i < lightPositions.size(); i++)
+            shader.SetInteger("irradianceRed", IRRADIANCE_GRID_TEXTURE_UNIT);
+            shader.SetInteger("irradianceGreen", IRRADIANCE_GRID_TEXTURE_UNIT + 1);
+            shader.SetInteger("irradianceBlue", IRRADIANCE_GRID_TEXTURE_UNIT + 2);
+            shader.SetVector3f("irradianceMin", irradiance.TextureMin());
+            shader.SetVector3f("irradianceExtent", irradiance.TextureExtent());
+        });
+        upscaleShader.Use();
+        upscaleShader.SetInteger("sceneColor", 0);
+
+        // pipeline statistics
+        // -------------------
+        FragmentInvocationsQuery fragmentInvocationsQuery;
+        fragmentInvocationsQuery.Init();
+        if (!fragmentInvocationsQuery.Supported)
+            std::cout << "GL_ARB_pipeline_statistics_query not available, fragment invocations won't be reported" << std::endl;
+        float lastStatsReport = 0.0f;
+
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            // latency control: wait until the GPU is few enough frames behind (and for the frame's start time if pacing
+            // to a target), then read the input as late as possible; otherwise it was read after the last swap
+            // -----------------------------------------------------------------------------------------------------------
+            framePacer.Limit = latencyControlFlag;
+            framePacer.BeginFrame();
+            if (latencyControlFlag)
+                glfwPollEvents();
+
+            // per-frame time logic
+            // --------------------
+            float currentFrame = glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
+
+            GLState().ResetCounters();
+            // transient data of the last frame is gone, a frame that changes nothing but the view mustn't allocate
+            FrameMemory().Reset();
+            AllocationScope frameAllocations;
+            bool steadyFrame = true;
+
+            // input
+            // -----
+            processInput(window);
+
+            // rebuild the frame graph when the framebuffer or the pipeline configuration changed
+            // -----------------------------------------------------------------------------------
+            if (resolution.Resize(framebufferWidth, framebufferHeight))
+                frameGraphDirty = true;
+            // multi-view renders forward, the deferred passes have a single view
+            bool deferredShading = deferredShadingFlag && !multiViewFlag;
+            // the GPU-driven path feeds the deferred geometry pass, its Hi-Z needs the geometry depth
+            bool gpuDriven = gpuDrivenFlag && indirectRenderer.Supported && deferredShading;
+            if (frameGraphDeferred != deferredShading || frameGraphDepthPrepass != depthPrepassFlag || frameGraphGpuDriven != gpuDriven)
+                frameGraphDirty = true;
+            resolution.DynamicScaling = dynamicResolutionFlag;
+
+            if (frameGraphDirty)
             {
-                baseShader.SetVector3f("pointLights[" + std::to_string(i) + "].Position", lightPositions[i]);
-                baseShader.SetVector3f("pointLights[" + std::to_string(i) + "].Color", lightColors[i]);
-                // update attenuation parameters and calculate radius
-                const float constant = 1.0; // note that we don't send this to the shader, we assume it is always 1.0 (in our case)
-                const float linear = 0.35;
-                const float quadratic = 0.44;
-                baseShader.SetFloat("pointLights[" + std::to_string(i) + "].Linear", linear);
-                baseShader.SetFloat("pointLights[" + std::to_string(i) + "].Quadratic", quadratic);
+                frameGraphDeferred = deferredShading;
+                frameGraphDepthPrepass = depthPrepassFlag;
+                frameGraphGpuDriven = gpuDriven;
+                // the depth pyramid of the previous configuration doesn't match the new one
+                indirectRenderer.InvalidateHiZ();
+                frameGraph.Reset();
+                changes.Invalidate();
+                geometryPassIndex = -1;
+                hiZPassIndex = -1;
+                FrameGraphResource backbuffer = frameGraph.ImportBackbuffer("backbuffer", framebufferWidth, framebufferHeight);
+
+                if (!deferredShading)
+                {
+                    // ------------------- FORWARD SHADING START --------------- //
+                    // 0. optional depth pre-pass: lay down the nearest depth with a position-only shader
+                    // -----------------------------------------------------------------------------------
+                    if (depthPrepassFlag)
+                    {
+                        unsigned int depthPrepass = frameGraph.AddPass("depth pre-pass", [&]()
+                        {
+                            GLState().Viewport(0, 0, framebufferWidth, framebufferHeight);
+                            GLState().ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                            if (multiViewFlag)
+                            {
+                                depthPrepassMultiViewShader.Use();
+                                multiView.SetUniforms(depthPrepassMultiViewShader);
+                                multiView.Draw(depthPrepassMultiViewShader, objectModels, objectTransforms, visibleObjects);
+                                GLState().Viewport(0, 0, framebufferWidth, framebufferHeight);
+                                GLState().ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                                return;
+                            }
+                            depthPrepassShader.Use();
+                            depthPrepassShader.SetMatrix4("projection", projection);
+                            depthPrepassShader.SetMatrix4("view", view);
+                            for (unsigned int v = 0; v < visibleObjects.size(); v++)
+                                drawObject(*objectModels[visibleObjects[v]], depthPrepassShader, objectTransforms[visibleObjects[v]],
+                                           projection * view, meshletCuller);
+                            GLState().ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                        });
+                        frameGraph.Write(depthPrepass, backbuffer);
+                    }
+
+                    // 1. shade the models, then render the lights on top
+                    // --------------------------------------------------
+                    unsigned int forwardPass = frameGraph.AddPass("forward shading", [&]()
+                    {
+                        GLState().Viewport(0, 0, framebufferWidth, framebufferHeight);
+                        if (depthPrepassFlag)
+                        {
+                            // only the fragments that won the pre-pass get shaded
+                            GLState().DepthFunc(GL_EQUAL);
+                            GLState().DepthMask(GL_FALSE);
+                        }
+
+                        baseShader->Use();
+
+                        // set lighting uniforms
+                        baseShader->SetVector3f("viewPos", camera.Position);
+                        if (bakedLighting)
+                            irradiance.Bind(IRRADIANCE_GRID_TEXTURE_UNIT);
+
+                        // light properties
+                        // directional light
+                        baseShader->SetVector3f("dirLight.Direction", 0.0f, 1.0f, 0.0f);
+                        baseShader->SetVector3f("dirLight.Ambient", 0.05f, 0.05f, 0.05f);
+                        baseShader->SetVector3f("dirLight.Diffuse", 0.2f, 0.2f, 0.2f);
+                        baseShader->SetVector3f("dirLight.Specular", 0.5f, 0.5f, 0.5f);
+
+                        // light properties, unused slots are black
+                        for (unsigned int i = 0; i < NR_LIGHTS; i++)
+                        {
+                            baseShader->SetVector3f(FrameMemory().Format("pointLights[%u].Position", i), i < lightPositions.size() ? lightPositions[i] : glm::vec3(0.0f));
+                            baseShader->SetVector3f(FrameMemory().Format("pointLights[%u].Color", i), i < lightColors.size() ? lightColors[i] : glm::vec3(0.0f));
+                            // update attenuation parameters and calculate radius
+                            const float constant = 1.0; // note that we don't send this to the shader, we assume it is always 1.0 (in our case)
+                            const float linear = 0.35;
+                            const float quadratic = 0.44;
+                            baseShader->SetFloat(FrameMemory().Format("pointLights[%u].Linear", i), linear);
+                            baseShader->SetFloat(FrameMemory().Format("pointLights[%u].Quadratic", i), quadratic);
+                        }
+                        baseShader->SetMatrix4("projection", projection);
+                        baseShader->SetMatrix4("view", view);
+
+                        // the culler reports on the shading pass only, the pre-pass culls the same meshlets
+                        meshletCuller.ResetStats();
+                        fragmentInvocationsQuery.Begin();
+                        if (multiViewFlag)
+                        {
+                            multiView.SetUniforms(*baseShader);
+                            multiView.Draw(*baseShader, objectModels, objectTransforms, visibleObjects);
+                        }
+                        else
+                            for (unsigned int v = 0; v < visibleObjects.size(); v++)
+                                drawObject(*objectModels[visibleObjects[v]], *baseShader, objectTransforms[visibleObjects[v]],
+                                           projection * view, meshletCuller);
+                        fragmentInvocationsQuery.End();
+
+                        if (depthPrepassFlag)
+                        {
+                            // back to regular depth testing for the light boxes
+                            GLState().DepthFunc(GL_LESS);
+                            GLState().DepthMask(GL_TRUE);
+                        }
+
+                        if (multiViewFlag)
+                        {
+                            // few boxes, drawn per view with the single-view shader
+                            for (unsigned int v = 0; v < multiView.ViewCount; v++)
+                            {
+                                const RenderView &renderView = multiView.Views[v];
+                                GLState().Viewport(renderView.X, renderView.Y, renderView.Width, renderView.Height);
+                                renderLightBoxes(lightBoxShader, renderView.Projection, renderView.View, lightPositions, lightColors);
+                                renderPlaceholders(lightBoxShader, renderView.Projection, renderView.View, placeholderTransforms,
+                                                   placeholderColors);
+                            }
+                            GLState().Viewport(0, 0, framebufferWidth, framebufferHeight);
+                            return;
+                        }
+                        renderLightBoxes(lightBoxShader, projection, view, lightPositions, lightColors);
+                        renderPlaceholders(lightBoxShader, projection, view, placeholderTransforms, placeholderColors);
+                    });
+                    frameGraph.Write(forwardPass, backbuffer);
+                    // ------------------- FORWARD SHADING END --------------- //
+                }
+                else
+                {
+                    // ------------------- DEFERRED SHADING START --------------- //
+                    gPosition = frameGraph.CreateTexture("gPosition", resolution.RenderTargetDesc(GL_RGB16F));
+                    gNormal = frameGraph.CreateTexture("gNormal", resolution.RenderTargetDesc(GL_RGB16F));
+                    gAlbedoSpec = frameGraph.CreateTexture("gAlbedoSpec", resolution.RenderTargetDesc(GL_RGBA8));
+                    // shared by the geometry and light box passes, no need to blit it anywhere
+                    sceneDepth = frameGraph.CreateTexture("depth", resolution.RenderTargetDesc(GL_DEPTH_COMPONENT24));
+                    // lit scene, sampled with bilinear filtering by the upscale pass
+                    sceneColor = frameGraph.CreateTexture("sceneColor", resolution.RenderTargetDesc(GL_RGBA16F, GL_LINEAR));
+                    // kept across frames, the lighting pass reuses them while the geometry doesn't change
+                    frameGraph.SetPersistent(gPosition);
+                    frameGraph.SetPersistent(gNormal);
+                    frameGraph.SetPersistent(gAlbedoSpec);
+                    frameGraph.SetPersistent(sceneDepth);
+
+                    // 1. geometry pass: render scene's geometry/color data into gbuffer, at the scaled resolution
+                    // ---------------------------------------------------------------------------------------------
+                    unsigned int geometryPass = frameGraph.AddPass("geometry", [&]()
+                    {
+                        resolution.BeginFrame();
+                        GLState().Viewport(0, 0, resolution.RenderWidth, resolution.RenderHeight);
+                        if (frameGraphGpuDriven)
+                        {
+                            // instances were culled on the GPU, one multi-draw per material
+                            geometryPassIndirectShader.Use();
+                            geometryPassIndirectShader.SetMatrix4("projection", projection);
+                            geometryPassIndirectShader.SetMatrix4("view", view);
+                            indirectRenderer.Draw(geometryPassIndirectShader);
+                            return;
+                        }
+                        geometryPassShader.Use();
+                        geometryPassShader.SetMatrix4("projection", projection);
+                        geometryPassShader.SetMatrix4("view", view);
+                        meshletCuller.ResetStats();
+                        for (unsigned int v = 0; v < visibleObjects.size(); v++)
+                            drawObject(*objectModels[visibleObjects[v]], geometryPassShader, objectTransforms[visibleObjects[v]],
+                                       projection * view, meshletCuller);
+                    });
+                    frameGraph.Write(geometryPass, gPosition);
+                    frameGraph.Write(geometryPass, gNormal);
+                    frameGraph.Write(geometryPass, gAlbedoSpec);
+                    frameGraph.Write(geometryPass, sceneDepth);
+                    geometryPassIndex = (int)geometryPass;
+
+                    // 1b. depth pyramid of the geometry, used by the next frame's GPU culling
+                    // -----------------------------------------------------------------------
+                    if (frameGraphGpuDriven)
+                    {
+                        unsigned int hiZPass = frameGraph.AddPass("hi-z", [&]()
+                        {
+                            indirectRenderer.BuildHiZ(frameGraph.Texture(sceneDepth), resolution.RenderWidth, resolution.RenderHeight,
+                                                      resolution.FramebufferWidth, resolution.FramebufferHeight, projection * view);
+                        });
+                        frameGraph.Read(hiZPass, sceneDepth);
+                        frameGraph.SetSideEffect(hiZPass);
+                        hiZPassIndex = (int)hiZPass;
+                    }
+
+                    // 2. lighting pass: calculate lighting by iterating over a screen filled quad pixel-by-pixel using the gbuffer's content.
+                    // the lit result goes to the scene color target, still at the scaled resolution.
+                    // -----------------------------------------------------------------------------------------------------------------------
+                    unsigned int lightingPass = frameGraph.AddPass("lighting", [&]()
+                    {
+                        // the geometry pass that set the scaled viewport may have been skipped this frame
+                        GLState().Viewport(0, 0, resolution.RenderWidth, resolution.RenderHeight);
+                        lightingPassShader->Use();
+                        lightingPassShader->SetVector2f("uvScale", resolution.UVScale());
+                        GLState().BindTexture(0, GL_TEXTURE_2D, frameGraph.Texture(gPosition));
+                        GLState().BindTexture(1, GL_TEXTURE_2D, frameGraph.Texture(gNormal));
+                        GLState().BindTexture(2, GL_TEXTURE_2D, frameGraph.Texture(gAlbedoSpec));
+                        // send light relevant uniforms, unused slots are black
+                        for (unsigned int i = 0; i < NR_LIGHTS; i++)
+                        {
+                            lightingPassShader->SetVector3f(FrameMemory().Format("pointLights[%u].Position", i), i < lightPositions.size() ? lightPositions[i] : glm::vec3(0.0f));
+                            lightingPassShader->SetVector3f(FrameMemory().Format("pointLights[%u].Color", i), i < lightColors.size() ? lightColors[i] : glm::vec3(0.0f));
+                            // update attenuation parameters and calculate radius
+                            const float constant = 1.0; // note that we don't send this to the shader, we assume it is always 1.0 (in our case)
+                            const float linear = 0.35;
+                            const float quadratic = 0.44;
+                            lightingPassShader->SetFloat(FrameMemory().Format("pointLights[%u].Linear", i), linear);
+                            lightingPassShader->SetFloat(FrameMemory().Format("pointLights[%u].Quadratic", i), quadratic);
+                        }
+                        lightingPassShader->SetVector3f("viewPos", camera.Position);
+                        if (bakedLighting)
+                            irradiance.Bind(IRRADIANCE_GRID_TEXTURE_UNIT);
+                        // render the quad
+                        renderQuad();
+                    });
+                    frameGraph.Read(lightingPass, gPosition);
+                    frameGraph.Read(lightingPass, gNormal);
+                    frameGraph.Read(lightingPass, gAlbedoSpec);
+                    frameGraph.Write(lightingPass, sceneColor);
+
+                    // 3. render lights on top of scene, depth tested against the geometry pass depth
+                    // ------------------------------------------------------------------------------
+                    unsigned int lightBoxPass = frameGraph.AddPass("light boxes", [&]()
+                    {
+                        GLState().Viewport(0, 0, resolution.RenderWidth, resolution.RenderHeight);
+                        // the boxes mustn't end up in the depth the next frames may reuse with the G-buffer
+                        if (incrementalFlag)
+                            GLState().DepthMask(GL_FALSE);
+                        renderLightBoxes(lightBoxShader, projection, view, lightPositions, lightColors);
+                        renderPlaceholders(lightBoxShader, projection, view, placeholderTransforms, placeholderColors);
+                        GLState().DepthMask(GL_TRUE);
+                        // only frames that rendered the geometry are timed for the dynamic resolution
+                        if (geometryRendered)
+                            resolution.EndFrame();
+                    });
+                    frameGraph.Write(lightBoxPass, sceneColor);
+                    frameGraph.Write(lightBoxPass, sceneDepth);
+
+                    // 4. upscale the lit scene to the whole backbuffer
+                    // ------------------------------------------------
+                    unsigned int upscalePass = frameGraph.AddPass("upscale", [&]()
+                    {
+                        GLState().Viewport(0, 0, framebufferWidth, framebufferHeight);
+                        upscaleShader.Use();
+                        upscaleShader.SetVector2f("uvScale", resolution.UVScale());
+                        upscaleShader.SetVector2f("sceneSize", (float)resolution.FramebufferWidth, (float)resolution.FramebufferHeight);
+                        upscaleShader.SetInteger("filterMode", edgeAwareUpscaleFlag ? 1 : 0);
+                        GLState().BindTexture(0, GL_TEXTURE_2D, frameGraph.Texture(sceneColor));
+                        renderQuad();
+                    });
+                    frameGraph.Read(upscalePass, sceneColor);
+                    frameGraph.Write(upscalePass, backbuffer);
+                    // ------------------- DEFERRED SHADING END --------------- //
+                }
+
+                frameGraph.Compile();
+                std::cout << "frame graph:" << std::endl;
+                frameGraph.Describe(std::cout);
+                frameGraphDirty = false;
+                steadyFrame = false;
             }
-            // pass projection matrix to shader (note that in this case it could change every frame)
-            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
-                                                    (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT,
-                                                    0.1f, 100.0f);
-            baseShader.SetMatrix4("projection", projection);
 
-            // camera/view transformation
-            glm::mat4 view = camera.GetViewMatrix();
-            baseShader.SetMatrix4("view", view);
+            // streaming: load what is around the camera, release what is far away
+            // --------------------------------------------------------------------
+            if (!cameraPath.Empty())
+                cameraPath.Apply(camera, currentFrame);
+            streamer.Update(camera.Position);
+            const std::vector<StreamedInstance> &streamedInstances = streamer.Instances();
+            if (streamer.Changed())
+            {
+                objectTransforms.resize(streamedInstances.size());
+                objectModels.clear();
+                objectModelIndices.clear();
+                for (unsigned int i = 0; i < streamedInstances.size(); i++)
+                {
+                    objectModels.push_back(streamedInstances[i].Loaded);
+                    objectModelIndices.push_back(streamedInstances[i].ModelIndex);
+                    const std::vector<Mesh> &meshes = streamedInstances[i].Loaded->meshes;
+                    for (unsigned int m = 0; m < meshes.size(); m++)
+                        meshletCuller.Reserve(meshes[m].Meshlets.Count);
+                    if (occluders[streamedInstances[i].ModelIndex].Triangles.empty())
+                        occluders[streamedInstances[i].ModelIndex] = BuildOccluderMesh(streamedInstances[i].Loaded->meshes);
+                    // the occluder was the last user of the CPU geometry, the GPU-driven path copies from the mesh buffers
+                    if (releaseGeometry)
+                        streamedInstances[i].Loaded->ReleaseGeometry();
+                }
+                if (indirectRenderer.Supported)
+                {
+                    // the GPU-driven path merges the geometry of the resident models
+                    indirectModels.clear();
+                    indirectInstanceModels.clear();
+                    for (unsigned int m = 0; m < scene.Models.size(); m++)
+                    {
+                        indirectModelSlots[m] = (unsigned int)indirectModels.size();
+                        if (Model *resident = streamer.Resident(m))
+                            indirectModels.push_back(resident);
+                    }
+                    for (unsigned int i = 0; i < objectModelIndices.size(); i++)
+                        indirectInstanceModels.push_back(indirectModelSlots[objectModelIndices[i]]);
+                    indirectRenderer.SetModels(indirectModels);
+                }
+            }
 
-            for (unsigned int i = 0; i < objectPositions.size(); i++)
+            // the nearest resident lights fill the NR_LIGHTS slots of the shaders, the baked ones go last and only add
+            // specular
+            bakedLighting = bakedLightingFlag && !irradiance.Empty();
+            lightCandidates.clear();
+            for (unsigned int i = 0; i < streamer.Lights().size(); i++)
             {
-                glm::mat4 model = glm::mat4(1.0);
-                model = glm::translate(model, objectPositions[i]);
-                model = glm::scale(model, glm::vec3(0.05f));
-                if (rotateModelFlag)
-                    model = glm::rotate(model, (float)glfwGetTime() * -1.0f, glm::normalize(glm::vec3(-0.5, -0.6, 0.8)));
-                baseShader.SetMatrix4("model", model);
-                shipModel.Draw(baseShader);
+                unsigned int light = streamer.Lights()[i];
+                lightCandidates.push_back(std::make_pair(glm::distance(camera.Position, scene.Lights[light].Position), light));
             }
+            std::sort(lightCandidates.begin(), lightCandidates.end());
+            lightCandidates.resize(std::min(lightCandidates.size(), (size_t)NR_LIGHTS));
+            lightPositions.clear();
+            lightColors.clear();
+            bakedLightCount = 0;
+            // per-pixel lights first, then the baked ones (a stable partition in place, std::stable_partition allocates)
+            for (unsigned int baked = 0; baked < 2; baked++)
+                for (unsigned int i = 0; i < lightCandidates.size(); i++)
+                {
+                    const SceneLight &light = scene.Lights[lightCandidates[i].second];
+                    if ((bakedLighting && light.Static) != (baked == 1))
+                        continue;
+                    lightPositions.push_back(light.Position);
+                    lightColors.push_back(light.Color);
+                    bakedLightCount += baked;
+                }
 
-            lightBoxShader.Use();
-            lightBoxShader.SetMatrix4("projection", projection);
-            lightBoxShader.SetMatrix4("view", view);
-            for (unsigned int i = 0; i < lightPositions.size(); i++)
+            // the lit pass in use, specialised for the light setup; a new setup compiles its variant once. The defines
+            // and their key are only built again when the setup changes
+            unsigned int lightingSetup = (bakedLighting ? 1 : 0) | (dirLightFlag ? 2 : 0) | (frameGraphDeferred ? 4 : 0) |
+                                         ((unsigned int)lightPositions.size() << 3) | (bakedLightCount << 8) |
+                                         (multiViewFlag ? 1u << 16 : 0);
+            if (lightingSetup != lastLightingSetup)
             {
-                glm::mat4 model = glm::mat4(1.0);
-                model = glm::translate(model, lightPositions[i]);
-                model = glm::scale(model, glm::vec3(0.05f));
-                lightBoxShader.SetMatrix4("model", model);
-                lightBoxShader.SetVector3f("lightColor", lightColors[i]);
-                renderCube();
+                lightingDefines.Clear();
+                lightingDefines.Keyword("BAKED_LIGHTING", bakedLighting);
+                lightingDefines.Constant("POINT_LIGHTS", (int)lightPositions.size());
+                lightingDefines.Constant("BAKED_POINT_LIGHTS", (int)bakedLightCount);
+                if (frameGraphDeferred)
+                    lightingPassShader = &lightingPassShaderVariants.Get(lightingDefines);
+                else
+                {
+                    ShaderDefines baseDefines(lightingDefines);
+                    baseDefines.Keyword("DIR_LIGHT", dirLightFlag);
+                    if (multiViewFlag)
+                        multiView.AddDefines(baseDefines);
+                    baseShader = &baseShaderVariants.Get(baseDefines);
+                }
+                lastLightingSetup = lightingSetup;
+                steadyFrame = false;
             }
-            // ------------------- FORWARD SHADING END --------------- //
-        }
 
-        if (deferredShadingFlag)
-        {
-            // ------------------- DEFERRED SHADING START --------------- //
-            // 1. geometry pass: render scene's geometry/color data into gbuffer
-            // -----------------------------------------------------------------
-            glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-                geometryPassShader.Use();
-                // pass projection matrix to shader (note that in this case it could change every frame)
-                glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
-                                                        (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT,
-                                                        0.1f, 100.0f);
-                geometryPassShader.SetMatrix4("projection", projection);
-
-                // camera/view transformation
-                glm::mat4 view = camera.GetViewMatrix();
-                geometryPassShader.SetMatrix4("view", view);
-
-                for (unsigned int i = 0; i < objectPositions.size(); i++)
+            // render
+            // ------
+            // pass projection matrix to shader (note that in this case it could change every frame)
+            projection = glm::perspective(glm::radians(camera.Zoom),
+                                          (float)framebufferWidth / (float)framebufferHeight,
+                                          0.1f, 100.0f);
+            // camera/view transformation
+            view = camera.GetViewMatrix();
+            if (multiViewFlag)
+                multiView.Configure(multiViewLayout, camera, framebufferWidth, framebufferHeight, 0.1f, 100.0f);
+            // sampled once so that every pass of the frame produces identical transforms
+            rotationAngle = (float)glfwGetTime() * -1.0f;
+            for (unsigned int i = 0; i < streamedInstances.size(); i++)
+                objectTransforms[i] = instanceTransform(*streamedInstances[i].Instance, rotationAngle);
+            placeholderTransforms.clear();
+            placeholderColors.clear();
+            for (unsigned int i = 0; i < streamer.Placeholders().size(); i++)
+            {
+                const StreamedPlaceholder &placeholder = streamer.Placeholders()[i];
+                glm::mat4 model = instanceTransform(*placeholder.Instance, rotationAngle);
+                model = glm::translate(model, (placeholder.BoundsMin + placeholder.BoundsMax) * 0.5f);
+                model = glm::scale(model, (placeholder.BoundsMax - placeholder.BoundsMin) * 0.5f);
+                placeholderTransforms.push_back(model);
+                placeholderColors.push_back(glm::mix(glm::vec3(0.2f), glm::vec3(0.2f, 0.6f, 0.3f), placeholder.Progress));
+            }
+
+            // texture residency: report the on-screen size of every instance's textures, then fit the budget
+            // -------------------------------------------------------------------------------------------------
+            std::fill(modelScreenSizes.begin(), modelScreenSizes.end(), 0.0f);
+            float pixelsPerUnit = (float)framebufferHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+            for (unsigned int i = 0; i < objectTransforms.size(); i++)
+            {
+                const Model &model = *objectModels[i];
+                glm::vec3 center = glm::vec3(objectTransforms[i] * glm::vec4((model.BoundsMin + model.BoundsMax) * 0.5f, 1.0f));
+                float diameter = glm::length(model.BoundsMax - model.BoundsMin) * glm::length(glm::vec3(objectTransforms[i][0]));
+                float distance = std::max(glm::distance(camera.Position, center) - diameter * 0.5f, 0.1f);
+                modelScreenSizes[objectModelIndices[i]] = std::max(modelScreenSizes[objectModelIndices[i]], diameter / distance * pixelsPerUnit);
+            }
+            for (unsigned int m = 0; m < modelScreenSizes.size(); m++)
+                if (modelScreenSizes[m] > 0.0f)
+                    if (Model *resident = streamer.Resident(m))
+                        for (unsigned int t = 0; t < resident->textures_loaded.size(); t++)
+                            TextureResidency().Touch(resident->textures_loaded[t].id, modelScreenSizes[m]);
+            TextureResidency().Update();
+
+            // change tracking: hash what each part of the frame depends on, reuse what didn't change
+            // ---------------------------------------------------------------------------------------
+            changes.Begin();
+            changes.Add(CHANGE_GEOMETRY, projection);
+            changes.Add(CHANGE_GEOMETRY, view);
+            changes.Add(CHANGE_GEOMETRY, resolution.RenderWidth);
+            changes.Add(CHANGE_GEOMETRY, resolution.RenderHeight);
+            changes.Add(CHANGE_GEOMETRY, objectTransforms);
+            changes.Add(CHANGE_GEOMETRY, objectModels);
+            changes.Add(CHANGE_GEOMETRY, occlusionCullingFlag);
+            changes.Add(CHANGE_GEOMETRY, meshletCullingFlag);
+            changes.Add(CHANGE_GEOMETRY, multiViewFlag);
+            changes.Add(CHANGE_GEOMETRY, multiViewLayout);
+            if (TextureResidency().Evictions > 0 || TextureResidency().Restreams > 0)
+                changes.Touch(CHANGE_GEOMETRY);
+            changes.Add(CHANGE_LIGHTING, lightPositions);
+            changes.Add(CHANGE_LIGHTING, lightColors);
+            changes.Add(CHANGE_LIGHTING, bakedLightCount);
+            changes.Add(CHANGE_LIGHTING, bakedLighting);
+            changes.Add(CHANGE_LIGHTING, dirLightFlag);
+            changes.Add(CHANGE_OVERLAY, placeholderTransforms);
+            changes.Add(CHANGE_OVERLAY, placeholderColors);
+            changes.Add(CHANGE_OVERLAY, edgeAwareUpscaleFlag);
+            if (!incrementalFlag || windowDamaged)
+                changes.Invalidate();
+            windowDamaged = false;
+            changes.End();
+            // the forward path has a single shading pass, any change renders it again
+            bool frameChanged = changes.AnyChanged();
+            geometryRendered = changes.Changed(CHANGE_GEOMETRY) || (frameChanged && !frameGraphDeferred);
+
+            // occlusion culling: rasterize the instances that cover most of the screen, test everything against them
+            // while the geometry is reused, so are the culling results
+            // ---------------------------------------------------------------------------------------------------------
+            if (geometryRendered)
+                visibleObjects.clear();
+            if (geometryRendered && frameGraphGpuDriven)
+            {
+                // frustum and Hi-Z culling run on the GPU, nothing to do per instance here
+                indirectRenderer.SetInstances(objectTransforms, indirectInstanceModels);
+                indirectRenderer.Cull(projection * view);
+            }
+            else if (geometryRendered && multiViewFlag)
+            {
+                // one pass over the instances for all the views; the occluders are rasterized from a single view
+                multiView.Cull(objectModels, objectTransforms, visibleObjects);
+            }
+            else if (geometryRendered && occlusionCullingFlag)
+            {
+                occlusionCuller.BeginFrame(projection * view);
+                occluderCandidates.clear();
+                for (unsigned int i = 0; i < objectTransforms.size(); i++)
                 {
-                    glm::mat4 model = glm::mat4(1.0);
-                    model = glm::translate(model, objectPositions[i]);
-                    model = glm::scale(model, glm::vec3(0.05f));
-                    if (rotateModelFlag)
-                        model = glm::rotate(model, (float)glfwGetTime() * -1.0f, glm::normalize(glm::vec3(-0.5, -0.6, 0.8)));
-                    geometryPassShader.SetMatrix4("model", model);
-                    shipModel.Draw(geometryPassShader);
+                    const Model &model = *objectModels[i];
+                    glm::vec3 localCenter = (model.BoundsMin + model.BoundsMax) * 0.5f;
+                    float localRadius = glm::length(model.BoundsMax - model.BoundsMin) * 0.5f;
+                    glm::vec3 center = glm::vec3(objectTransforms[i] * glm::vec4(localCenter, 1.0f));
+                    float radius = localRadius * glm::length(glm::vec3(objectTransforms[i][0]));
+                    float distance = std::max(glm::distance(camera.Position, center), 0.1f);
+                    occluderCandidates.push_back(std::make_pair(-radius / distance, i)); // largest projected size first
                 }
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-            // 2. lighting pass: calculate lighting by iterating over a screen filled quad pixel-by-pixel using the gbuffer's content.
-            // -----------------------------------------------------------------------------------------------------------------------
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            lightingPassShader.Use();
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, gPosition);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, gNormal);
-            glActiveTexture(GL_TEXTURE2);
-            glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-            // send light relevant uniforms
-            for (unsigned int i = 0; i < lightPositions.size(); i++)
+                std::sort(occluderCandidates.begin(), occluderCandidates.end());
+                for (unsigned int i = 0; i < occluderCandidates.size() && i < OCCLUDER_MAX_INSTANCES; i++)
+                    occlusionCuller.AddOccluder(occluders[objectModelIndices[occluderCandidates[i].second]],
+                                                objectTransforms[occluderCandidates[i].second]);
+                occlusionCuller.RasterizeOccluders();
+                for (unsigned int i = 0; i < objectTransforms.size(); i++)
+                    if (occlusionCuller.IsVisible(objectModels[i]->BoundsMin, objectModels[i]->BoundsMax, objectTransforms[i]))
+                        visibleObjects.push_back(i);
+            }
+            else if (geometryRendered)
             {
-                lightingPassShader.SetVector3f("pointLights[" + std::to_string(i) + "].Position", lightPositions[i]);
-                lightingPassShader.SetVector3f("pointLights[" + std::to_string(i) + "].Color", lightColors[i]);
-                // update attenuation parameters and calculate radius
-                const float constant = 1.0; // note that we don't send this to the shader, we assume it is always 1.0 (in our case)
-                const float linear = 0.35;
-                const float quadratic = 0.44;
-                lightingPassShader.SetFloat("pointLights[" + std::to_string(i) + "].Linear", linear);
-                lightingPassShader.SetFloat("pointLights[" + std::to_string(i) + "].Quadratic", quadratic);
+                for (unsigned int i = 0; i < objectTransforms.size(); i++)
+                    visibleObjects.push_back(i);
             }
-            lightingPassShader.SetVector3f("viewPos", camera.Position);
-            // render the quad
-            renderQuad();
-
-            // 2.5. copy content of geometry's depth buffer to default framebuffer's depth buffer
-            // ----------------------------------------------------------------------------------
-            glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0); // write to default framebuffer
-            // blit to default framebuffer
-            glBlitFramebuffer(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-                              0, 0, WINDOW_WIDTH, WINDOW_HEIGHT,
-                              GL_DEPTH_BUFFER_BIT,
-                              GL_NEAREST);
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-            // 3. render lights on top of scene
-            // --------------------------------
-            lightBoxShader.Use();
-            lightBoxShader.SetMatrix4("projection", projection);
-            lightBoxShader.SetMatrix4("view", view);
-            for (unsigned int i = 0; i < lightPositions.size(); i++)
+
+            if (frameChanged)
             {
-                glm::mat4 model = glm::mat4(1.0);
-                model = glm::translate(model, lightPositions[i]);
-                model = glm::scale(model, glm::vec3(0.05f));
-                lightBoxShader.SetMatrix4("model", model);
-                lightBoxShader.SetVector3f("lightColor", lightColors[i]);
-                renderCube();
+                if (geometryPassIndex >= 0)
+                    frameGraph.SkipPass(geometryPassIndex, !geometryRendered);
+                if (hiZPassIndex >= 0)
+                    frameGraph.SkipPass(hiZPassIndex, !geometryRendered);
+                frameGraph.Execute();
+                passesExecuted += frameGraph.ExecutedPassCount;
+                passesReused += frameGraph.SkippedPassCount;
+                if (geometryRendered)
+                    fullFrames++;
+                else
+                    lightingFrames++;
             }
-            // ------------------- DEFERRED SHADING END --------------- //
-        }
+            else
+            {
+                passesReused += frameGraph.PassCount - frameGraph.CulledPassCount;
+                idleFrames++;
+            }
+
+            // frames that stream, rebuild or compile something allocate; the others only render and mustn't
+            steadyFrame = steadyFrame && !streamer.Changed() && streamer.LoadsInFlight == 0 &&
+                          TextureResidency().Evictions == 0 && TextureResidency().Restreams == 0;
+            if (steadyFrame)
+            {
+                frameAllocations.Expect(0, "steady-state frame");
+                steadyFrames++;
+                steadyFrameAllocations += frameAllocations.Count();
+            }
+
+            RenderStats().EndFrame(deltaTime * 1000.0f);
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+            if (currentFrame - lastStatsReport >= 1.0f)
+            {
+                if (!frameGraphDeferred && fragmentInvocationsQuery.Supported)
+                    std::cout << "forward shading: " << fragmentInvocationsQuery.Result() << " fragment shader invocations"
+                              << (depthPrepassFlag ? " (depth pre-pass)" : "") << std::endl;
+                if (frameGraphDeferred)
+                    std::cout << "deferred shading: " << resolution.RenderWidth << "x" << resolution.RenderHeight
+                              << " (scale " << resolution.Scale << ", " << resolution.GpuTime() << " ms GPU)" << std::endl;
+                std::cout << "shader variants: " << baseShaderVariants.Compiled + lightingPassShaderVariants.Compiled
+                          << " compiled, lighting [" << lightingDefines.Key() << "]" << std::endl;
+                if (frameGraphGpuDriven)
+                    std::cout << "gpu-driven culling: " << indirectRenderer.VisibleCount << "/" << indirectRenderer.InstanceCount
+                              << " instances visible, " << indirectRenderer.BatchCount << " multi-draw calls for "
+                              << indirectRenderer.MeshCount << " meshes" << std::endl;
+                else if (multiViewFlag)
+                    std::cout << "multi-view (" << MultiView::LayoutName(multiViewLayout) << "): " << multiView.Culled << "/"
+                              << multiView.Tested << " instances culled for " << multiView.ViewCount << " views, "
+                              << multiView.DrawCalls << " model draws" << (multiView.ViewportIndex ? " (instanced)" : " (per view)")
+                              << std::endl;
+                else if (occlusionCullingFlag)
+                    std::cout << "occlusion culling: " << occlusionCuller.CulledCount << "/" << occlusionCuller.TestedCount
+                              << " instances culled, " << occlusionCuller.RasterTime << " ms raster, "
+                              << occlusionCuller.TestTime << " ms test" << std::endl;
+                if (!frameGraphGpuDriven && !multiViewFlag && meshletCullingFlag && meshletCuller.MeshletCount > 0)
+                    std::cout << "meshlet culling: " << meshletCuller.FrustumCulled + meshletCuller.BackfaceCulled << "/"
+                              << meshletCuller.MeshletCount << " meshlets culled (" << meshletCuller.FrustumCulled << " frustum, "
+                              << meshletCuller.BackfaceCulled << " backface), " << meshletCuller.DrawnTriangles << "/"
+                              << meshletCuller.TriangleCount << " triangles drawn ("
+                              << 100.0 * meshletCuller.DrawnTriangles / meshletCuller.TriangleCount << "%) in "
+                              << meshletCuller.Ranges << " ranges" << std::endl;
+                std::cout << "streaming: " << streamer.ResidentCells << "/" << streamer.WantedCells << " cells resident ("
+                          << scene.Cells.size() << " total), " << streamer.ResidentModels << " models, " << streamer.LoadsInFlight
+                          << " loading, CPU " << streamer.CpuBytes / (1024.0 * 1024.0) << "/" << streamer.CpuBudget / (1024 * 1024)
+                          << " MB, GPU " << streamer.GpuBytes / (1024.0 * 1024.0) << "/" << streamer.GpuBudget / (1024 * 1024) << " MB"
+                          << (streamer.BudgetLimited ? " (over budget, radius cut short)" : "") << ", " << streamer.Uploads
+                          << " uploads (" << streamer.Loader().UploadTime << " ms this frame), " << streamer.Releases << " releases, "
+                          << streamer.Placeholders().size() << " placeholders" << std::endl;
+                std::cout << "assets: " << Assets().TextureCount << " shared textures, " << Assets().TextureReferences << " references, "
+                          << Assets().DecodesSkipped << " decodes skipped, " << Assets().ContentHits << " content matches, "
+                          << streamer.Loader().SharedLoads << " shared model loads" << std::endl;
+                std::cout << "textures: " << TextureResidency().TextureCount << " tracked, " << TextureResidency().ResidentBytes / (1024.0 * 1024.0)
+                          << "/" << TextureResidency().Budget / (1024 * 1024) << " MB resident, " << TextureResidency().Evictions << " evictions, "
+                          << TextureResidency().Restreams << " restreams this frame (" << TextureResidency().TotalEvictions << " evictions, "
+                          << TextureResidency().TotalRestreams << " restreams total)" << std::endl;
+                std::cout << "gl state: " << GLState().LastIssued << " calls issued, " << GLState().LastSkipped << " redundant calls skipped" << std::endl;
+                const RenderStatistics &stats = RenderStats();
+                std::cout << "render: per frame over the last " << std::min<uint64_t>(stats.FrameCount, RENDER_STATS_WINDOW)
+                          << " frames " << stats.Mean(STAT_DRAW_CALLS) << " draws (max " << stats.Max(STAT_DRAW_CALLS) << "), "
+                          << stats.Mean(STAT_TRIANGLES) << " triangles, " << stats.Mean(STAT_DISPATCHES) << " dispatches, "
+                          << stats.Mean(STAT_TEXTURE_BINDS) << " texture binds, " << stats.Mean(STAT_PROGRAM_SWITCHES)
+                          << " program switches, " << stats.Mean(STAT_UNIFORM_UPLOADS) << " uniforms, "
+                          << (stats.Mean(STAT_BUFFER_BYTES) + stats.Mean(STAT_TEXTURE_BYTES)) / 1024.0 << " KB uploaded; "
+                          << stats.MeanFrameTime() << " ms mean, " << stats.MaxFrameTime() << " ms max" << std::endl;
+                std::cout << "gpu memory: " << stats.TotalMemory() / (1024.0 * 1024.0) << " MB (";
+                for (unsigned int m = 0; m < GPU_MEMORY_CATEGORY_COUNT; m++)
+                    std::cout << (m > 0 ? ", " : "") << RenderStatistics::MemoryName((GpuMemoryCategory)m) << " "
+                              << stats.Memory[m] / (1024.0 * 1024.0);
+                std::cout << " MB)" << std::endl;
+                RenderStats().WriteMetrics(currentFrame);
+                std::cout << "render targets: peak " << frameGraph.PeakBytes / (1024.0 * 1024.0) << " MB, allocated "
+                          << frameGraph.AllocatedBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+                std::cout << "incremental rendering" << (incrementalFlag ? "" : " (off)") << ": " << fullFrames << " frames rendered, "
+                          << lightingFrames << " lit from the previous G-buffer, " << idleFrames << " unchanged; " << passesExecuted
+                          << " passes rendered, " << passesReused << " reused" << std::endl;
+                std::cout << "latency" << (latencyControlFlag ? "" : " (uncapped)") << ": input to submit " << framePacer.InputToSubmit
+                          << " ms, submit to GPU complete " << framePacer.SubmitToComplete << " ms, " << framePacer.FramesInFlight
+                          << " frames in flight (limit " << framePacer.MaxFramesInFlight << "), " << framePacer.FenceWait
+                          << " ms waiting on fences, " << framePacer.Sleep << " ms sleeping per frame" << std::endl;
+                framePacer.ResetStats();
+                std::cout << "frame memory: " << steadyFrameAllocations << " heap allocations in " << steadyFrames
+                          << " steady frames, arena " << FrameMemory().Peak / 1024.0 << "/" << FrameMemory().Capacity() / 1024
+                          << " KB peak" << std::endl;
+                fullFrames = lightingFrames = idleFrames = 0;
+                steadyFrames = 0;
+                steadyFrameAllocations = 0;
+                passesExecuted = passesReused = 0;
+                lastStatsReport = currentFrame;
+            }
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // an unchanged frame isn't swapped, the previous one stays on screen until an event (or a load) changes something
+            // -------------------------------------------------------------------------------------------------------------------
+            if (frameChanged)
+            {
+                framePacer.Submitting();
+                glfwSwapBuffers(window);
+                framePacer.Submitted();
+                if (!latencyControlFlag)
+                    glfwPollEvents();
+            }
+            else
+                glfwWaitEventsTimeout(streamer.LoadsInFlight > 0 ? IDLE_LOADING_WAIT : IDLE_WAIT);
+        }
     }
 
+    framePacer.Release();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -408,23 +1128,87 @@ void renderCube()
         glGenVertexArrays(1, &cubeVAO);
         glGenBuffers(1, &cubeVBO);
         // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        GLState().BindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+        RenderStats().BufferAllocated(cubeVBO, GPU_MEMORY_OTHER, sizeof(vertices));
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState().BindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    GLState().BindVertexArray(cubeVAO);
+    RenderStats().Draw(12);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+}
+
+// renderLightBoxes() renders a small cube at each light position, in the light's color
+// -------------------------------------------------------------------------------------
+void renderLightBoxes(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view,
+                      const std::vector<glm::vec3> &lightPositions, const std::vector<glm::vec3> &lightColors)
+{
+    shader.Use();
+    shader.SetMatrix4("projection", projection);
+    shader.SetMatrix4("view", view);
+    for (unsigned int i = 0; i < lightPositions.size(); i++)
+    {
+        glm::mat4 model = glm::mat4(1.0);
+        model = glm::translate(model, lightPositions[i]);
+        model = glm::scale(model, glm::vec3(0.05f));
+        shader.SetMatrix4("model", model);
+        shader.SetVector3f("lightColor", lightColors[i]);
+        renderCube();
+    }
+}
+
+// renderPlaceholders() renders a box per transform (scaling the 2x2x2 cube), e.g. for models still loading
+// ------------------------------------------------------------------------------------------------------------
+void renderPlaceholders(Shader &shader, const glm::mat4 &projection, const glm::mat4 &view,
+                        const std::vector<glm::mat4> &transforms, const std::vector<glm::vec3> &colors)
+{
+    if (transforms.empty())
+        return;
+    shader.Use();
+    shader.SetMatrix4("projection", projection);
+    shader.SetMatrix4("view", view);
+    for (unsigned int i = 0; i < transforms.size(); i++)
+    {
+        shader.SetMatrix4("model", transforms[i]);
+        shader.SetVector3f("lightColor", colors[i]);
+        renderCube();
+    }
+}
+
+// instanceTransform() places a scene instance, rotating it if the rotation is on
+// --------------------------------------------------------------------------------
+glm::mat4 instanceTransform(const SceneInstance &instance, float rotationAngle)
+{
+    glm::mat4 model = glm::mat4(1.0);
+    model = glm::translate(model, instance.Position);
+    model = glm::scale(model, glm::vec3(instance.Scale));
+    if (rotateModelFlag && instance.Rotate)
+        model = glm::rotate(model, rotationAngle, glm::normalize(glm::vec3(-0.5, -0.6, 0.8)));
+    return model;
+}
+
+// drawObject() draws an instance of a model, leaving out the meshlets outside the frustum or facing away from the
+// camera if meshlet culling is on
+// ----------------------------------------------------------------------------------------------------------------
+void drawObject(Model &model, Shader &shader, const glm::mat4 &transform, const glm::mat4 &viewProjection, MeshletCuller &culler)
+{
+    shader.SetMatrix4("model", transform);
+    if (!meshletCullingFlag)
+    {
+        model.Draw(shader);
+        return;
+    }
+    // the meshlet bounds are in model space, so is the test
+    culler.SetInstance(viewProjection * transform, glm::vec3(glm::inverse(transform) * glm::vec4(camera.Position, 1.0f)));
+    model.Draw(shader, culler);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
@@ -445,17 +1229,18 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        GLState().BindVertexArray(quadVAO);
+        GLState().BindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+        RenderStats().BufferAllocated(quadVBO, GPU_MEMORY_OTHER, sizeof(quadVertices));
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState().BindVertexArray(quadVAO);
+    RenderStats().Draw(2);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -501,6 +1286,86 @@ void processInput(GLFWwindow *window)
     }
     if (glfwGetKey(window, GLFW_KEY_3) == GLFW_RELEASE)
         rotateModelFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && !depthPrepassFlagPressed)
+    {
+        depthPrepassFlag = !depthPrepassFlag;
+        depthPrepassFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_RELEASE)
+        depthPrepassFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS && !dynamicResolutionFlagPressed)
+    {
+        dynamicResolutionFlag = !dynamicResolutionFlag;
+        dynamicResolutionFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_RELEASE)
+        dynamicResolutionFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS && !edgeAwareUpscaleFlagPressed)
+    {
+        edgeAwareUpscaleFlag = !edgeAwareUpscaleFlag;
+        edgeAwareUpscaleFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_6) == GLFW_RELEASE)
+        edgeAwareUpscaleFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS && !occlusionCullingFlagPressed)
+    {
+        occlusionCullingFlag = !occlusionCullingFlag;
+        occlusionCullingFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_RELEASE)
+        occlusionCullingFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS && !gpuDrivenFlagPressed)
+    {
+        gpuDrivenFlag = !gpuDrivenFlag;
+        gpuDrivenFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_RELEASE)
+        gpuDrivenFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS && !incrementalFlagPressed)
+    {
+        incrementalFlag = !incrementalFlag;
+        incrementalFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_RELEASE)
+        incrementalFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS && !bakedLightingFlagPressed)
+    {
+        bakedLightingFlag = !bakedLightingFlag;
+        bakedLightingFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_0) == GLFW_RELEASE)
+        bakedLightingFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !meshletCullingFlagPressed)
+    {
+        meshletCullingFlag = !meshletCullingFlag;
+        meshletCullingFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+        meshletCullingFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !latencyControlFlagPressed)
+    {
+        latencyControlFlag = !latencyControlFlag;
+        latencyControlFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_RELEASE)
+        latencyControlFlagPressed = false;
+
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !multiViewFlagPressed)
+    {
+        multiViewFlag = !multiViewFlag;
+        multiViewFlagPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE)
+        multiViewFlagPressed = false;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -534,7 +1399,20 @@ void scroll_callback(GLFWwindow * /* window */, double /* xoffset */, double yof
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow * /* window */, int width, int height)
 {
+    // a minimized window has a 0x0 framebuffer: keep the last size, the projection and the render targets need one
+    if (width <= 0 || height <= 0)
+        return;
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
\ No newline at end of file
+    GLState().Viewport(0, 0, width, height);
+    // render targets are reallocated at the start of the next frame
+    framebufferWidth = width;
+    framebufferHeight = height;
+}
+
+// glfw: whenever the window content was damaged (exposed, restored) and has to be drawn again
+// -------------------------------------------------------------------------------------------
+void window_refresh_callback(GLFWwindow * /* window */)
+{
+    windowDamaged = true;
+}
@@ -0,0 +1,131 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "gl_state.hpp"
+
+// The textures a material can have, in texture unit order
+enum MaterialSlot
+{
+    MATERIAL_DIFFUSE,
+    MATERIAL_SPECULAR,
+    MATERIAL_NORMAL,
+    MATERIAL_EMISSION,
+    MATERIAL_SLOT_COUNT
+};
+
+// Material texture units: slot s is always bound to unit MATERIAL_TEXTURE_UNIT + s, in every shader
+const unsigned int MATERIAL_TEXTURE_UNIT = 0;
+// the sampler each slot is read through, and the texture type the model importer gives it
+const char *const MATERIAL_SAMPLERS[MATERIAL_SLOT_COUNT] = { "texture_diffuse1", "texture_specular1", "texture_normal1",
+                                                             "texture_emission1" };
+const char *const MATERIAL_TEXTURE_TYPES[MATERIAL_SLOT_COUNT] = { "texture_diffuse", "texture_specular", "texture_normal",
+                                                                  "texture_emission" };
+
+// Gives every distinct set of material textures a small ID, in order of first use, so that draws can be sorted and
+// batched by material. Render thread only. A GL name reused after its texture was deleted maps to the IDs of the
+// old texture's materials, which is harmless: binding them binds the same names.
+class MaterialRegistry
+{
+    public:
+        MaterialRegistry()
+        {
+            GLuint none[MATERIAL_SLOT_COUNT] = {};
+            Find(none);
+        }
+
+        // the ID of a texture set, 0 for the set without any texture
+        unsigned int Find(const GLuint textures[MATERIAL_SLOT_COUNT])
+        {
+            std::vector<GLuint> key(textures, textures + MATERIAL_SLOT_COUNT);
+            std::map<std::vector<GLuint>, unsigned int>::iterator found = ids.find(key);
+            if (found != ids.end())
+                return found->second;
+            unsigned int id = (unsigned int)ids.size();
+            ids[key] = id;
+            return id;
+        }
+
+        unsigned int Count() const
+        {
+            return (unsigned int)ids.size();
+        }
+
+    private:
+        std::map<std::vector<GLuint>, unsigned int> ids;
+};
+
+inline MaterialRegistry &Materials()
+{
+    static MaterialRegistry registry;
+    return registry;
+}
+
+// The textures of a mesh by slot, resolved once when the mesh is created. The shaders' material samplers point at
+// fixed units from the time they are linked (BindSamplers()), so binding a material is a texture bind per slot,
+// skipped by the state cache when the unit already holds it.
+struct Material
+{
+    unsigned int ID;                      // see MaterialRegistry
+    GLuint Textures[MATERIAL_SLOT_COUNT]; // 0 where the material has no texture of that kind
+
+    Material()
+        : ID(0)
+    {
+        for (unsigned int s = 0; s < MATERIAL_SLOT_COUNT; s++)
+            Textures[s] = 0;
+    }
+
+    // the first texture of every known type fills its slot, the shaders only sample one of each
+    template <typename TextureList>
+    static Material FromTextures(const TextureList &textures)
+    {
+        Material material;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            MaterialSlot slot = SlotOf(textures[i].type);
+            if (slot != MATERIAL_SLOT_COUNT && material.Textures[slot] == 0)
+                material.Textures[slot] = textures[i].id;
+        }
+        material.ID = Materials().Find(material.Textures);
+        return material;
+    }
+
+    // the slot of an importer texture type such as "texture_diffuse", MATERIAL_SLOT_COUNT for none
+    static MaterialSlot SlotOf(const std::string &type)
+    {
+        for (unsigned int s = 0; s < MATERIAL_SLOT_COUNT; s++)
+            if (type == MATERIAL_TEXTURE_TYPES[s])
+                return (MaterialSlot)s;
+        return MATERIAL_SLOT_COUNT;
+    }
+
+    // an empty slot unbinds its unit, so it samples black rather than the texture of the previous material
+    void Bind() const
+    {
+        for (unsigned int s = 0; s < MATERIAL_SLOT_COUNT; s++)
+            GLState().BindTexture(MATERIAL_TEXTURE_UNIT + s, GL_TEXTURE_2D, Textures[s]);
+    }
+
+    // points the material samplers a program has at their units; call once after linking it
+    static void BindSamplers(GLuint program)
+    {
+        GLState().UseProgram(program);
+        for (unsigned int s = 0; s < MATERIAL_SLOT_COUNT; s++)
+        {
+            GLint location = glGetUniformLocation(program, MATERIAL_SAMPLERS[s]);
+            if (location >= 0)
+            {
+                RenderStats().Count(STAT_UNIFORM_UPLOADS);
+                glUniform1i(location, MATERIAL_TEXTURE_UNIT + s);
+            }
+        }
+    }
+};
+
+#endif
@@ -6,6 +6,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "gl_state.hpp"
+#include "material.hpp"
+#include "meshlet.hpp"
 #include "shader.hpp"
 
 #include <string>
@@ -37,65 +40,85 @@ struct Texture {
 class Mesh {
     public:
         /*  Mesh Data  */
-        vector<Vertex> vertices;
+        vector<Vertex> vertices; // CPU copy of the geometry, empty after ReleaseGeometry()
         vector<unsigned int> indices;
         vector<Texture> textures;
+        Material material; // the textures by slot, what Draw() binds
         unsigned int VAO;
+        // GL buffers holding the geometry, e.g. for copying it into merged buffers
+        unsigned int VBO, EBO;
+        unsigned int VertexCount;
+        unsigned int IndexCount;
+        MeshletData Meshlets; // culling data of the index buffer's meshlets, kept by ReleaseGeometry()
 
         /*  Functions  */
-        // constructor
-        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+        // constructor, takes ownership of the geometry: pass the vectors with std::move to avoid copying them
+        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, MeshletData meshlets = MeshletData())
+            : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)),
+              material(Material::FromTextures(this->textures)), VertexCount((unsigned int)this->vertices.size()), IndexCount((unsigned int)this->indices.size()),
+              Meshlets(std::move(meshlets))
         {
-            this->vertices = vertices;
-            this->indices  = indices;
-            this->textures = textures;
-
             // now that we have all the required data, set the vertex buffers and its attribute pointers.
             setupMesh();
         }
 
-        // render the mesh
-        void Draw(Shader shader)
+        // render the mesh; the shader's material samplers were pointed at their units when it was linked
+        void Draw(Shader & /* shader */)
+        {
+            material.Bind();
+
+            // draw mesh; the VAO stays bound, the state cache knows about it
+            GLState().BindVertexArray(VAO);
+            RenderStats().Draw(IndexCount / 3);
+            glDrawElements(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0);
+        }
+
+        // render the mesh count times in one draw, the vertex shader tells the instances apart by gl_InstanceID
+        void DrawInstanced(Shader & /* shader */, unsigned int count)
         {
-            // bind appropriate textures
-            unsigned int diffuseNr  = 1;
-            unsigned int specularNr = 1;
-            unsigned int normalNr   = 1;
-            unsigned int emissionNr = 1;
-            for(unsigned int i = 0; i < textures.size(); i++)
+            material.Bind();
+            GLState().BindVertexArray(VAO);
+            RenderStats().Draw((uint64_t)IndexCount / 3 * count);
+            glDrawElementsInstanced(GL_TRIANGLES, IndexCount, GL_UNSIGNED_INT, 0, count);
+        }
+
+        // render the meshlets that pass the culler's tests, in as few index ranges as they merge into
+        void Draw(Shader &shader, MeshletCuller &culler)
+        {
+            if (Meshlets.Count == 0)
             {
-                glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-                // retrieve texture number (the N in diffuse_textureN)
-                string number;
-                string name = textures[i].type;
-                if(name == "texture_diffuse")
-                    number = std::to_string(diffuseNr++); // transfer unsigned int to stream
-                else if(name == "texture_specular")
-                    number = std::to_string(specularNr++);
-                else if (name == "texture_normal")
-                    number = std::to_string(normalNr++);
-                else if (name == "texture_emission")
-                    number = std::to_string(emissionNr++);
-
-                // now set the sampler to the correct texture unit
-                glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-                // and finally bind the texture
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                Draw(shader);
+                return;
             }
+            unsigned int ranges = culler.Cull(Meshlets);
+            if (ranges == 0)
+                return;
+            material.Bind();
+            GLState().BindVertexArray(VAO);
+            uint64_t rangeIndices = 0;
+            for (unsigned int r = 0; r < ranges; r++)
+                rangeIndices += culler.RangeCounts[r];
+            RenderStats().Draw(rangeIndices / 3);
+            glMultiDrawElements(GL_TRIANGLES, &culler.RangeCounts[0], GL_UNSIGNED_INT, &culler.RangeOffsets[0], ranges);
+        }
 
-            // draw mesh
-            glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
+        // deletes the GL objects, the mesh can't be drawn afterwards
+        void Release()
+        {
+            GLState().DeleteVertexArray(VAO);
+            GLState().DeleteBuffer(VBO);
+            GLState().DeleteBuffer(EBO);
+            VAO = VBO = EBO = 0;
+        }
 
-            // always good practice to set everything back to defaults once configured.
-            glActiveTexture(GL_TEXTURE0);
+        // frees the CPU copy of the geometry once it is resident, the mesh can still be drawn
+        void ReleaseGeometry()
+        {
+            vector<Vertex>().swap(vertices);
+            vector<unsigned int>().swap(indices);
         }
 
     private:
-        /*  Render data  */
-        unsigned int VBO, EBO;
-
         /*  Functions    */
         // initializes all the buffer objects/arrays
         void setupMesh()
@@ -105,16 +128,20 @@ class Mesh {
             glGenBuffers(1, &VBO);
             glGenBuffers(1, &EBO);
 
-            glBindVertexArray(VAO);
+            GLState().BindVertexArray(VAO);
             // load data into vertex buffers
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            GLState().BindBuffer(GL_ARRAY_BUFFER, VBO);
             // A great thing about structs is that their memory layout is sequential for all its items.
             // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
             // again translates to 3/2 floats which translates to a byte array.
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+            RenderStats().BufferAllocated(VBO, GPU_MEMORY_MESHES, vertices.size() * sizeof(Vertex));
+            RenderStats().Count(STAT_BUFFER_BYTES, vertices.size() * sizeof(Vertex));
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            GLState().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
             glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+            RenderStats().BufferAllocated(EBO, GPU_MEMORY_MESHES, indices.size() * sizeof(unsigned int));
+            RenderStats().Count(STAT_BUFFER_BYTES, indices.size() * sizeof(unsigned int));
 
             // set the vertex attribute pointers
             // vertex Positions
@@ -133,7 +160,7 @@ class Mesh {
             glEnableVertexAttribArray(4);
             glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-            glBindVertexArray(0);
+            GLState().BindVertexArray(0);
         }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,377 @@
+#ifndef MESH_PROCESSING_H
+#define MESH_PROCESSING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh.hpp"
+#include "worker_pool.hpp"
+
+// Default mesh processing values
+const size_t MESH_PROCESSING_PARALLEL_TRIANGLES = 16384; // models with fewer triangles are processed on the calling thread
+const size_t MESH_PROCESSING_SPLIT_TRIANGLES = 65536;    // meshes with more are split across the threads themselves
+const size_t MESH_PROCESSING_BLOCK = 4096;               // triangles or vertices a thread takes at a time
+const float MESH_PROCESSING_EPSILON = 1e-20f;            // squared lengths below this are degenerate
+
+// How the importer post-processes meshes; set before loading, read by the streaming workers
+struct MeshProcessingSettings
+{
+    std::atomic<bool> Native;   // welding, normals and tangents by MeshProcessor; false leaves them to assimp
+    unsigned int ThreadCount;
+
+    MeshProcessingSettings()
+        : Native(true)
+    {
+        ThreadCount = WorkerPool::HardwareThreads();
+    }
+};
+
+inline MeshProcessingSettings &MeshProcessing()
+{
+    static MeshProcessingSettings settings;
+    return settings;
+}
+
+// The post-processing of imported triangle meshes, replacing assimp's single-threaded JoinIdenticalVertices,
+// GenSmoothNormals and CalcTangentSpace steps:
+//  - welding: vertices with the same position, normal and texture coordinates become one, found by hashing them
+//  - normals, for meshes imported without any: the area weighted sum of the faces around every position
+//  - tangents following MikkTSpace: per corner, the face's tangent projected into the plane of the vertex normal
+//    and weighted by the corner angle; a vertex shared by faces with mirrored texture coordinates is split in two,
+//    one per orientation, and the bitangent is the cross product of normal and tangent with the orientation's sign.
+//    Corners are only grouped by vertex and orientation, not by the edge connectivity MikkTSpace also uses.
+// Meshes are spread over ThreadCount of the shared worker threads (WorkerPool), and meshes above
+// MESH_PROCESSING_SPLIT_TRIANGLES are split by faces and vertices across all of them. Sums are always taken in index
+// order, so the result doesn't depend on the thread count; basegl-loadbench --validate-postprocess checks it.
+class MeshProcessor
+{
+    public:
+        unsigned int ThreadCount;
+
+        MeshProcessor()
+            : ThreadCount(MeshProcessing().ThreadCount)
+        {
+        }
+
+        // queues a triangle mesh for Run(), which processes it in place; the vectors must stay where they are
+        // until then. Without normals, smooth ones are generated
+        void Add(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, bool hasNormals)
+        {
+            MeshJob job;
+            job.Vertices = &vertices;
+            job.Indices = &indices;
+            job.HasNormals = hasNormals;
+            jobs.push_back(job);
+        }
+
+        // processes the queued meshes and empties the queue
+        void Run()
+        {
+            size_t triangles = 0;
+            for (unsigned int i = 0; i < jobs.size(); i++)
+                triangles += jobs[i].Indices->size() / 3;
+            unsigned int threads = triangles < MESH_PROCESSING_PARALLEL_TRIANGLES ? 1 : ThreadCount;
+            // the large meshes one after the other, each using all the threads
+            std::vector<unsigned int> small;
+            for (unsigned int i = 0; i < jobs.size(); i++)
+            {
+                if (jobs[i].Indices->size() / 3 > MESH_PROCESSING_SPLIT_TRIANGLES)
+                    processMesh(jobs[i], threads);
+                else
+                    small.push_back(i);
+            }
+            // the others a mesh per thread at a time
+            std::atomic<unsigned int> nextMesh(0);
+            Workers().Run(std::min(threads, (unsigned int)small.size()), [&]()
+            {
+                for (unsigned int i = nextMesh.fetch_add(1); i < small.size(); i = nextMesh.fetch_add(1))
+                    processMesh(jobs[small[i]], 1);
+            });
+            jobs.clear();
+        }
+
+    private:
+        enum { NONE = 0xFFFFFFFFu }; // no vertex or group
+
+        struct MeshJob
+        {
+            std::vector<Vertex> *Vertices;
+            std::vector<unsigned int> *Indices;
+            bool HasNormals;
+        };
+        std::vector<MeshJob> jobs;
+
+        static void processMesh(const MeshJob &job, unsigned int threads)
+        {
+            weld(*job.Vertices, *job.Indices, threads);
+            if (!job.HasNormals)
+                generateNormals(*job.Vertices, *job.Indices, threads);
+            generateTangents(*job.Vertices, *job.Indices, threads);
+        }
+
+        // merges the vertices that are the same but for the tangents, which aren't computed yet
+        static void weld(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, unsigned int threads)
+        {
+            std::vector<unsigned int> ids;
+            unsigned int count = group(vertices.size(), threads, [&](size_t v)
+            {
+                uint32_t key[8];
+                weldKey(vertices[v], key);
+                return hash(key, 8);
+            }, [&](size_t a, size_t b)
+            {
+                uint32_t keyA[8], keyB[8];
+                weldKey(vertices[a], keyA);
+                weldKey(vertices[b], keyB);
+                return std::memcmp(keyA, keyB, sizeof(keyA)) == 0;
+            }, ids);
+            if (count == vertices.size())
+                return;
+            std::vector<Vertex> welded(count);
+            for (size_t v = 0; v < vertices.size(); v++)
+                welded[ids[v]] = vertices[v];
+            vertices.swap(welded);
+            parallelFor(indices.size(), threads, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    indices[i] = ids[indices[i]];
+            });
+        }
+
+        // smooth normals: every vertex at a position gets the sum of the (area weighted) normals of the faces there
+        static void generateNormals(std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int threads)
+        {
+            size_t triangles = indices.size() / 3;
+            std::vector<glm::vec3> faceNormals(triangles);
+            parallelFor(triangles, threads, [&](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; t++)
+                {
+                    const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+                    faceNormals[t] = glm::cross(vertices[indices[t * 3 + 1]].Position - p0, vertices[indices[t * 3 + 2]].Position - p0);
+                }
+            });
+            std::vector<unsigned int> positions;
+            unsigned int count = group(vertices.size(), threads, [&](size_t v)
+            {
+                uint32_t key[3];
+                positionKey(vertices[v].Position, key);
+                return hash(key, 3);
+            }, [&](size_t a, size_t b)
+            {
+                uint32_t keyA[3], keyB[3];
+                positionKey(vertices[a].Position, keyA);
+                positionKey(vertices[b].Position, keyB);
+                return std::memcmp(keyA, keyB, sizeof(keyA)) == 0;
+            }, positions);
+            std::vector<glm::vec3> sums(count, glm::vec3(0.0f));
+            for (size_t i = 0; i < indices.size(); i++)
+                sums[positions[indices[i]]] += faceNormals[i / 3];
+            parallelFor(vertices.size(), threads, [&](size_t begin, size_t end)
+            {
+                for (size_t v = begin; v < end; v++)
+                {
+                    const glm::vec3 &sum = sums[positions[v]];
+                    vertices[v].Normal = glm::dot(sum, sum) > MESH_PROCESSING_EPSILON ? glm::normalize(sum) : glm::vec3(0.0f, 0.0f, 1.0f);
+                }
+            });
+        }
+
+        static void generateTangents(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, unsigned int threads)
+        {
+            size_t triangles = indices.size() / 3;
+            // face tangents, along increasing u. The texture coordinates were flipped (aiProcess_FlipUVs) after
+            // assimp computed its tangent space, so the orientation is taken on the unflipped v to keep the
+            // bitangents pointing the same way
+            std::vector<glm::vec3> faceTangents(triangles);
+            std::vector<unsigned char> faceMirrored(triangles);
+            parallelFor(triangles, threads, [&](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; t++)
+                {
+                    const Vertex &v0 = vertices[indices[t * 3]];
+                    const Vertex &v1 = vertices[indices[t * 3 + 1]];
+                    const Vertex &v2 = vertices[indices[t * 3 + 2]];
+                    glm::vec3 e1 = v1.Position - v0.Position, e2 = v2.Position - v0.Position;
+                    glm::vec2 d1 = v1.TexCoords - v0.TexCoords, d2 = v2.TexCoords - v0.TexCoords;
+                    d1.y = -d1.y;
+                    d2.y = -d2.y;
+                    float area = d1.x * d2.y - d2.x * d1.y; // signed, twice the area in texture space
+                    glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * (area < 0.0f ? -1.0f : 1.0f);
+                    faceMirrored[t] = area < 0.0f;
+                    faceTangents[t] = area != 0.0f && glm::dot(tangent, tangent) > MESH_PROCESSING_EPSILON ? glm::normalize(tangent) : glm::vec3(0.0f);
+                }
+            });
+            // a vertex used by both orientations is split, the mirrored faces get the copy
+            std::vector<unsigned char> orientations(vertices.size(), 0);
+            for (size_t i = 0; i < indices.size(); i++)
+                orientations[indices[i]] |= faceMirrored[i / 3] ? 2 : 1;
+            std::vector<unsigned int> mirroredCopies(vertices.size(), NONE);
+            size_t original = vertices.size();
+            for (size_t v = 0; v < original; v++)
+            {
+                if (orientations[v] != 3)
+                    continue;
+                mirroredCopies[v] = (unsigned int)vertices.size();
+                vertices.push_back(vertices[v]);
+            }
+            std::vector<unsigned char> mirrored(vertices.size(), 0);
+            for (size_t v = 0; v < original; v++)
+                if (orientations[v] == 2)
+                    mirrored[v] = 1;
+            for (size_t v = original; v < vertices.size(); v++)
+                mirrored[v] = 1;
+            if (vertices.size() > original)
+                for (size_t i = 0; i < indices.size(); i++)
+                    if (faceMirrored[i / 3] && mirroredCopies[indices[i]] != NONE)
+                        indices[i] = mirroredCopies[indices[i]];
+            // corner contributions: the face tangent in the plane of the vertex normal, weighted by the corner angle
+            // in that plane
+            std::vector<glm::vec3> corners(indices.size());
+            parallelFor(triangles, threads, [&](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; t++)
+                {
+                    for (unsigned int c = 0; c < 3; c++)
+                    {
+                        const Vertex &vertex = vertices[indices[t * 3 + c]];
+                        const glm::vec3 &normal = vertex.Normal;
+                        glm::vec3 tangent = faceTangents[t] - normal * glm::dot(normal, faceTangents[t]);
+                        glm::vec3 toNext = vertices[indices[t * 3 + (c + 1) % 3]].Position - vertex.Position;
+                        glm::vec3 toPrevious = vertices[indices[t * 3 + (c + 2) % 3]].Position - vertex.Position;
+                        toNext -= normal * glm::dot(normal, toNext);
+                        toPrevious -= normal * glm::dot(normal, toPrevious);
+                        if (glm::dot(tangent, tangent) <= MESH_PROCESSING_EPSILON || glm::dot(toNext, toNext) <= MESH_PROCESSING_EPSILON ||
+                            glm::dot(toPrevious, toPrevious) <= MESH_PROCESSING_EPSILON)
+                        {
+                            corners[t * 3 + c] = glm::vec3(0.0f);
+                            continue;
+                        }
+                        float cosine = glm::clamp(glm::dot(glm::normalize(toNext), glm::normalize(toPrevious)), -1.0f, 1.0f);
+                        corners[t * 3 + c] = glm::normalize(tangent) * std::acos(cosine);
+                    }
+                }
+            });
+            std::vector<glm::vec3> sums(vertices.size(), glm::vec3(0.0f));
+            for (size_t i = 0; i < indices.size(); i++)
+                sums[indices[i]] += corners[i];
+            parallelFor(vertices.size(), threads, [&](size_t begin, size_t end)
+            {
+                for (size_t v = begin; v < end; v++)
+                {
+                    const glm::vec3 &normal = vertices[v].Normal;
+                    glm::vec3 tangent = sums[v] - normal * glm::dot(normal, sums[v]);
+                    if (glm::dot(tangent, tangent) <= MESH_PROCESSING_EPSILON)
+                        tangent = perpendicular(normal);
+                    tangent = glm::normalize(tangent);
+                    vertices[v].Tangent = tangent;
+                    vertices[v].Bitangent = glm::cross(normal, tangent) * (mirrored[v] ? -1.0f : 1.0f);
+                }
+            });
+        }
+
+        // any unit vector perpendicular to normal, for vertices without a usable texture mapping
+        static glm::vec3 perpendicular(const glm::vec3 &normal)
+        {
+            glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::vec3 tangent = axis - normal * glm::dot(normal, axis);
+            return glm::dot(tangent, tangent) > MESH_PROCESSING_EPSILON ? tangent : axis;
+        }
+
+        // the bits of a float, with -0 and +0 the same
+        static uint32_t floatKey(float value)
+        {
+            if (value == 0.0f)
+                value = 0.0f;
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+
+        static void positionKey(const glm::vec3 &position, uint32_t key[3])
+        {
+            for (unsigned int i = 0; i < 3; i++)
+                key[i] = floatKey(position[i]);
+        }
+
+        static void weldKey(const Vertex &vertex, uint32_t key[8])
+        {
+            for (unsigned int i = 0; i < 3; i++)
+            {
+                key[i] = floatKey(vertex.Position[i]);
+                key[3 + i] = floatKey(vertex.Normal[i]);
+            }
+            key[6] = floatKey(vertex.TexCoords.x);
+            key[7] = floatKey(vertex.TexCoords.y);
+        }
+
+        static uint32_t hash(const uint32_t *key, unsigned int count)
+        {
+            uint32_t h = 2166136261u;
+            for (unsigned int i = 0; i < count; i++)
+            {
+                h = (h ^ key[i]) * 0x9E3779B1u;
+                h ^= h >> 15;
+            }
+            return h;
+        }
+
+        // gives every element the ID of the first equal one, IDs numbered in order of first occurrence; the hashes
+        // are computed in parallel, the open addressing table is filled in order. Returns the number of IDs
+        template <typename Hash, typename Equal>
+        static unsigned int group(size_t count, unsigned int threads, const Hash &hashOf, const Equal &equal, std::vector<unsigned int> &ids)
+        {
+            std::vector<uint32_t> hashes(count);
+            parallelFor(count, threads, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    hashes[i] = hashOf(i);
+            });
+            size_t size = 16;
+            while (size < count * 2)
+                size <<= 1;
+            std::vector<unsigned int> table(size, NONE); // first element of each ID
+            ids.resize(count);
+            unsigned int groups = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                size_t slot = hashes[i] & (size - 1);
+                while (table[slot] != NONE && !(hashes[table[slot]] == hashes[i] && equal(table[slot], i)))
+                    slot = (slot + 1) & (size - 1);
+                if (table[slot] == NONE)
+                {
+                    table[slot] = (unsigned int)i;
+                    ids[i] = groups++;
+                }
+                else
+                    ids[i] = ids[table[slot]];
+            }
+            return groups;
+        }
+
+        // calls function(begin, end) over [0, count) in blocks taken by threads threads, this one included
+        template <typename Function>
+        static void parallelFor(size_t count, unsigned int threads, const Function &function)
+        {
+            size_t blocks = (count + MESH_PROCESSING_BLOCK - 1) / MESH_PROCESSING_BLOCK;
+            if (threads <= 1 || blocks <= 1)
+            {
+                function(0, count);
+                return;
+            }
+            std::atomic<size_t> next(0);
+            Workers().Run((unsigned int)std::min((size_t)threads, blocks), [&]()
+            {
+                for (size_t begin = next.fetch_add(MESH_PROCESSING_BLOCK); begin < count; begin = next.fetch_add(MESH_PROCESSING_BLOCK))
+                    function(begin, std::min(begin + MESH_PROCESSING_BLOCK, count));
+            });
+        }
+};
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESHLET_SSE2
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Default meshlet values
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+const float MESHLET_MIN_CONE_DOT = 0.1f; // wider normal cones (close to a half sphere) are never backface culled
+const float MESHLET_SPLIT_DOT = 0.7f; // a triangle turned further than this from the meshlet's first one starts a new one
+
+// Culling data of the meshlets of a mesh: small runs of consecutive triangles, each with a bounding sphere and a
+// cone bounding its triangle normals. Stored as a structure of arrays padded to a multiple of 4, so that the
+// culler can test 4 meshlets at once.
+struct MeshletData
+{
+    unsigned int Count;
+    std::vector<float> CenterX, CenterY, CenterZ, Radius;
+    std::vector<float> AxisX, AxisY, AxisZ, Cutoff; // Cutoff above 1: the cone is too wide to ever face away
+    std::vector<unsigned int> IndexOffset, IndexCount; // range of the mesh's index buffer
+
+    MeshletData()
+        : Count(0)
+    {
+    }
+
+    // splits the triangles into meshlets in their index order, a meshlet ends when one more triangle would take it
+    // over maxVertices distinct vertices or maxTriangles triangles, or would widen its normal cone too much to be
+    // culled. VertexType needs a Position.
+    template <typename VertexType>
+    void Build(const std::vector<VertexType> &vertices, const std::vector<unsigned int> &indices,
+               unsigned int maxVertices = MESHLET_MAX_VERTICES, unsigned int maxTriangles = MESHLET_MAX_TRIANGLES)
+    {
+        Count = 0;
+        for (std::vector<float> *array : arrays())
+            array->clear();
+        IndexOffset.clear();
+        IndexCount.clear();
+        // the meshlet a vertex was last counted in, so that each one is counted once per meshlet
+        std::vector<unsigned int> vertexMeshlet(vertices.size(), ~0u);
+        unsigned int start = 0, vertexCount = 0;
+        glm::vec3 firstNormal(0.0f);
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+        {
+            unsigned int added = 0;
+            for (unsigned int c = 0; c < 3; c++)
+                added += vertexMeshlet[indices[i + c]] != Count ? 1 : 0;
+            glm::vec3 normal = faceNormal(vertices, indices, i);
+            bool turned = firstNormal != glm::vec3(0.0f) && normal != glm::vec3(0.0f) && glm::dot(firstNormal, normal) < MESHLET_SPLIT_DOT;
+            if (i > start && (vertexCount + added > maxVertices || (i - start) / 3 + 1 > maxTriangles || turned))
+            {
+                addMeshlet(vertices, indices, start, i);
+                start = i;
+                vertexCount = 0;
+                added = 3; // none of its vertices are in the new meshlet yet
+                firstNormal = glm::vec3(0.0f);
+            }
+            if (firstNormal == glm::vec3(0.0f))
+                firstNormal = normal;
+            for (unsigned int c = 0; c < 3; c++)
+                vertexMeshlet[indices[i + c]] = Count;
+            vertexCount += added;
+        }
+        if (indices.size() / 3 * 3 > start)
+            addMeshlet(vertices, indices, start, (unsigned int)(indices.size() / 3 * 3));
+        // padding, the culler ignores the lanes past Count
+        while (CenterX.size() % 4 != 0)
+            for (std::vector<float> *array : arrays())
+                array->push_back(0.0f);
+    }
+
+    // memory held by the culling data
+    size_t Bytes() const
+    {
+        return CenterX.capacity() * sizeof(float) * 8 + (IndexOffset.capacity() + IndexCount.capacity()) * sizeof(unsigned int);
+    }
+
+    private:
+        std::vector<std::vector<float>*> arrays()
+        {
+            std::vector<std::vector<float>*> all = { &CenterX, &CenterY, &CenterZ, &Radius, &AxisX, &AxisY, &AxisZ, &Cutoff };
+            return all;
+        }
+
+        template <typename VertexType>
+        void addMeshlet(const std::vector<VertexType> &vertices, const std::vector<unsigned int> &indices, unsigned int first, unsigned int end)
+        {
+            // sphere around the bounding box center
+            glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+            for (unsigned int i = first; i < end; i++)
+            {
+                boundsMin = glm::min(boundsMin, vertices[indices[i]].Position);
+                boundsMax = glm::max(boundsMax, vertices[indices[i]].Position);
+            }
+            glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+            float radius = 0.0f;
+            for (unsigned int i = first; i < end; i++)
+                radius = std::max(radius, glm::length(vertices[indices[i]].Position - center));
+
+            // normal cone: the average face normal, as wide as the face normal farthest from it
+            glm::vec3 axis(0.0f);
+            for (unsigned int i = first; i < end; i += 3)
+                axis += faceNormal(vertices, indices, i);
+            float axisLength = glm::length(axis);
+            float minDot = -1.0f;
+            if (axisLength > 0.0f)
+            {
+                axis /= axisLength;
+                minDot = 1.0f;
+                for (unsigned int i = first; i < end; i += 3)
+                {
+                    glm::vec3 normal = faceNormal(vertices, indices, i);
+                    if (normal != glm::vec3(0.0f))
+                        minDot = std::min(minDot, glm::dot(axis, normal));
+                }
+            }
+
+            CenterX.push_back(center.x);
+            CenterY.push_back(center.y);
+            CenterZ.push_back(center.z);
+            Radius.push_back(radius);
+            AxisX.push_back(axis.x);
+            AxisY.push_back(axis.y);
+            AxisZ.push_back(axis.z);
+            // the sine of the cone's half angle: the camera sees every face from behind if it looks at the meshlet
+            // from inside the cone, mirrored, narrowed by that angle
+            Cutoff.push_back(minDot >= MESHLET_MIN_CONE_DOT ? std::sqrt(1.0f - minDot * minDot) : 2.0f);
+            IndexOffset.push_back(first);
+            IndexCount.push_back(end - first);
+            Count++;
+        }
+
+        // unit normal of the counter-clockwise triangle at index i, zero if degenerate
+        template <typename VertexType>
+        static glm::vec3 faceNormal(const std::vector<VertexType> &vertices, const std::vector<unsigned int> &indices, unsigned int i)
+        {
+            const glm::vec3 &a = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+            float length = glm::length(normal);
+            return length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+};
+
+// Tests meshlets against the view frustum and their normal cones against the camera position, 4 at a time.
+// Works in the model space of an instance, so the meshlet data is shared by all instances of a model.
+class MeshletCuller
+{
+    public:
+        bool BackfaceCulling;
+        // counted since ResetStats()
+        unsigned int MeshletCount;
+        unsigned int FrustumCulled;
+        unsigned int BackfaceCulled;
+        size_t TriangleCount;
+        size_t DrawnTriangles;
+        unsigned int Ranges; // index ranges left to draw after merging neighbouring visible meshlets
+        // result of the last Cull(), laid out for glMultiDrawElements: byte offsets into the index buffer and index counts
+        std::vector<const void*> RangeOffsets;
+        std::vector<int> RangeCounts;
+
+        MeshletCuller()
+            : BackfaceCulling(true)
+        {
+            ResetStats();
+        }
+
+        void ResetStats()
+        {
+            MeshletCount = FrustumCulled = BackfaceCulled = Ranges = 0;
+            TriangleCount = DrawnTriangles = 0;
+        }
+
+        // prepares the tests for an instance: the frustum planes of modelViewProjection and the camera position in
+        // model space
+        void SetInstance(const glm::mat4 &modelViewProjection, const glm::vec3 &cameraPosition)
+        {
+            glm::vec4 rows[4];
+            for (int r = 0; r < 4; r++)
+                rows[r] = glm::vec4(modelViewProjection[0][r], modelViewProjection[1][r], modelViewProjection[2][r], modelViewProjection[3][r]);
+            // Gribb-Hartmann plane extraction, normalized so the distances can be compared against radii
+            glm::vec4 extracted[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                       rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+            for (int i = 0; i < 6; i++)
+                planes[i] = extracted[i] / glm::length(glm::vec3(extracted[i]));
+            camera = cameraPosition;
+        }
+
+        // sizes the range lists for meshes of up to that many meshlets, so that Cull() doesn't allocate
+        void Reserve(unsigned int meshlets)
+        {
+            RangeOffsets.reserve(meshlets);
+            RangeCounts.reserve(meshlets);
+        }
+
+        // finds the index ranges of the meshlets that may be visible, neighbours merged; returns the number of ranges
+        unsigned int Cull(const MeshletData &meshlets)
+        {
+            RangeOffsets.clear();
+            RangeCounts.clear();
+            MeshletCount += meshlets.Count;
+            unsigned int rangeEnd = ~0u; // end of the last range, in indices
+            for (unsigned int i = 0; i < meshlets.Count; i += 4)
+            {
+                int inFrustum, frontFacing;
+                testGroup(meshlets, i, inFrustum, frontFacing);
+                for (unsigned int lane = 0; lane < 4 && i + lane < meshlets.Count; lane++)
+                {
+                    unsigned int m = i + lane;
+                    TriangleCount += meshlets.IndexCount[m] / 3;
+                    if (!(inFrustum & (1 << lane)))
+                    {
+                        FrustumCulled++;
+                        continue;
+                    }
+                    if (BackfaceCulling && !(frontFacing & (1 << lane)))
+                    {
+                        BackfaceCulled++;
+                        continue;
+                    }
+                    DrawnTriangles += meshlets.IndexCount[m] / 3;
+                    if (rangeEnd == meshlets.IndexOffset[m])
+                        RangeCounts.back() += (int)meshlets.IndexCount[m];
+                    else
+                    {
+                        RangeOffsets.push_back((const void*)(size_t)(meshlets.IndexOffset[m] * sizeof(unsigned int)));
+                        RangeCounts.push_back((int)meshlets.IndexCount[m]);
+                    }
+                    rangeEnd = meshlets.IndexOffset[m] + meshlets.IndexCount[m];
+                }
+            }
+            Ranges += (unsigned int)RangeCounts.size();
+            return (unsigned int)RangeCounts.size();
+        }
+
+    private:
+        glm::vec4 planes[6];
+        glm::vec3 camera;
+
+        // one bit per meshlet of the group of 4 starting at first: inside the frustum, not entirely facing away
+        void testGroup(const MeshletData &m, unsigned int first, int &inFrustum, int &frontFacing) const
+        {
+#ifdef MESHLET_SSE2
+            __m128 cx = _mm_loadu_ps(&m.CenterX[first]);
+            __m128 cy = _mm_loadu_ps(&m.CenterY[first]);
+            __m128 cz = _mm_loadu_ps(&m.CenterZ[first]);
+            __m128 radius = _mm_loadu_ps(&m.Radius[first]);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].x), cx), _mm_mul_ps(_mm_set1_ps(planes[p].y), cy)),
+                                             _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p].z), cz), _mm_set1_ps(planes[p].w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+            __m128 vx = _mm_sub_ps(cx, _mm_set1_ps(camera.x));
+            __m128 vy = _mm_sub_ps(cy, _mm_set1_ps(camera.y));
+            __m128 vz = _mm_sub_ps(cz, _mm_set1_ps(camera.z));
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+            __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&m.AxisX[first])), _mm_mul_ps(vy, _mm_loadu_ps(&m.AxisY[first]))),
+                                      _mm_mul_ps(vz, _mm_loadu_ps(&m.AxisZ[first])));
+            __m128 backFacing = _mm_cmpge_ps(along, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&m.Cutoff[first]), distance), radius));
+            inFrustum = _mm_movemask_ps(inside);
+            frontFacing = ~_mm_movemask_ps(backFacing) & 15;
+#else
+            inFrustum = 0;
+            frontFacing = 0;
+            for (unsigned int lane = 0; lane < 4; lane++)
+            {
+                unsigned int i = first + lane;
+                glm::vec3 center(m.CenterX[i], m.CenterY[i], m.CenterZ[i]);
+                bool inside = true;
+                for (int p = 0; p < 6; p++)
+                    inside = inside && glm::dot(glm::vec3(planes[p]), center) + planes[p].w >= -m.Radius[i];
+                glm::vec3 view = center - camera;
+                float along = glm::dot(view, glm::vec3(m.AxisX[i], m.AxisY[i], m.AxisZ[i]));
+                bool backFacing = along >= m.Cutoff[i] * glm::length(view) + m.Radius[i];
+                inFrustum |= inside ? 1 << lane : 0;
+                frontFacing |= backFacing ? 0 : 1 << lane;
+            }
+#endif
+        }
+};
+
+#endif
@@ -13,61 +13,173 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "asset_registry.hpp"
+#include "gl_state.hpp"
+#include "load_profiler.hpp"
 #include "mesh.hpp"
+#include "mesh_processing.hpp"
 #include "shader.hpp"
+#include "texture_residency.hpp"
 
+#include <cfloat>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// Decoded image of a material texture, not uploaded yet
+struct TextureImage
+{
+    string type; // texture_diffuse, texture_specular, ...
+    string path; // as referenced by the material
+    string file; // canonical path of the file, the texture is shared by it through the asset registry
+    uint64_t hash; // of the file's content
+    int width;
+    int height;
+    int components;
+    std::shared_ptr<unsigned char> pixels; // freed with stbi_image_free once the last copy goes away
+};
 
-class Model
+// Geometry of one mesh, not uploaded yet
+struct MeshData
 {
-    public:
-        /*  Model Data */
-        vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-        vector<Mesh> meshes;
-        string directory;
-        bool gammaCorrection;
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<unsigned int> textures; // indices into ModelData::images
+    MeshletData Meshlets;
+};
 
-        /*  Functions   */
-        // constructor, expects a filepath to a 3D model.
-        Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
-        {
-            loadModel(path);
-        }
+// Everything a Model is made of, imported and decoded without touching OpenGL so it can be done on any thread
+struct ModelData
+{
+    string path; // of the model file
+    string directory;
+    vector<MeshData> meshes;
+    vector<TextureImage> images;
+    // axis aligned bounding box of all meshes, in model space
+    glm::vec3 BoundsMin;
+    glm::vec3 BoundsMax;
 
-        // draws the model, and thus all its meshes
-        void Draw(Shader shader)
-        {
-            for(unsigned int i = 0; i < meshes.size(); i++)
-                meshes[i].Draw(shader);
-        }
+    ModelData()
+        : BoundsMin(glm::vec3(FLT_MAX)), BoundsMax(glm::vec3(-FLT_MAX))
+    {
+    }
 
-    private:
-        /*  Functions   */
-        // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-        void loadModel(string const &path)
+    // size of the vertex and index data
+    size_t GeometryBytes() const
+    {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].vertices.size() * sizeof(Vertex) + meshes[i].indices.size() * sizeof(unsigned int);
+        return bytes;
+    }
+
+    // size of the decoded pixels
+    size_t ImageBytes() const
+    {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < images.size(); i++)
+            bytes += (size_t)images[i].width * images[i].height * images[i].components;
+        return bytes;
+    }
+
+    // estimated video memory of the textures once uploaded
+    size_t TextureBytes() const
+    {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < images.size(); i++)
+            bytes += EstimatedTextureBytes(images[i].width, images[i].height);
+        return bytes;
+    }
+};
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+bool LoadTextureImage(const char *path, const string &directory, TextureImage &image, bool skipResident = false);
+unsigned int TextureFromImage(const TextureImage &image);
+
+// Reads a model with assimp and decodes its textures into a ModelData; no OpenGL calls, safe on worker threads
+class ModelImporter
+{
+    public:
+        // returns false if assimp couldn't read the file
+        bool Import(string const &path, ModelData &model)
         {
+            data = &model;
+            data->path = path;
             // read file via ASSIMP
             Assimp::Importer importer;
-            const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices);
+            LoadTimer timer(LOAD_IMPORT, path);
+            if (timer.Active())
+            {
+                ifstream file(path.c_str(), ios::binary | ios::ate);
+                timer.Bytes(file ? (size_t)file.tellg() : 0);
+            }
+            // welding, normals and tangents are done by MeshProcessor on all cores, unless switched back to assimp's steps
+            native = MeshProcessing().Native;
+            unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+            if (!native)
+                flags |= aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_JoinIdenticalVertices;
+            const aiScene *scene = importer.ReadFile(path, flags);
+            timer.Stop();
             // check for errors
             if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
             {
                 cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-                return;
+                return false;
             }
             // retrieve the directory path of the filepath
-            directory = path.substr(0, path.find_last_of('/'));
+            data->directory = path.substr(0, path.find_last_of('/'));
+            imageIndices.clear();
 
+            // size the mesh list up front so that filling it never reallocates (and copies) the meshes
+            data->meshes.reserve(data->meshes.size() + countMeshes(scene->mRootNode));
             // process ASSIMP's root node recursively
             processNode(scene->mRootNode, scene);
+            if (native)
+            {
+                LoadTimer postprocess(LOAD_POSTPROCESS, path);
+                processor.Run();
+                postprocess.Bytes(data->GeometryBytes());
+            }
+            // split the triangles into meshlets for culling them in small groups
+            for (unsigned int i = 0; i < data->meshes.size(); i++)
+            {
+                LoadTimer meshlets(LOAD_MESHLETS, path);
+                data->meshes[i].Meshlets.Build(data->meshes[i].vertices, data->meshes[i].indices);
+                meshlets.Bytes(data->meshes[i].Meshlets.Bytes());
+            }
+            return true;
+        }
+
+    private:
+        ModelData *data;
+        bool native;               // post-processing by processor rather than assimp
+        MeshProcessor processor;
+        unordered_map<string, unsigned int> imageIndices; // material texture path to index into data->images
+
+        // most meshes processNode() will produce, a mesh referenced by several nodes counts each time
+        static unsigned int countMeshes(const aiNode *node)
+        {
+            unsigned int count = node->mNumMeshes;
+            for (unsigned int i = 0; i < node->mNumChildren; i++)
+                count += countMeshes(node->mChildren[i]);
+            return count;
+        }
+
+        // after triangulation, meshes made only of points and lines have nothing to draw
+        static bool hasTriangles(const aiMesh *mesh)
+        {
+            for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+                if (mesh->mFaces[i].mNumIndices == 3)
+                    return true;
+            return false;
         }
 
         // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -79,7 +191,10 @@ class Model
                 // the node object only contains indices to index the actual objects in the scene.
                 // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
                 aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-                meshes.push_back(processMesh(mesh, scene));
+                if (!hasTriangles(mesh))
+                    continue;
+                data->meshes.push_back(MeshData());
+                processMesh(mesh, scene, data->meshes.back());
             }
             // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
             for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -89,28 +204,38 @@ class Model
 
         }
 
-        Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+        // converts an assimp mesh into result, in place: the vectors are sized once and filled without reallocating
+        void processMesh(aiMesh *mesh, const aiScene *scene, MeshData &result)
         {
             // data to fill
-            vector<Vertex> vertices;
-            vector<unsigned int> indices;
-            vector<Texture> textures;
+            vector<Vertex> &vertices = result.vertices;
+            vector<unsigned int> &indices = result.indices;
+            vector<unsigned int> &textures = result.textures;
+            LoadTimer convert(LOAD_CONVERT, data->path);
 
             // Walk through each of the mesh's vertices
+            vertices.resize(mesh->mNumVertices);
             for(unsigned int i = 0; i < mesh->mNumVertices; i++)
             {
-                Vertex vertex;
+                Vertex &vertex = vertices[i];
                 glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
                 // positions
                 vector.x = mesh->mVertices[i].x;
                 vector.y = mesh->mVertices[i].y;
                 vector.z = mesh->mVertices[i].z;
                 vertex.Position = vector;
-                // normals
-                vector.x = mesh->mNormals[i].x;
-                vector.y = mesh->mNormals[i].y;
-                vector.z = mesh->mNormals[i].z;
-                vertex.Normal = vector;
+                data->BoundsMin = glm::min(data->BoundsMin, vector);
+                data->BoundsMax = glm::max(data->BoundsMax, vector);
+                // normals, generated afterwards for meshes without them
+                if (mesh->mNormals)
+                {
+                    vector.x = mesh->mNormals[i].x;
+                    vector.y = mesh->mNormals[i].y;
+                    vector.z = mesh->mNormals[i].z;
+                    vertex.Normal = vector;
+                }
+                else
+                    vertex.Normal = glm::vec3(0.0f);
                 // texture coordinates
                 if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
                 {
@@ -123,26 +248,42 @@ class Model
                 }
                 else
                     vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-                // tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-                // bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
-                vertices.push_back(vertex);
+                // tangent and bitangent, assimp leaves them out for meshes without texture coordinates
+                if (mesh->mTangents && mesh->mBitangents)
+                {
+                    vector.x = mesh->mTangents[i].x;
+                    vector.y = mesh->mTangents[i].y;
+                    vector.z = mesh->mTangents[i].z;
+                    vertex.Tangent = vector;
+                    vector.x = mesh->mBitangents[i].x;
+                    vector.y = mesh->mBitangents[i].y;
+                    vector.z = mesh->mBitangents[i].z;
+                    vertex.Bitangent = vector;
+                }
+                else
+                {
+                    vertex.Tangent = glm::vec3(0.0f);
+                    vertex.Bitangent = glm::vec3(0.0f);
+                }
             }
             // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+            // after triangulation, the faces with fewer indices are points and lines, which aren't drawn
+            unsigned int indexCount = 0;
+            for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+                if (mesh->mFaces[i].mNumIndices == 3)
+                    indexCount += 3;
+            indices.reserve(indexCount);
             for(unsigned int i = 0; i < mesh->mNumFaces; i++)
             {
-                aiFace face = mesh->mFaces[i];
+                const aiFace &face = mesh->mFaces[i];
                 // retrieve all indices of the face and store them in the indices vector
-                for(unsigned int j = 0; j < face.mNumIndices; j++)
-                    indices.push_back(face.mIndices[j]);
+                if (face.mNumIndices == 3)
+                    indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
             }
+            convert.Bytes(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
+            convert.Stop();
+            if (native)
+                processor.Add(vertices, indices, mesh->mNormals != NULL);
             // process materials
             aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
             // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
@@ -154,93 +295,376 @@ class Model
             // emission: texture_emissionN
 
             // 1. diffuse maps
-            vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+            loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
             // 2. specular maps
-            vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+            loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", textures);
             // 3. normal maps
-            vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-            textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+            loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", textures);
             // 4. emission maps
-            vector<Texture> emissionMaps = loadMaterialTextures(material, aiTextureType_EMISSIVE, "texture_emission");
-            textures.insert(textures.end(), emissionMaps.begin(), emissionMaps.end());
-
-            // return a mesh object created from the extracted mesh data
-            return Mesh(vertices, indices, textures);
+            loadMaterialTextures(material, aiTextureType_EMISSIVE, "texture_emission", textures);
         }
 
-        // checks all material textures of a given type and loads the textures if they're not loaded yet.
-        // the required info is returned as a Texture struct.
-        vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+        // checks all material textures of a given type and decodes the images if they're not decoded yet.
+        // the image indices are appended to textures.
+        void loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, vector<unsigned int> &textures)
         {
-            vector<Texture> textures;
             for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
             {
                 aiString str;
                 mat->GetTexture(type, i, &str);
                 // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-                bool skip = false;
-                for(unsigned int j = 0; j < textures_loaded.size(); j++)
+                unordered_map<string, unsigned int>::iterator loaded = imageIndices.find(str.C_Str());
+                if(loaded != imageIndices.end())
                 {
-                    if(strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                    {
-                        textures.push_back(textures_loaded[j]);
-                        skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                        break;
-                    }
+                    textures.push_back(loaded->second); // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                    continue;
                 }
-                if(!skip)
-                {   // if texture hasn't been loaded already, load it
-                    Texture texture;
-                    texture.id = TextureFromFile(str.C_Str(), this->directory);
-                    texture.type = typeName;
-                    texture.path = str.C_Str();
-                    textures.push_back(texture);
-                    textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                // if texture hasn't been loaded already, decode it, unless another model already has it resident
+                TextureImage image;
+                LoadTextureImage(str.C_Str(), data->directory, image, true);
+                image.type = typeName;
+                image.path = str.C_Str();
+                imageIndices[image.path] = (unsigned int)data->images.size();
+                textures.push_back(data->images.size());
+                data->images.push_back(std::move(image));  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+            }
+        }
+};
+
+// Imports a model file into model, see ModelImporter
+inline bool ImportModel(string const &path, ModelData &model)
+{
+    ModelImporter importer;
+    return importer.Import(path, model);
+}
+
+class Model
+{
+    public:
+        /*  Model Data */
+        vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+        vector<Mesh> meshes;
+        string directory;
+        bool gammaCorrection;
+        // axis aligned bounding box of all meshes, in model space
+        glm::vec3 BoundsMin;
+        glm::vec3 BoundsMax;
+
+        /*  Functions   */
+        // constructor, expects a filepath to a 3D model.
+        Model(string const &path, bool gamma = false)
+            : gammaCorrection(gamma), BoundsMin(glm::vec3(FLT_MAX)), BoundsMax(glm::vec3(-FLT_MAX)), textureBytes(0)
+        {
+            ModelData data;
+            if (ImportModel(path, data))
+                upload(data);
+        }
+
+        // constructor, uploads a model imported beforehand (e.g. on a worker thread) with ImportModel;
+        // the geometry is moved into the meshes, data only keeps its images afterwards
+        Model(ModelData &&data, bool gamma = false)
+            : gammaCorrection(gamma), BoundsMin(glm::vec3(FLT_MAX)), BoundsMax(glm::vec3(-FLT_MAX)), textureBytes(0)
+        {
+            upload(data);
+        }
+
+        // draws the model, and thus all its meshes
+        void Draw(Shader &shader)
+        {
+            for(unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].Draw(shader);
+        }
+
+        // draws every mesh count times, one instanced draw per mesh
+        void DrawInstanced(Shader &shader, unsigned int count)
+        {
+            for(unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].DrawInstanced(shader, count);
+        }
+
+        // draws the meshes leaving out the meshlets the culler rejects, culler.SetInstance() has to be called first
+        void Draw(Shader &shader, MeshletCuller &culler)
+        {
+            for(unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].Draw(shader, culler);
+        }
+
+        // deletes the GL objects of the meshes and textures, the model can't be drawn afterwards
+        void Release()
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].Release();
+            for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            {
+                // textures are shared with other models, the last one deletes them
+                if (!Assets().ReleaseTexture(textures_loaded[i].id))
+                    continue;
+                TextureResidency().Unregister(textures_loaded[i].id);
+                GLState().DeleteTexture(textures_loaded[i].id);
+            }
+            meshes.clear();
+            textures_loaded.clear();
+            textureBytes = 0;
+        }
+
+        // memory still held in RAM (the meshes keep a copy of their geometry until ReleaseGeometry())
+        size_t CpuBytes() const
+        {
+            size_t bytes = 0;
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                bytes += meshes[i].vertices.capacity() * sizeof(Vertex) + meshes[i].indices.capacity() * sizeof(unsigned int) +
+                         meshes[i].Meshlets.Bytes();
+            return bytes;
+        }
+
+        // estimated video memory of the geometry and textures
+        size_t GpuBytes() const
+        {
+            size_t bytes = textureBytes;
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                bytes += meshes[i].VertexCount * sizeof(Vertex) + meshes[i].IndexCount * sizeof(unsigned int);
+            return bytes;
+        }
+
+        // frees the CPU copy of the geometry once it is resident; anything reading vertices/indices
+        // (occluders, merged buffers) has to be built before
+        void ReleaseGeometry()
+        {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+                meshes[i].ReleaseGeometry();
+        }
+
+    private:
+        friend class ModelUpload;
+
+        size_t textureBytes;
+
+        // empty model, filled by a ModelUpload
+        Model(const ModelData &data, bool gamma, int /* incremental */)
+            : gammaCorrection(gamma), textureBytes(0)
+        {
+            beginUpload(data);
+        }
+
+        /*  Functions   */
+        // creates the GL textures and meshes of an imported model, moving the geometry out of data
+        void upload(ModelData &data)
+        {
+            beginUpload(data);
+            for (unsigned int i = 0; i < data.images.size(); i++)
+                uploadTexture(data, i);
+            for (unsigned int i = 0; i < data.meshes.size(); i++)
+                uploadMesh(data, i);
+        }
+
+        void beginUpload(const ModelData &data)
+        {
+            directory = data.directory;
+            BoundsMin = data.BoundsMin;
+            BoundsMax = data.BoundsMax;
+            textureBytes = data.TextureBytes();
+            textures_loaded.reserve(data.images.size());
+            meshes.reserve(data.meshes.size());
+        }
+
+        // textures first: the meshes refer to them
+        void uploadTexture(const ModelData &data, unsigned int i)
+        {
+            const TextureImage &image = data.images[i];
+            Texture texture;
+            texture.type = image.type;
+            texture.path = image.path;
+            texture.id = Assets().AcquireTexture(image.file, image.hash);
+            if (!texture.id)
+            {
+                // not resident: create it, decoding it now if the import skipped it for a texture released since
+                TextureImage decoded;
+                const TextureImage *source = &image;
+                if (!image.pixels && !image.file.empty())
+                {
+                    LoadTextureImage(image.path.c_str(), directory, decoded);
+                    source = &decoded;
+                }
+                texture.id = TextureFromImage(*source);
+                if (source->pixels)
+                {
+                    Assets().AddTexture(texture.id, source->file, source->hash);
+                    // the residency manager may shrink it later and restream it from the file
+                    TextureResidency().Register(texture.id, source->file, source->width, source->height, source->components);
                 }
             }
-            return textures;
+            textures_loaded.push_back(texture);
+        }
+
+        void uploadMesh(ModelData &data, unsigned int i)
+        {
+            vector<Texture> textures;
+            textures.reserve(data.meshes[i].textures.size());
+            for (unsigned int t = 0; t < data.meshes[i].textures.size(); t++)
+                textures.push_back(textures_loaded[data.meshes[i].textures[t]]);
+            // the mesh takes over the imported vectors and uploads straight from them
+            LoadTimer timer(LOAD_MESH_UPLOAD, data.path, true);
+            timer.Bytes(data.meshes[i].vertices.size() * sizeof(Vertex) + data.meshes[i].indices.size() * sizeof(unsigned int));
+            meshes.push_back(Mesh(std::move(data.meshes[i].vertices), std::move(data.meshes[i].indices), std::move(textures),
+                                  std::move(data.meshes[i].Meshlets)));
         }
     };
 
+// Creates the GL objects of an imported model one texture or mesh per Step(), so that uploading a large model
+// can be spread across frames. Must be used on the thread owning the context.
+class ModelUpload
+{
+    public:
+        ModelUpload(ModelData &&data, bool gamma = false)
+            : data(std::move(data)), model(new Model(this->data, gamma, 0)), next(0)
+        {
+        }
+
+        // an unfinished upload releases what it created
+        ~ModelUpload()
+        {
+            if (model)
+                model->Release();
+        }
+
+        // total number of steps: the textures, then the meshes
+        unsigned int Steps() const
+        {
+            return (unsigned int)(data.images.size() + data.meshes.size());
+        }
+
+        bool Done() const
+        {
+            return next >= Steps();
+        }
+
+        float Progress() const
+        {
+            return Steps() ? (float)next / Steps() : 1.0f;
+        }
+
+        // uploads the next texture or mesh, returns false once everything is uploaded
+        bool Step()
+        {
+            if (Done())
+                return false;
+            if (next < data.images.size())
+                model->uploadTexture(data, next);
+            else
+                model->uploadMesh(data, next - (unsigned int)data.images.size());
+            next++;
+            if (Done())
+                data = ModelData(); // the decoded images aren't needed any more
+            return !Done();
+        }
+
+        // hands the model over once Done(); the upload can't be used afterwards
+        Model *Finish()
+        {
+            return model.release();
+        }
+
+        // memory still held by the upload, decoded images and geometry not moved into meshes yet
+        size_t CpuBytes() const
+        {
+            return data.GeometryBytes() + data.ImageBytes();
+        }
+
+    private:
+        ModelData data;
+        std::unique_ptr<Model> model;
+        unsigned int next;
+};
+
     unsigned int TextureFromFile(const char *path, const string &directory, bool /* gamma */)
+    {
+        TextureImage image;
+        LoadTextureImage(path, directory, image);
+        return TextureFromImage(image);
+    }
+
+    // reads and decodes an image file, thread safe; on failure image.pixels stays empty. With skipResident, a file
+    // whose texture (or the same content under another name) is already resident isn't decoded either
+    bool LoadTextureImage(const char *path, const string &directory, TextureImage &image, bool skipResident)
     {
         string filename = string(path);
         filename = directory + '/' + filename;
 
+        image.width = image.height = image.components = 0;
+        image.file = AssetRegistry::CanonicalPath(filename);
+        image.hash = 0;
+        // a texture of this file is resident: nothing to read, the upload finds it by path
+        if (skipResident && Assets().HasTexture(image.file))
+            return true;
+        LoadTimer read(LOAD_FILE_READ, image.file);
+        ifstream file(filename.c_str(), ios::binary | ios::ate);
+        streamoff size = file ? (streamoff)file.tellg() : 0;
+        vector<unsigned char> bytes(size > 0 ? (size_t)size : 0);
+        if (!bytes.empty())
+        {
+            file.seekg(0);
+            if (!file.read(reinterpret_cast<char*>(&bytes[0]), size))
+                bytes.clear();
+        }
+        read.Bytes(bytes.size());
+        read.Stop();
+        if (bytes.empty())
+        {
+            cout << "Texture failed to load at path: " << path << endl;
+            return false;
+        }
+        image.hash = AssetRegistry::Hash(&bytes[0], bytes.size());
+        if (skipResident && Assets().HasTexture(image.file, image.hash))
+            return true;
+        LoadTimer decode(LOAD_DECODE, image.file);
+        unsigned char *data = stbi_load_from_memory(&bytes[0], (int)bytes.size(), &image.width, &image.height, &image.components, 0);
+        decode.Bytes((size_t)image.width * image.height * image.components);
+        decode.Stop();
+        if (!data)
+        {
+            cout << "Texture failed to load at path: " << path << endl;
+            return false;
+        }
+        image.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+        return true;
+    }
+
+    // creates a mipmapped GL texture from a decoded image, must run on the thread owning the context
+    unsigned int TextureFromImage(const TextureImage &image)
+    {
         unsigned int textureID;
         glGenTextures(1, &textureID);
 
-        int width, height, nrComponents;
-        unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-        if (data)
+        if (image.pixels)
         {
             GLenum format;
-            if (nrComponents == 1)
+            if (image.components == 1)
                 format = GL_RED;
-            else if (nrComponents == 3)
+            else if (image.components == 3)
                 format = GL_RGB;
-            else if (nrComponents == 4)
+            else if (image.components == 4)
                 format = GL_RGBA;
             else
                 format = GL_RED;
 
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+            GLState().BindTexture(GL_TEXTURE_2D, textureID);
+            size_t bytes = (size_t)image.width * image.height * image.components;
+            LoadTimer upload(LOAD_TEXTURE_UPLOAD, image.file, true);
+            upload.Bytes(bytes);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+            upload.Stop();
+            RenderStats().Count(STAT_TEXTURE_BYTES, bytes);
+            RenderStats().TextureAllocated(textureID, GPU_MEMORY_TEXTURES, EstimatedTextureBytes(image.width, image.height));
+            // counted by the size of the base level
+            LoadTimer mipmaps(LOAD_MIPMAPS, image.file, true);
+            mipmaps.Bytes(bytes);
             glGenerateMipmap(GL_TEXTURE_2D);
+            mipmaps.Stop();
 
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            cout << "Texture failed to load at path: " << path << endl;
-            stbi_image_free(data);
         }
 
         return textureID;
@@ -0,0 +1,377 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Default loader values
+const unsigned int MODEL_LOADER_THREADS = 2;
+const float MODEL_LOADER_UPLOAD_BUDGET = 2.0f; // milliseconds of GL uploads per frame
+
+enum ModelLoadState
+{
+    MODEL_LOAD_QUEUED,    // waiting for a worker
+    MODEL_LOAD_IMPORTING, // assimp and image decoding on a worker
+    MODEL_LOAD_UPLOADING, // creating the GL objects on the render thread, a few per frame
+    MODEL_LOAD_READY,
+    MODEL_LOAD_FAILED
+};
+
+// A model loaded in the background by a ModelLoader, shared through ModelHandle. Dropping the last handle cancels
+// the load, or releases the GL objects of a ready model, so handles must only be dropped on the render thread.
+class AsyncModel
+{
+    public:
+        std::string Path;
+        // axis aligned bounding box in model space, known once imported; use it to draw a placeholder
+        bool HasBounds;
+        glm::vec3 BoundsMin;
+        glm::vec3 BoundsMax;
+        // measured once imported: geometry in RAM, geometry and textures in video memory
+        size_t ImportedCpuBytes;
+        size_t ImportedGpuBytes;
+
+        AsyncModel(const std::string &path, float priority, bool gamma)
+            : Path(path), HasBounds(false), BoundsMin(0.0f), BoundsMax(0.0f), ImportedCpuBytes(0), ImportedGpuBytes(0),
+              state(MODEL_LOAD_QUEUED), priority(priority), gamma(gamma)
+        {
+        }
+
+        ~AsyncModel()
+        {
+            // an unfinished upload releases what it created by itself
+            if (loaded)
+                loaded->Release();
+        }
+
+        ModelLoadState State() const
+        {
+            return state;
+        }
+
+        bool Ready() const
+        {
+            return state == MODEL_LOAD_READY;
+        }
+
+        // part of the GL objects created so far, 0 until imported
+        float Progress() const
+        {
+            if (state == MODEL_LOAD_READY)
+                return 1.0f;
+            return upload ? upload->Progress() : 0.0f;
+        }
+
+        // the model once ready, 0 before
+        Model *Get() const
+        {
+            return Ready() ? loaded.get() : 0;
+        }
+
+        // memory currently held in RAM: the ready model, or the imported data waiting for its upload
+        size_t CpuBytes() const
+        {
+            if (loaded)
+                return loaded->CpuBytes();
+            return upload ? upload->CpuBytes() : 0;
+        }
+
+        size_t GpuBytes() const
+        {
+            return loaded ? loaded->GpuBytes() : 0;
+        }
+
+    private:
+        friend class ModelLoader;
+
+        ModelLoadState state;
+        float priority;
+        bool gamma;
+        std::unique_ptr<ModelUpload> upload;
+        std::unique_ptr<Model> loaded;
+};
+
+typedef std::shared_ptr<AsyncModel> ModelHandle;
+
+// Loads models without blocking the render loop: Load() returns a handle right away, workers import the file and
+// decode its textures, and Update() creates the GL objects of the imported models a texture or mesh at a time
+// until the frame's upload budget is spent. Loads are served by priority, lowest value first. Loading a file that
+// is already loaded or loading (by canonical path) returns the same handle, so its geometry is shared.
+class ModelLoader
+{
+    public:
+        float UploadBudget; // milliseconds per frame, at least one texture or mesh is uploaded every frame
+
+        // statistics of the last Update()
+        unsigned int UploadSteps;
+        float UploadTime;   // milliseconds
+        // totals
+        unsigned int Uploads; // models that became ready
+        unsigned int Failures;
+        unsigned int SharedLoads; // Load() calls served by a model already loaded or loading
+
+        ModelLoader(unsigned int threads = MODEL_LOADER_THREADS)
+            : UploadBudget(MODEL_LOADER_UPLOAD_BUDGET), UploadSteps(0), UploadTime(0.0f), Uploads(0), Failures(0),
+              SharedLoads(0), stopping(false)
+        {
+            for (unsigned int i = 0; i < std::max(threads, 1u); i++)
+                workers.push_back(std::thread(&ModelLoader::work, this));
+        }
+
+        ~ModelLoader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                jobs.clear();
+            }
+            wake.notify_all();
+            for (unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+            for (unsigned int i = 0; i < results.size(); i++)
+                delete results[i].second;
+        }
+
+        // starts loading a model, the handle can be polled (State(), Progress()) and drawn once Ready()
+        ModelHandle Load(const std::string &path, float priority = 0.0f, bool gamma = false)
+        {
+            std::string canonical = AssetRegistry::CanonicalPath(path);
+            std::unordered_map<std::string, std::weak_ptr<AsyncModel> >::iterator found = loaded.find(canonical);
+            if (found != loaded.end())
+            {
+                ModelHandle existing = found->second.lock();
+                if (existing && existing->state != MODEL_LOAD_FAILED && existing->gamma == gamma)
+                {
+                    SharedLoads++;
+                    if (priority < existing->priority)
+                        SetPriority(existing, priority);
+                    return existing;
+                }
+            }
+            ModelHandle handle(new AsyncModel(path, priority, gamma));
+            loaded[canonical] = handle;
+            inFlight.push_back(handle);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                Job job;
+                job.Target = handle.get();
+                job.Path = path;
+                job.Priority = priority;
+                jobs.push_back(job);
+            }
+            wake.notify_one();
+            return handle;
+        }
+
+        // changes the priority of a load still waiting for a worker or for its upload
+        void SetPriority(const ModelHandle &handle, float priority)
+        {
+            handle->priority = priority;
+            if (handle->state != MODEL_LOAD_QUEUED)
+                return;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int j = 0; j < jobs.size(); j++)
+                if (jobs[j].Target == handle.get())
+                    jobs[j].Priority = priority;
+        }
+
+        // loads not ready yet (nor failed)
+        unsigned int InFlight() const
+        {
+            return (unsigned int)inFlight.size();
+        }
+
+        // collects finished imports, drops abandoned loads and uploads within the budget.
+        // Must be called once per frame on the thread owning the GL context.
+        void Update()
+        {
+            collectImports();
+            cancelAbandoned();
+            uploadModels();
+        }
+
+    private:
+        struct Job
+        {
+            AsyncModel *Target;
+            std::string Path;
+            float Priority;
+        };
+
+        std::vector<ModelHandle> inFlight;
+        std::unordered_map<std::string, std::weak_ptr<AsyncModel> > loaded; // by canonical path, expired entries are replaced
+        std::vector<AsyncModel*> uploading; // scratch
+
+        // shared with the workers
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<Job> jobs;
+        std::vector<std::pair<AsyncModel*, ModelData*> > results; // 0 data if the import failed
+        std::vector<std::thread> workers;
+        bool stopping;
+
+        void work()
+        {
+            for (;;)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!stopping && jobs.empty())
+                        wake.wait(lock);
+                    if (stopping)
+                        return;
+                    std::vector<Job>::iterator next = jobs.begin();
+                    for (std::vector<Job>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+                        if (it->Priority < next->Priority)
+                            next = it;
+                    job = *next;
+                    jobs.erase(next);
+                }
+                ModelData *data = new ModelData();
+                if (!ImportModel(job.Path, *data))
+                {
+                    delete data;
+                    data = 0;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(std::make_pair(job.Target, data));
+            }
+        }
+
+        void collectImports()
+        {
+            std::vector<std::pair<AsyncModel*, ModelData*> > finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.swap(results);
+                // jobs picked up since the last frame
+                for (unsigned int i = 0; i < inFlight.size(); i++)
+                    if (inFlight[i]->state == MODEL_LOAD_QUEUED && !queued(inFlight[i].get()))
+                        inFlight[i]->state = MODEL_LOAD_IMPORTING;
+            }
+            for (unsigned int i = 0; i < finished.size(); i++)
+            {
+                // in flight until its result is collected, so still alive
+                AsyncModel &target = *finished[i].first;
+                std::unique_ptr<ModelData> data(finished[i].second);
+                if (data && isAbandoned(target))
+                {
+                    target.state = MODEL_LOAD_FAILED; // nobody wants it any more, not counted as a failure
+                    continue;
+                }
+                if (!data)
+                {
+                    target.state = MODEL_LOAD_FAILED;
+                    Failures++;
+                    continue;
+                }
+                target.HasBounds = true;
+                target.BoundsMin = data->BoundsMin;
+                target.BoundsMax = data->BoundsMax;
+                target.ImportedCpuBytes = data->GeometryBytes();
+                target.ImportedGpuBytes = data->GeometryBytes() + data->TextureBytes();
+                target.upload.reset(new ModelUpload(std::move(*data), target.gamma));
+                target.state = MODEL_LOAD_UPLOADING;
+            }
+            removeFinished();
+        }
+
+        // loads nobody holds a handle to any more; one being imported stays until its result comes in
+        void cancelAbandoned()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int i = 0; i < inFlight.size(); i++)
+            {
+                if (inFlight[i].use_count() > 1)
+                    continue;
+                if (inFlight[i]->state == MODEL_LOAD_QUEUED)
+                {
+                    // a worker may have taken it since collectImports(), its result is waited for then
+                    inFlight[i]->state = MODEL_LOAD_IMPORTING;
+                    for (unsigned int j = 0; j < jobs.size(); j++)
+                        if (jobs[j].Target == inFlight[i].get())
+                        {
+                            jobs.erase(jobs.begin() + j);
+                            inFlight[i]->state = MODEL_LOAD_FAILED;
+                            break;
+                        }
+                }
+                else if (inFlight[i]->state == MODEL_LOAD_UPLOADING)
+                    inFlight[i]->state = MODEL_LOAD_FAILED; // the upload is cancelled with the handle
+            }
+            removeFinished();
+        }
+
+        // uploads the most urgent models first until the budget is spent
+        void uploadModels()
+        {
+            UploadSteps = 0;
+            UploadTime = 0.0f;
+            uploading.clear();
+            for (unsigned int i = 0; i < inFlight.size(); i++)
+                if (inFlight[i]->state == MODEL_LOAD_UPLOADING)
+                    uploading.push_back(inFlight[i].get());
+            std::stable_sort(uploading.begin(), uploading.end(),
+                             [](const AsyncModel *a, const AsyncModel *b) { return a->priority < b->priority; });
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (unsigned int i = 0; i < uploading.size(); i++)
+            {
+                AsyncModel &target = *uploading[i];
+                while (UploadSteps == 0 || UploadTime < UploadBudget)
+                {
+                    bool more = target.upload->Step();
+                    UploadSteps++;
+                    UploadTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                    if (!more)
+                        break;
+                }
+                if (!target.upload->Done())
+                    break;
+                target.loaded.reset(target.upload->Finish());
+                target.upload.reset();
+                target.state = MODEL_LOAD_READY;
+                Uploads++;
+            }
+            removeFinished();
+        }
+
+        void removeFinished()
+        {
+            unsigned int kept = 0;
+            for (unsigned int i = 0; i < inFlight.size(); i++)
+                if (inFlight[i]->state != MODEL_LOAD_READY && inFlight[i]->state != MODEL_LOAD_FAILED)
+                    inFlight[kept++] = inFlight[i];
+            inFlight.resize(kept);
+        }
+
+        bool isAbandoned(const AsyncModel &target) const
+        {
+            for (unsigned int i = 0; i < inFlight.size(); i++)
+                if (inFlight[i].get() == &target)
+                    return inFlight[i].use_count() == 1;
+            return true;
+        }
+
+        // caller holds the mutex
+        bool queued(const AsyncModel *target) const
+        {
+            for (unsigned int j = 0; j < jobs.size(); j++)
+                if (jobs[j].Target == target)
+                    return true;
+            return false;
+        }
+};
+#endif
@@ -0,0 +1,261 @@
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "camera.hpp"
+#include "frame_arena.hpp"
+#include "gl_caps.hpp"
+#include "gl_state.hpp"
+#include "model.hpp"
+#include "shader.hpp"
+
+// Default multi-view values
+const unsigned int MULTI_VIEW_MAX_VIEWS = 4;           // must match MAX_VIEWS in the shaders
+const float MULTI_VIEW_EYE_SEPARATION = 0.064f;        // stereo, world units between the eyes
+const float MULTI_VIEW_OVERVIEW_HEIGHT = 12.0f;        // split screen, the overview camera above the main one
+const float MULTI_VIEW_OVERVIEW_DISTANCE = 8.0f;       // and behind it
+const float MULTI_VIEW_PLANE_EPSILON = 1e-4f;          // plane normals closer than this are treated as parallel
+
+enum MultiViewLayout
+{
+    MULTI_VIEW_STEREO, // two eyes side by side
+    MULTI_VIEW_SPLIT   // the camera on the top half, an overview following it on the bottom half
+};
+
+// One camera and the part of the framebuffer it renders to
+struct RenderView
+{
+    glm::mat4 View;
+    glm::mat4 Projection;
+    glm::mat4 ViewProjection;
+    glm::vec3 Position;
+    int X, Y, Width, Height;
+};
+
+// Renders several views of the scene in one pass. The objects are culled once against all the views: a sphere
+// outside the frustum that encloses them (the planes the views share, moved out to the most permissive one) is
+// rejected with a single test, the others get a mask of the views that see them. Every object is then submitted
+// once as an instanced draw, one instance per view: the vertex shader (MULTI_VIEW) takes its view matrices from
+// viewProjections[gl_InstanceID] and routes the triangle to the view's viewport with gl_ViewportIndex. Without the
+// extension that makes gl_ViewportIndex writable from a vertex shader, the views are drawn one after the other
+// instead, each with its own viewport and only the objects it sees; the culling and uniforms are still shared.
+class MultiView
+{
+    public:
+        bool ViewportIndex;   // gl_ViewportIndex from the vertex shader: one draw per object for all views
+        RenderView Views[MULTI_VIEW_MAX_VIEWS];
+        unsigned int ViewCount;
+        // statistics of the last Cull() and Draw()
+        unsigned int Tested;
+        unsigned int Culled;      // outside every view
+        unsigned int DrawCalls;   // per model, counting the views drawn separately
+
+        MultiView()
+            : ViewportIndex(false), ViewCount(0), Tested(0), Culled(0), DrawCalls(0), extension(0)
+        {
+        }
+
+        // looks for viewport arrays (GL 4.1) and a vertex shader viewport index extension; call with a current context
+        void Init()
+        {
+            if (HasGLVersion(4, 1) && HasGLExtension("GL_ARB_shader_viewport_layer_array"))
+                extension = "ARB_VIEWPORT_LAYER_ARRAY";
+            else if (HasGLVersion(4, 1) && HasGLExtension("GL_AMD_vertex_shader_viewport_index"))
+                extension = "AMD_VERTEX_SHADER_VIEWPORT_INDEX";
+            ViewportIndex = extension != 0;
+        }
+
+        // the defines of the multi-view variant of a shader
+        ShaderDefines &AddDefines(ShaderDefines &defines) const
+        {
+            defines.Keyword("MULTI_VIEW");
+            if (extension)
+                defines.Keyword(extension);
+            return defines;
+        }
+
+        // places the views of a layout around the camera, splitting the framebuffer between them
+        void Configure(MultiViewLayout layout, const Camera &camera, int width, int height, float nearPlane, float farPlane)
+        {
+            if (layout == MULTI_VIEW_STEREO)
+            {
+                ViewCount = 2;
+                int half = width / 2;
+                for (unsigned int v = 0; v < 2; v++)
+                {
+                    // parallel eyes, so the views share every plane but the left and right ones
+                    glm::vec3 eye = camera.Position + camera.Right * (v == 0 ? -0.5f : 0.5f) * MULTI_VIEW_EYE_SEPARATION;
+                    int viewWidth = v == 0 ? half : width - half;
+                    setView(Views[v], glm::lookAt(eye, eye + camera.Front, camera.Up), eye,
+                            glm::perspective(glm::radians(camera.Zoom), (float)viewWidth / (float)height, nearPlane, farPlane),
+                            v == 0 ? 0 : half, 0, viewWidth, height);
+                }
+            }
+            else
+            {
+                ViewCount = 2;
+                int half = height / 2;
+                glm::vec3 eye = camera.Position;
+                setView(Views[0], glm::lookAt(eye, eye + camera.Front, camera.Up), eye,
+                        glm::perspective(glm::radians(camera.Zoom), (float)width / (float)(height - half), nearPlane, farPlane),
+                        0, half, width, height - half);
+                glm::vec3 flatFront = glm::vec3(camera.Front.x, 0.0f, camera.Front.z);
+                flatFront = glm::length(flatFront) > 0.0f ? glm::normalize(flatFront) : glm::vec3(0.0f, 0.0f, -1.0f);
+                glm::vec3 overview = camera.Position + glm::vec3(0.0f, MULTI_VIEW_OVERVIEW_HEIGHT, 0.0f) -
+                                     flatFront * MULTI_VIEW_OVERVIEW_DISTANCE;
+                setView(Views[1], glm::lookAt(overview, camera.Position, glm::vec3(0.0f, 1.0f, 0.0f)), overview,
+                        glm::perspective(glm::radians(45.0f), (float)width / (float)half, nearPlane, farPlane * 2.0f),
+                        0, 0, width, half);
+            }
+            combinePlanes();
+        }
+
+        // bit v set if view v may see the sphere
+        unsigned int Visibility(const glm::vec3 &center, float radius) const
+        {
+            for (unsigned int p = 0; p < 6; p++)
+                if (combinedValid[p] && glm::dot(glm::vec3(combined[p]), center) + combined[p].w < -radius)
+                    return 0;
+            unsigned int mask = 0;
+            for (unsigned int v = 0; v < ViewCount; v++)
+            {
+                bool inside = true;
+                for (unsigned int p = 0; p < 6 && inside; p++)
+                    inside = glm::dot(glm::vec3(planes[v][p]), center) + planes[v][p].w >= -radius;
+                if (inside)
+                    mask |= 1u << v;
+            }
+            return mask;
+        }
+
+        // fills visible with the objects some view sees, by their bounding spheres
+        void Cull(const std::vector<Model*> &models, const std::vector<glm::mat4> &transforms, std::vector<unsigned int> &visible)
+        {
+            visible.clear();
+            masks.clear();
+            masks.reserve(transforms.size());
+            Tested = (unsigned int)transforms.size();
+            Culled = 0;
+            for (unsigned int i = 0; i < transforms.size(); i++)
+            {
+                const Model &model = *models[i];
+                glm::vec3 center = glm::vec3(transforms[i] * glm::vec4((model.BoundsMin + model.BoundsMax) * 0.5f, 1.0f));
+                float radius = glm::length(model.BoundsMax - model.BoundsMin) * 0.5f * glm::length(glm::vec3(transforms[i][0]));
+                unsigned int mask = Visibility(center, radius);
+                if (mask == 0)
+                {
+                    Culled++;
+                    continue;
+                }
+                visible.push_back(i);
+                masks.push_back(mask);
+            }
+        }
+
+        // the view matrices of a MULTI_VIEW shader, which must be in use
+        void SetUniforms(Shader &shader) const
+        {
+            for (unsigned int v = 0; v < ViewCount; v++)
+            {
+                shader.SetMatrix4(FrameMemory().Format("viewProjections[%u]", v), Views[v].ViewProjection);
+                shader.SetVector3f(FrameMemory().Format("viewPositions[%u]", v), Views[v].Position);
+            }
+            shader.SetInteger("viewOffset", 0);
+        }
+
+        // draws the objects Cull() kept into every view that sees them, with a MULTI_VIEW shader in use
+        void Draw(Shader &shader, const std::vector<Model*> &models, const std::vector<glm::mat4> &transforms,
+                  const std::vector<unsigned int> &visible)
+        {
+            DrawCalls = 0;
+            if (ViewportIndex)
+            {
+                for (unsigned int v = 0; v < ViewCount; v++)
+                    GLState().ViewportIndexed(v, Views[v].X, Views[v].Y, Views[v].Width, Views[v].Height);
+                for (unsigned int i = 0; i < visible.size(); i++)
+                {
+                    shader.SetMatrix4("model", transforms[visible[i]]);
+                    models[visible[i]]->DrawInstanced(shader, ViewCount);
+                    DrawCalls++;
+                }
+                return;
+            }
+            for (unsigned int v = 0; v < ViewCount; v++)
+            {
+                GLState().Viewport(Views[v].X, Views[v].Y, Views[v].Width, Views[v].Height);
+                shader.SetInteger("viewOffset", (int)v);
+                for (unsigned int i = 0; i < visible.size(); i++)
+                {
+                    if (!(masks[i] & (1u << v)))
+                        continue;
+                    shader.SetMatrix4("model", transforms[visible[i]]);
+                    models[visible[i]]->Draw(shader);
+                    DrawCalls++;
+                }
+            }
+            shader.SetInteger("viewOffset", 0);
+        }
+
+        // the framebuffer layout as a name, for the stats
+        static const char *LayoutName(MultiViewLayout layout)
+        {
+            return layout == MULTI_VIEW_STEREO ? "stereo" : "split screen";
+        }
+
+    private:
+        const char *extension; // keyword of the viewport index extension, 0 without one
+        glm::vec4 planes[MULTI_VIEW_MAX_VIEWS][6];
+        glm::vec4 combined[6];
+        bool combinedValid[6];
+        std::vector<unsigned int> masks; // per visible object, the views that see it
+
+        void setView(RenderView &view, const glm::mat4 &viewMatrix, const glm::vec3 &position, const glm::mat4 &projection,
+                     int x, int y, int width, int height)
+        {
+            view.View = viewMatrix;
+            view.Projection = projection;
+            view.ViewProjection = projection * viewMatrix;
+            view.Position = position;
+            view.X = x;
+            view.Y = y;
+            view.Width = width;
+            view.Height = height;
+        }
+
+        // the planes of every view (Gribb-Hartmann, normalized), and of the frustum enclosing them all: where all
+        // views have a plane facing the same way, the outermost one; a plane the views don't share bounds nothing
+        void combinePlanes()
+        {
+            for (unsigned int v = 0; v < ViewCount; v++)
+            {
+                const glm::mat4 &m = Views[v].ViewProjection;
+                glm::vec4 rows[4];
+                for (int r = 0; r < 4; r++)
+                    rows[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+                glm::vec4 extracted[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                           rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+                for (int p = 0; p < 6; p++)
+                    planes[v][p] = extracted[p] / glm::length(glm::vec3(extracted[p]));
+            }
+            for (unsigned int p = 0; p < 6; p++)
+            {
+                combined[p] = planes[0][p];
+                combinedValid[p] = ViewCount > 0;
+                for (unsigned int v = 1; v < ViewCount && combinedValid[p]; v++)
+                {
+                    glm::vec3 difference = glm::vec3(planes[v][p]) - glm::vec3(combined[p]);
+                    combinedValid[p] = glm::dot(difference, difference) < MULTI_VIEW_PLANE_EPSILON * MULTI_VIEW_PLANE_EPSILON;
+                    combined[p].w = std::max(combined[p].w, planes[v][p].w);
+                }
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE2
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Default occlusion culling values
+const int OCCLUSION_BUFFER_WIDTH = 256;  // must be a multiple of OCCLUSION_TILE_SIZE
+const int OCCLUSION_BUFFER_HEIGHT = 128; // must be a multiple of OCCLUSION_TILE_SIZE
+const int OCCLUSION_TILE_SIZE = 8;
+const unsigned int OCCLUDER_MAX_TRIANGLES = 256;
+const unsigned int OCCLUDER_MAX_INSTANCES = 4;
+const unsigned int OCCLUSION_MAX_THREADS = 4;
+
+// A simplified version of a model used to occlude others: a subset of its own triangles (the largest
+// ones), which keeps it conservative since it never covers anything the real model doesn't.
+struct OccluderMesh
+{
+    std::vector<glm::vec3> Triangles; // three model space positions per triangle
+};
+
+// Picks the maxTriangles largest triangles of the given meshes (anything exposing vertices[i].Position
+// and indices, like Mesh). Ties are broken by triangle order so the result is deterministic.
+template <typename MeshType>
+OccluderMesh BuildOccluderMesh(const std::vector<MeshType> &meshes, unsigned int maxTriangles = OCCLUDER_MAX_TRIANGLES)
+{
+    struct Candidate
+    {
+        float Area;
+        glm::vec3 A, B, C;
+    };
+    std::vector<Candidate> candidates;
+    for (unsigned int m = 0; m < meshes.size(); m++)
+    {
+        const MeshType &mesh = meshes[m];
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            Candidate candidate;
+            candidate.A = mesh.vertices[mesh.indices[i]].Position;
+            candidate.B = mesh.vertices[mesh.indices[i + 1]].Position;
+            candidate.C = mesh.vertices[mesh.indices[i + 2]].Position;
+            candidate.Area = glm::length(glm::cross(candidate.B - candidate.A, candidate.C - candidate.A));
+            candidates.push_back(candidate);
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate &a, const Candidate &b) { return a.Area > b.Area; });
+    if (candidates.size() > maxTriangles)
+        candidates.resize(maxTriangles);
+
+    OccluderMesh occluder;
+    occluder.Triangles.reserve(candidates.size() * 3);
+    for (unsigned int i = 0; i < candidates.size(); i++)
+    {
+        occluder.Triangles.push_back(candidates[i].A);
+        occluder.Triangles.push_back(candidates[i].B);
+        occluder.Triangles.push_back(candidates[i].C);
+    }
+    return occluder;
+}
+
+// Software occlusion culling: a few occluders are rasterized into a small depth buffer on the CPU and
+// every instance's bounding box is tested against it before any draw call is submitted.
+//  - occluder triangles are written with their farthest vertex depth, so the buffer is never nearer
+//    than the real surface and culling stays conservative;
+//  - rasterization uses SSE2 across 4 pixels and splits the buffer in horizontal bands, one per thread.
+//    Each band is owned by a single thread and depth merging is a min, so results are deterministic.
+//    The band threads are started once and wait between frames, so a frame doesn't allocate;
+//  - a second level keeps the farthest depth of every 8x8 tile, so most tests touch a few tiles only.
+// Depth is z/w remapped to [0, 1], smaller is nearer. Everything runs without a GPU.
+class OcclusionCuller
+{
+    public:
+        unsigned int ThreadCount;
+        // statistics of the last frame
+        unsigned int OccluderTriangleCount;
+        unsigned int TestedCount;
+        unsigned int CulledCount;
+        float RasterTime; // milliseconds
+        float TestTime;   // milliseconds
+
+        OcclusionCuller()
+            : OccluderTriangleCount(0), TestedCount(0), CulledCount(0), RasterTime(0.0f), TestTime(0.0f),
+              bandCount(0), generation(0), pending(0), stopping(false),
+              depth(OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT, 1.0f),
+              tiles((OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_SIZE) * (OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_SIZE), 1.0f)
+        {
+            ThreadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), OCCLUSION_MAX_THREADS));
+            triangles.reserve(OCCLUDER_MAX_INSTANCES * OCCLUDER_MAX_TRIANGLES);
+        }
+
+        ~OcclusionCuller()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+        // clears the occluder list and the statistics for a new frame
+        void BeginFrame(const glm::mat4 &viewProjection)
+        {
+            this->viewProjection = viewProjection;
+            triangles.clear();
+            TestedCount = 0;
+            CulledCount = 0;
+            TestTime = 0.0f;
+        }
+
+        // queues every triangle of an occluder instance; triangles crossing the near plane are dropped,
+        // which is conservative: less occluder coverage can only mean fewer objects culled
+        void AddOccluder(const OccluderMesh &occluder, const glm::mat4 &model)
+        {
+            glm::mat4 mvp = viewProjection * model;
+            for (unsigned int i = 0; i + 2 < occluder.Triangles.size(); i += 3)
+            {
+                ScreenTriangle triangle;
+                bool valid = true;
+                float maxDepth = 0.0f;
+                for (int v = 0; v < 3 && valid; v++)
+                {
+                    glm::vec4 clip = mvp * glm::vec4(occluder.Triangles[i + v], 1.0f);
+                    if (clip.w <= 1e-5f)
+                    {
+                        valid = false;
+                        break;
+                    }
+                    float invW = 1.0f / clip.w;
+                    triangle.X[v] = (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+                    triangle.Y[v] = (clip.y * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+                    maxDepth = std::max(maxDepth, clip.z * invW * 0.5f + 0.5f);
+                }
+                if (!valid || maxDepth > 1.0f)
+                    continue;
+                triangle.Depth = maxDepth;
+                if (setupTriangle(triangle))
+                    triangles.push_back(triangle);
+            }
+        }
+
+        // rasterizes the queued occluders and builds the tile level
+        void RasterizeOccluders()
+        {
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            OccluderTriangleCount = (unsigned int)triangles.size();
+            std::fill(depth.begin(), depth.end(), 1.0f);
+
+            unsigned int bands = std::min(ThreadCount, (unsigned int)(OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_SIZE));
+            int tileRows = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_SIZE;
+            if (bands <= 1)
+                rasterizeBand(0, tileRows);
+            else
+            {
+                // bands are whole tile rows so each thread also builds its own part of the tile level; this thread
+                // takes the first band, the workers the others
+                while (workers.size() + 1 < bands)
+                    workers.push_back(std::thread(&OcclusionCuller::work, this, (unsigned int)workers.size() + 1, generation));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    bandCount = bands;
+                    pending = bands - 1;
+                    generation++;
+                }
+                wake.notify_all();
+                rasterizeBand(0, tileRows / bands);
+                std::unique_lock<std::mutex> lock(mutex);
+                while (pending > 0)
+                    finished.wait(lock);
+            }
+            RasterTime = elapsed(start);
+        }
+
+        // tests a model space bounding box, returns false if it is hidden behind the occluders or off-screen
+        bool IsVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model)
+        {
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            bool visible = testBox(boundsMin, boundsMax, model);
+            TestTime += elapsed(start);
+            TestedCount++;
+            if (!visible)
+                CulledCount++;
+            return visible;
+        }
+
+        // raw access to the depth buffer, row 0 is the bottom of the screen
+        const std::vector<float> &DepthBuffer() const
+        {
+            return depth;
+        }
+
+    private:
+        struct ScreenTriangle
+        {
+            float X[3], Y[3];
+            float Depth;
+            // edge functions E(x, y) = A * x + B * y + C, all >= 0 inside
+            float A[3], B[3], C[3];
+            int MinX, MaxX, MinY, MaxY;
+        };
+
+        glm::mat4 viewProjection;
+        std::vector<ScreenTriangle> triangles;
+        // band workers, woken by a new generation
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        unsigned int bandCount;
+        unsigned int generation;
+        unsigned int pending;
+        bool stopping;
+        std::vector<float> depth;
+        std::vector<float> tiles;
+
+        static float elapsed(std::chrono::high_resolution_clock::time_point start)
+        {
+            return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+
+        // computes edge equations and the pixel bounding box; returns false if nothing can be covered
+        static bool setupTriangle(ScreenTriangle &t)
+        {
+            float area = (t.X[1] - t.X[0]) * (t.Y[2] - t.Y[0]) - (t.X[2] - t.X[0]) * (t.Y[1] - t.Y[0]);
+            if (area == 0.0f)
+                return false;
+            if (area < 0.0f)
+            {
+                // occluders are opaque from both sides, just flip to a consistent winding
+                std::swap(t.X[1], t.X[2]);
+                std::swap(t.Y[1], t.Y[2]);
+            }
+            for (int e = 0; e < 3; e++)
+            {
+                int a = e, b = (e + 1) % 3;
+                t.A[e] = -(t.Y[b] - t.Y[a]);
+                t.B[e] = t.X[b] - t.X[a];
+                t.C[e] = -t.A[e] * t.X[a] - t.B[e] * t.Y[a];
+            }
+            float minX = std::min(t.X[0], std::min(t.X[1], t.X[2]));
+            float maxX = std::max(t.X[0], std::max(t.X[1], t.X[2]));
+            float minY = std::min(t.Y[0], std::min(t.Y[1], t.Y[2]));
+            float maxY = std::max(t.Y[0], std::max(t.Y[1], t.Y[2]));
+            t.MinX = std::max(0, (int)std::floor(minX));
+            t.MaxX = std::min(OCCLUSION_BUFFER_WIDTH - 1, (int)std::floor(maxX));
+            t.MinY = std::max(0, (int)std::floor(minY));
+            t.MaxY = std::min(OCCLUSION_BUFFER_HEIGHT - 1, (int)std::floor(maxY));
+            return t.MinX <= t.MaxX && t.MinY <= t.MaxY;
+        }
+
+        // rasterizes every triangle into the rows of the given tile rows, then updates their tiles
+        // rasterizes its band of every generation after seen that has enough bands
+        void work(unsigned int band, unsigned int seen)
+        {
+            for (;;)
+            {
+                unsigned int bands;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!stopping && generation == seen)
+                        wake.wait(lock);
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    bands = bandCount;
+                }
+                if (band >= bands)
+                    continue;
+                int tileRows = OCCLUSION_BUFFER_HEIGHT / OCCLUSION_TILE_SIZE;
+                rasterizeBand(tileRows * band / bands, tileRows * (band + 1) / bands);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    finished.notify_one();
+            }
+        }
+
+        void rasterizeBand(int firstTileRow, int lastTileRow)
+        {
+            int bandMinY = firstTileRow * OCCLUSION_TILE_SIZE;
+            int bandMaxY = lastTileRow * OCCLUSION_TILE_SIZE - 1;
+            for (unsigned int i = 0; i < triangles.size(); i++)
+            {
+                const ScreenTriangle &t = triangles[i];
+                int minY = std::max(t.MinY, bandMinY);
+                int maxY = std::min(t.MaxY, bandMaxY);
+                int minX = t.MinX & ~3; // rows are processed 4 pixels at a time
+                for (int y = minY; y <= maxY; y++)
+                    rasterizeRow(t, y, minX, t.MaxX);
+            }
+
+            int tilesPerRow = OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_SIZE;
+            for (int ty = firstTileRow; ty < lastTileRow; ty++)
+            {
+                for (int tx = 0; tx < tilesPerRow; tx++)
+                {
+                    float farthest = 0.0f;
+                    for (int y = ty * OCCLUSION_TILE_SIZE; y < (ty + 1) * OCCLUSION_TILE_SIZE; y++)
+                    {
+                        const float *row = &depth[y * OCCLUSION_BUFFER_WIDTH + tx * OCCLUSION_TILE_SIZE];
+                        for (int x = 0; x < OCCLUSION_TILE_SIZE; x++)
+                            farthest = std::max(farthest, row[x]);
+                    }
+                    tiles[ty * tilesPerRow + tx] = farthest;
+                }
+            }
+        }
+
+        void rasterizeRow(const ScreenTriangle &t, int y, int minX, int maxX)
+        {
+            float *row = &depth[y * OCCLUSION_BUFFER_WIDTH];
+            float py = y + 0.5f;
+            float rowE0 = t.B[0] * py + t.C[0];
+            float rowE1 = t.B[1] * py + t.C[1];
+            float rowE2 = t.B[2] * py + t.C[2];
+#ifdef OCCLUSION_CULLER_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 triangleDepth = _mm_set1_ps(t.Depth);
+            const __m128 a0 = _mm_set1_ps(t.A[0]), a1 = _mm_set1_ps(t.A[1]), a2 = _mm_set1_ps(t.A[2]);
+            const __m128 r0 = _mm_set1_ps(rowE0), r1 = _mm_set1_ps(rowE1), r2 = _mm_set1_ps(rowE2);
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_set_ps(x + 3.5f, x + 2.5f, x + 1.5f, x + 0.5f);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(current, triangleDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+            }
+#else
+            for (int x = minX; x <= maxX; x++)
+            {
+                float px = x + 0.5f;
+                if (t.A[0] * px + rowE0 >= 0.0f && t.A[1] * px + rowE1 >= 0.0f && t.A[2] * px + rowE2 >= 0.0f)
+                    row[x] = std::min(row[x], t.Depth);
+            }
+#endif
+        }
+
+        bool testBox(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &model) const
+        {
+            glm::mat4 mvp = viewProjection * model;
+            float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+            for (int c = 0; c < 8; c++)
+            {
+                glm::vec3 corner((c & 1) ? boundsMax.x : boundsMin.x,
+                                 (c & 2) ? boundsMax.y : boundsMin.y,
+                                 (c & 4) ? boundsMax.z : boundsMin.z);
+                glm::vec4 clip = mvp * glm::vec4(corner, 1.0f);
+                if (clip.w <= 1e-5f)
+                    return true; // crosses the near plane, too close to reason about
+                float invW = 1.0f / clip.w;
+                float x = (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_WIDTH;
+                float y = (clip.y * invW * 0.5f + 0.5f) * OCCLUSION_BUFFER_HEIGHT;
+                minX = std::min(minX, x);
+                maxX = std::max(maxX, x);
+                minY = std::min(minY, y);
+                maxY = std::max(maxY, y);
+                nearest = std::min(nearest, clip.z * invW * 0.5f + 0.5f);
+            }
+            // outside the view frustum
+            if (maxX < 0.0f || maxY < 0.0f || minX >= OCCLUSION_BUFFER_WIDTH || minY >= OCCLUSION_BUFFER_HEIGHT || nearest > 1.0f)
+                return false;
+
+            int x0 = std::max(0, (int)std::floor(minX));
+            int x1 = std::min(OCCLUSION_BUFFER_WIDTH - 1, (int)std::floor(maxX));
+            int y0 = std::max(0, (int)std::floor(minY));
+            int y1 = std::min(OCCLUSION_BUFFER_HEIGHT - 1, (int)std::floor(maxY));
+            int tilesPerRow = OCCLUSION_BUFFER_WIDTH / OCCLUSION_TILE_SIZE;
+            for (int ty = y0 / OCCLUSION_TILE_SIZE; ty <= y1 / OCCLUSION_TILE_SIZE; ty++)
+            {
+                for (int tx = x0 / OCCLUSION_TILE_SIZE; tx <= x1 / OCCLUSION_TILE_SIZE; tx++)
+                {
+                    // the whole tile is nearer than the box: this part is hidden
+                    if (tiles[ty * tilesPerRow + tx] < nearest)
+                        continue;
+                    int py0 = std::max(y0, ty * OCCLUSION_TILE_SIZE), py1 = std::min(y1, (ty + 1) * OCCLUSION_TILE_SIZE - 1);
+                    int px0 = std::max(x0, tx * OCCLUSION_TILE_SIZE), px1 = std::min(x1, (tx + 1) * OCCLUSION_TILE_SIZE - 1);
+                    for (int y = py0; y <= py1; y++)
+                        for (int x = px0; x <= px1; x++)
+                            if (depth[y * OCCLUSION_BUFFER_WIDTH + x] >= nearest)
+                                return true;
+                }
+            }
+            return false;
+        }
+};
+#endif
@@ -0,0 +1,269 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <unordered_map>
+
+// Default render statistics values
+const unsigned int RENDER_STATS_WINDOW = 120; // frames the rolling aggregates cover
+
+// The work a frame submits, counted where the GL calls are made
+enum RenderCounter
+{
+    STAT_DRAW_CALLS,          // a multi-draw counts once
+    STAT_TRIANGLES,           // of the draws whose size the CPU knows, the GPU-driven indirect draws aren't included
+    STAT_DISPATCHES,          // compute
+    STAT_TEXTURE_BINDS,       // reaching the driver, see GLStateCache
+    STAT_PROGRAM_SWITCHES,    // reaching the driver
+    STAT_UNIFORM_UPLOADS,     // glUniform* calls
+    STAT_BUFFER_BYTES,        // uploaded to buffers
+    STAT_TEXTURE_BYTES,       // uploaded to textures, the base level of the images
+    RENDER_COUNTER_COUNT
+};
+
+// What the video memory is spent on
+enum GpuMemoryCategory
+{
+    GPU_MEMORY_MESHES,          // vertex and index buffers, including the GPU-driven path's merged copy
+    GPU_MEMORY_TEXTURES,        // material textures
+    GPU_MEMORY_RENDER_TARGETS,  // the frame graph's textures: G-buffer, depth, scene color
+    GPU_MEMORY_OTHER,           // culling buffers, depth pyramid, irradiance grid, helper geometry
+    GPU_MEMORY_CATEGORY_COUNT
+};
+
+// Estimated video memory of a mipmapped texture: drivers store 4 bytes per texel, plus a third for the mips
+inline size_t EstimatedTextureBytes(int width, int height)
+{
+    return (size_t)width * height * 4 * 4 / 3;
+}
+
+// Always-on counters of the work every frame submits, kept over the last RENDER_STATS_WINDOW frames, and the video
+// memory of every buffer and texture the engine creates, a texture as EstimatedTextureBytes() unless its format says
+// otherwise, a buffer the size of its data store.
+// Counting is an add on the render thread; with a metrics file open, WriteMetrics() appends the aggregates as one
+// JSON object per line.
+class RenderStatistics
+{
+    public:
+        uint64_t Frame[RENDER_COUNTER_COUNT];       // counted since the last EndFrame()
+        size_t Memory[GPU_MEMORY_CATEGORY_COUNT];   // bytes currently allocated
+        uint64_t FrameCount;
+
+        RenderStatistics()
+            : FrameCount(0), frameTimeSum(0.0), metrics(0)
+        {
+            for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+            {
+                Frame[c] = 0;
+                sums[c] = 0;
+                for (unsigned int f = 0; f < RENDER_STATS_WINDOW; f++)
+                    history[f][c] = 0;
+            }
+            for (unsigned int m = 0; m < GPU_MEMORY_CATEGORY_COUNT; m++)
+                Memory[m] = 0;
+            for (unsigned int f = 0; f < RENDER_STATS_WINDOW; f++)
+                frameTimes[f] = 0.0f;
+        }
+
+        ~RenderStatistics()
+        {
+            CloseMetrics();
+        }
+
+        static const char *CounterName(RenderCounter counter)
+        {
+            static const char *names[RENDER_COUNTER_COUNT] = { "draw_calls", "triangles", "dispatches", "texture_binds",
+                                                               "program_switches", "uniform_uploads", "buffer_bytes",
+                                                               "texture_bytes" };
+            return names[counter];
+        }
+
+        static const char *MemoryName(GpuMemoryCategory category)
+        {
+            static const char *names[GPU_MEMORY_CATEGORY_COUNT] = { "meshes", "textures", "render_targets", "other" };
+            return names[category];
+        }
+
+        void Count(RenderCounter counter, uint64_t amount = 1)
+        {
+            Frame[counter] += amount;
+        }
+
+        // a draw call of that many triangles
+        void Draw(uint64_t triangles)
+        {
+            Frame[STAT_DRAW_CALLS]++;
+            Frame[STAT_TRIANGLES] += triangles;
+        }
+
+        // the data store of a buffer was (re)allocated
+        void BufferAllocated(GLuint id, GpuMemoryCategory category, size_t bytes)
+        {
+            allocate(buffers, id, category, bytes);
+        }
+
+        // the storage of a texture was (re)allocated, all its levels
+        void TextureAllocated(GLuint id, GpuMemoryCategory category, size_t bytes)
+        {
+            allocate(textures, id, category, bytes);
+        }
+
+        // called by GLStateCache when it deletes them
+        void BufferDeleted(GLuint id)
+        {
+            release(buffers, id);
+        }
+
+        void TextureDeleted(GLuint id)
+        {
+            release(textures, id);
+        }
+
+        size_t TotalMemory() const
+        {
+            size_t total = 0;
+            for (unsigned int m = 0; m < GPU_MEMORY_CATEGORY_COUNT; m++)
+                total += Memory[m];
+            return total;
+        }
+
+        // closes the frame: its counters join the rolling window and start again from zero
+        void EndFrame(float milliseconds)
+        {
+            unsigned int slot = (unsigned int)(FrameCount % RENDER_STATS_WINDOW);
+            for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+            {
+                sums[c] += Frame[c] - history[slot][c];
+                history[slot][c] = Frame[c];
+                Frame[c] = 0;
+            }
+            frameTimeSum += milliseconds - frameTimes[slot];
+            frameTimes[slot] = milliseconds;
+            FrameCount++;
+        }
+
+        // aggregates over the frames of the window, the last one ended included
+        uint64_t Last(RenderCounter counter) const
+        {
+            return FrameCount > 0 ? history[(FrameCount - 1) % RENDER_STATS_WINDOW][counter] : 0;
+        }
+
+        double Mean(RenderCounter counter) const
+        {
+            return windowFrames() > 0 ? (double)sums[counter] / windowFrames() : 0.0;
+        }
+
+        uint64_t Max(RenderCounter counter) const
+        {
+            uint64_t max = 0;
+            for (unsigned int f = 0; f < windowFrames(); f++)
+                max = std::max(max, history[f][counter]);
+            return max;
+        }
+
+        double MeanFrameTime() const
+        {
+            return windowFrames() > 0 ? frameTimeSum / windowFrames() : 0.0;
+        }
+
+        float MaxFrameTime() const
+        {
+            float max = 0.0f;
+            for (unsigned int f = 0; f < windowFrames(); f++)
+                max = std::max(max, frameTimes[f]);
+            return max;
+        }
+
+        // starts a metrics file, replacing it; false if it can't be written
+        bool OpenMetrics(const char *path)
+        {
+            CloseMetrics();
+            metrics = std::fopen(path, "w");
+            if (!metrics)
+            {
+                std::cout << "ERROR::RENDER_STATS: can't write " << path << std::endl;
+                return false;
+            }
+            // buffered in place, so that writing never touches the heap during a frame
+            std::setvbuf(metrics, metricsBuffer, _IOFBF, sizeof(metricsBuffer));
+            return true;
+        }
+
+        void CloseMetrics()
+        {
+            if (metrics)
+                std::fclose(metrics);
+            metrics = 0;
+        }
+
+        // appends a line with the rolling aggregates and the memory, if a metrics file is open; time in seconds
+        void WriteMetrics(double time)
+        {
+            if (!metrics)
+                return;
+            std::fprintf(metrics, "{\"time\": %.3f, \"frames\": %llu, \"window\": %u, \"frame_ms\": {\"mean\": %.3f, \"max\": %.3f}",
+                         time, (unsigned long long)FrameCount, windowFrames(), MeanFrameTime(), MaxFrameTime());
+            for (unsigned int c = 0; c < RENDER_COUNTER_COUNT; c++)
+                std::fprintf(metrics, ", \"%s\": {\"last\": %llu, \"mean\": %.1f, \"max\": %llu}", CounterName((RenderCounter)c),
+                             (unsigned long long)Last((RenderCounter)c), Mean((RenderCounter)c), (unsigned long long)Max((RenderCounter)c));
+            std::fprintf(metrics, ", \"gpu_memory_bytes\": {");
+            for (unsigned int m = 0; m < GPU_MEMORY_CATEGORY_COUNT; m++)
+                std::fprintf(metrics, "\"%s\": %llu, ", MemoryName((GpuMemoryCategory)m), (unsigned long long)Memory[m]);
+            std::fprintf(metrics, "\"total\": %llu}}\n", (unsigned long long)TotalMemory());
+            std::fflush(metrics);
+        }
+
+    private:
+        struct Allocation
+        {
+            GpuMemoryCategory Category;
+            size_t Bytes;
+        };
+
+        uint64_t history[RENDER_STATS_WINDOW][RENDER_COUNTER_COUNT];
+        uint64_t sums[RENDER_COUNTER_COUNT];
+        float frameTimes[RENDER_STATS_WINDOW];
+        double frameTimeSum;
+        std::unordered_map<GLuint, Allocation> buffers;
+        std::unordered_map<GLuint, Allocation> textures;
+        std::FILE *metrics;
+        char metricsBuffer[4096];
+
+        unsigned int windowFrames() const
+        {
+            return (unsigned int)std::min<uint64_t>(FrameCount, RENDER_STATS_WINDOW);
+        }
+
+        // a reallocated object keeps its entry, only the sizes change
+        void allocate(std::unordered_map<GLuint, Allocation> &objects, GLuint id, GpuMemoryCategory category, size_t bytes)
+        {
+            Allocation initial = { category, 0 };
+            Allocation &entry = objects.insert(std::make_pair(id, initial)).first->second;
+            Memory[entry.Category] -= entry.Bytes;
+            entry.Category = category;
+            entry.Bytes = bytes;
+            Memory[category] += bytes;
+        }
+
+        void release(std::unordered_map<GLuint, Allocation> &objects, GLuint id)
+        {
+            std::unordered_map<GLuint, Allocation>::iterator found = objects.find(id);
+            if (found == objects.end())
+                return;
+            Memory[found->second.Category] -= found->second.Bytes;
+            objects.erase(found);
+        }
+};
+
+inline RenderStatistics &RenderStats()
+{
+    static RenderStatistics statistics;
+    return statistics;
+}
+
+#endif
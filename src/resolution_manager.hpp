@@ -0,0 +1,171 @@
+#ifndef RESOLUTION_MANAGER_H
+#define RESOLUTION_MANAGER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frame_graph.hpp"
+#include "gpu_query.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Default dynamic resolution values
+const float RESOLUTION_TARGET_GPU_TIME = 12.0f; // milliseconds spent in the geometry + lighting passes
+const float RESOLUTION_MIN_SCALE = 0.5f;
+const float RESOLUTION_MAX_SCALE = 1.0f;
+const float RESOLUTION_SCALE_STEP = 0.05f;
+const unsigned int RESOLUTION_HISTORY_SIZE = 300;
+
+// Decides at which fraction of the framebuffer size the deferred shading passes are rendered.
+// Render targets are sized at the full framebuffer size (see RenderTargetDesc) and only change on
+// resize: a lower scale simply renders into a smaller viewport of them, which the upscale pass then
+// stretches back over the whole backbuffer.
+class ResolutionManager
+{
+    public:
+        // framebuffer size in pixels (larger than the window size on HiDPI displays)
+        int FramebufferWidth, FramebufferHeight;
+        // size the geometry and lighting passes are rendered at this frame
+        int RenderWidth, RenderHeight;
+        float Scale;
+        // controller options
+        bool DynamicScaling;
+        float TargetGpuTime;
+        float MinScale;
+        float MaxScale;
+
+        ResolutionManager()
+            : FramebufferWidth(0), FramebufferHeight(0), RenderWidth(0), RenderHeight(0), Scale(RESOLUTION_MAX_SCALE),
+              DynamicScaling(true), TargetGpuTime(RESOLUTION_TARGET_GPU_TIME), MinScale(RESOLUTION_MIN_SCALE), MaxScale(RESOLUTION_MAX_SCALE),
+              historyStart(0)
+        {
+            // recorded every rendered frame, they mustn't grow in one
+            scaleHistory.reserve(RESOLUTION_HISTORY_SIZE);
+            gpuTimeHistory.reserve(RESOLUTION_HISTORY_SIZE);
+        }
+
+        // must be called once a context is current
+        void Init(int width, int height)
+        {
+            timer.Init();
+            Resize(width, height);
+        }
+
+        // returns true if the framebuffer size changed and render targets must be recreated
+        bool Resize(int width, int height)
+        {
+            if (width <= 0 || height <= 0) // minimized window
+                return false;
+            if (width == FramebufferWidth && height == FramebufferHeight)
+                return false;
+            FramebufferWidth = width;
+            FramebufferHeight = height;
+            updateRenderSize();
+            return true;
+        }
+
+        // description of a render target covering the whole framebuffer
+        FrameGraphTextureDesc RenderTargetDesc(GLenum internalFormat, GLint filter = GL_NEAREST) const
+        {
+            FrameGraphTextureDesc desc;
+            desc.Width = FramebufferWidth;
+            desc.Height = FramebufferHeight;
+            desc.InternalFormat = internalFormat;
+            desc.Filter = filter;
+            return desc;
+        }
+
+        // starts timing the passes rendered at the scaled resolution
+        void BeginFrame()
+        {
+            timer.Begin();
+        }
+
+        // stops timing and, once a new GPU measurement is available, adjusts the scale for the next frames
+        void EndFrame()
+        {
+            if (!timer.End())
+                return;
+            if (DynamicScaling)
+            {
+                // the cost of the passes is roughly proportional to the pixel count, hence the square root
+                float gpuTime = glm::max(timer.Milliseconds(), 0.01f);
+                float ideal = Scale * std::sqrt(TargetGpuTime / gpuTime);
+                // hysteresis: only move when we are clearly over budget or have plenty of headroom
+                if (gpuTime > TargetGpuTime || gpuTime < TargetGpuTime * 0.8f)
+                {
+                    // move at most one step per measurement and snap to the step grid to avoid jitter
+                    float next = ideal < Scale ? Scale - RESOLUTION_SCALE_STEP : Scale + RESOLUTION_SCALE_STEP;
+                    next = std::floor(next / RESOLUTION_SCALE_STEP + 0.5f) * RESOLUTION_SCALE_STEP;
+                    Scale = glm::clamp(next, MinScale, MaxScale);
+                }
+            }
+            else
+                Scale = MaxScale;
+            record(timer.Milliseconds());
+            updateRenderSize();
+        }
+
+        // GPU time of the last measured frame
+        float GpuTime() const
+        {
+            return timer.Milliseconds();
+        }
+
+        // scale factors of the last RESOLUTION_HISTORY_SIZE measurements, oldest first
+        std::vector<float> ScaleHistory() const
+        {
+            return unroll(scaleHistory);
+        }
+
+        // GPU times matching ScaleHistory(), oldest first
+        std::vector<float> GpuTimeHistory() const
+        {
+            return unroll(gpuTimeHistory);
+        }
+
+        // scale applied to full-screen quad texture coordinates to sample the rendered sub-rectangle
+        glm::vec2 UVScale() const
+        {
+            return glm::vec2((float)RenderWidth / FramebufferWidth, (float)RenderHeight / FramebufferHeight);
+        }
+
+    private:
+        GpuTimer timer;
+        std::vector<float> scaleHistory;
+        std::vector<float> gpuTimeHistory;
+        unsigned int historyStart;
+
+        void updateRenderSize()
+        {
+            RenderWidth = std::max(1, (int)(FramebufferWidth * Scale + 0.5f));
+            RenderHeight = std::max(1, (int)(FramebufferHeight * Scale + 0.5f));
+        }
+
+        // ring buffers of RESOLUTION_HISTORY_SIZE entries
+        void record(float gpuTime)
+        {
+            if (scaleHistory.size() < RESOLUTION_HISTORY_SIZE)
+            {
+                scaleHistory.push_back(Scale);
+                gpuTimeHistory.push_back(gpuTime);
+                return;
+            }
+            scaleHistory[historyStart] = Scale;
+            gpuTimeHistory[historyStart] = gpuTime;
+            historyStart = (historyStart + 1) % RESOLUTION_HISTORY_SIZE;
+        }
+
+        std::vector<float> unroll(const std::vector<float> &ring) const
+        {
+            std::vector<float> ordered;
+            ordered.reserve(ring.size());
+            for (unsigned int i = 0; i < ring.size(); i++)
+                ordered.push_back(ring[(historyStart + i) % ring.size()]);
+            return ordered;
+        }
+};
+#endif
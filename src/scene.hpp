@@ -0,0 +1,240 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Default scene values
+const float SCENE_CELL_SIZE = 16.0f;
+
+struct SceneModel
+{
+    std::string Name;
+    std::string Path; // relative to the working directory, like every other asset path
+};
+
+struct SceneInstance
+{
+    unsigned int Model; // index into Scene::Models
+    glm::vec3 Position;
+    float Scale;
+    bool Rotate;        // spins around its own axis
+};
+
+struct SceneLight
+{
+    glm::vec3 Position;
+    glm::vec3 Color;
+    bool Static;        // never moves or changes, its diffuse light is baked (IrradianceGrid)
+};
+
+// Square column of the world, CellSize wide on the XZ plane; the unit of streaming
+struct SceneCell
+{
+    int X;
+    int Z;
+    glm::vec3 Center;
+    std::vector<unsigned int> Instances;
+    std::vector<unsigned int> Lights;
+    std::vector<unsigned int> Models; // distinct models used by the instances
+};
+
+// A world description loaded from a text file, one statement per line ('#' starts a comment):
+//
+//   cell_size 16
+//   model ship ../assets/models/SF_Light-Fighter_X6/SF_Light_Fighter-X6.obj
+//   instance ship -5 0 -8 0.05 rotate      (model x y z scale [rotate])
+//   light -2.4 3.1 0.7 0.45 0.3 0.6 static (x y z r g b [static])
+//
+// Instances and lights are partitioned into cells by position when the file is loaded.
+class Scene
+{
+    public:
+        float CellSize;
+        std::vector<SceneModel> Models;
+        std::vector<SceneInstance> Instances;
+        std::vector<SceneLight> Lights;
+        std::vector<SceneCell> Cells;
+
+        Scene()
+            : CellSize(SCENE_CELL_SIZE)
+        {
+        }
+
+        bool Load(const std::string &path)
+        {
+            std::ifstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::SCENE: can't open " << path << std::endl;
+                return false;
+            }
+            Models.clear();
+            Instances.clear();
+            Lights.clear();
+            CellSize = SCENE_CELL_SIZE;
+            std::map<std::string, unsigned int> modelIndices;
+
+            std::string line;
+            unsigned int lineNumber = 0;
+            while (std::getline(file, line))
+            {
+                lineNumber++;
+                line = line.substr(0, line.find('#'));
+                std::istringstream in(line);
+                std::string keyword;
+                if (!(in >> keyword))
+                    continue; // blank line
+                bool ok = true;
+                if (keyword == "cell_size")
+                    ok = (in >> CellSize) && CellSize > 0.0f;
+                else if (keyword == "model")
+                {
+                    SceneModel model;
+                    ok = (in >> model.Name >> model.Path) && !modelIndices.count(model.Name);
+                    if (ok)
+                    {
+                        modelIndices[model.Name] = (unsigned int)Models.size();
+                        Models.push_back(model);
+                    }
+                }
+                else if (keyword == "instance")
+                {
+                    std::string name, flag;
+                    SceneInstance instance;
+                    ok = (in >> name >> instance.Position.x >> instance.Position.y >> instance.Position.z >> instance.Scale)
+                         && modelIndices.count(name);
+                    if (ok)
+                    {
+                        instance.Model = modelIndices[name];
+                        instance.Rotate = (in >> flag) && flag == "rotate";
+                        Instances.push_back(instance);
+                    }
+                }
+                else if (keyword == "light")
+                {
+                    std::string flag;
+                    SceneLight light;
+                    ok = (bool)(in >> light.Position.x >> light.Position.y >> light.Position.z
+                                   >> light.Color.x >> light.Color.y >> light.Color.z);
+                    if (ok)
+                    {
+                        light.Static = (in >> flag) && flag == "static";
+                        Lights.push_back(light);
+                    }
+                }
+                else
+                    ok = false;
+                if (!ok)
+                {
+                    std::cout << "ERROR::SCENE: " << path << ":" << lineNumber << ": can't parse '" << line << "'" << std::endl;
+                    return false;
+                }
+            }
+            Partition();
+            return true;
+        }
+
+        bool Save(const std::string &path) const
+        {
+            std::ofstream file(path.c_str());
+            if (!file)
+            {
+                std::cout << "ERROR::SCENE: can't write " << path << std::endl;
+                return false;
+            }
+            file << "cell_size " << CellSize << "\n";
+            for (unsigned int i = 0; i < Models.size(); i++)
+                file << "model " << Models[i].Name << " " << Models[i].Path << "\n";
+            for (unsigned int i = 0; i < Instances.size(); i++)
+            {
+                const SceneInstance &instance = Instances[i];
+                file << "instance " << Models[instance.Model].Name << " " << instance.Position.x << " " << instance.Position.y
+                     << " " << instance.Position.z << " " << instance.Scale << (instance.Rotate ? " rotate" : "") << "\n";
+            }
+            for (unsigned int i = 0; i < Lights.size(); i++)
+                file << "light " << Lights[i].Position.x << " " << Lights[i].Position.y << " " << Lights[i].Position.z << " "
+                     << Lights[i].Color.x << " " << Lights[i].Color.y << " " << Lights[i].Color.z
+                     << (Lights[i].Static ? " static" : "") << "\n";
+            return (bool)file;
+        }
+
+        // groups instances and lights into cells of CellSize, cells without content are not created
+        void Partition()
+        {
+            Cells.clear();
+            std::map<std::pair<int, int>, unsigned int> cellIndices;
+            for (unsigned int i = 0; i < Instances.size(); i++)
+            {
+                SceneCell &cell = cellAt(Instances[i].Position, cellIndices);
+                cell.Instances.push_back(i);
+                if (std::find(cell.Models.begin(), cell.Models.end(), Instances[i].Model) == cell.Models.end())
+                    cell.Models.push_back(Instances[i].Model);
+            }
+            for (unsigned int i = 0; i < Lights.size(); i++)
+                cellAt(Lights[i].Position, cellIndices).Lights.push_back(i);
+        }
+
+        // a size x size grid of instances, spacing units apart, cycling through the given models, with a light
+        // every lightEvery instances (static ones); meant to stress the streaming with worlds larger than the budgets
+        static Scene Generate(unsigned int size, float spacing, const std::vector<SceneModel> &models, float scale,
+                              unsigned int lightEvery, unsigned int seed)
+        {
+            Scene scene;
+            scene.Models = models;
+            srand(seed);
+            float origin = -0.5f * spacing * (size - 1);
+            for (unsigned int z = 0; z < size; z++)
+            {
+                for (unsigned int x = 0; x < size; x++)
+                {
+                    SceneInstance instance;
+                    instance.Model = (x + z * size) % (unsigned int)models.size();
+                    instance.Position = glm::vec3(origin + x * spacing, 0.0f, origin + z * spacing);
+                    instance.Scale = scale;
+                    instance.Rotate = (rand() % 2) == 0;
+                    scene.Instances.push_back(instance);
+                    if (lightEvery > 0 && scene.Instances.size() % lightEvery == 0)
+                    {
+                        SceneLight light;
+                        light.Position = instance.Position + glm::vec3(((rand() % 100) / 100.0f) * spacing - 0.5f * spacing,
+                                                                       ((rand() % 100) / 100.0f) * 4.0f + 1.0f,
+                                                                       ((rand() % 100) / 100.0f) * spacing - 0.5f * spacing);
+                        light.Color = glm::vec3(((rand() % 100) / 200.0f) + 0.2f, ((rand() % 100) / 200.0f) + 0.2f,
+                                                ((rand() % 100) / 200.0f) + 0.2f);
+                        light.Static = true;
+                        scene.Lights.push_back(light);
+                    }
+                }
+            }
+            scene.Partition();
+            return scene;
+        }
+
+    private:
+        SceneCell &cellAt(const glm::vec3 &position, std::map<std::pair<int, int>, unsigned int> &cellIndices)
+        {
+            std::pair<int, int> key((int)std::floor(position.x / CellSize), (int)std::floor(position.z / CellSize));
+            std::map<std::pair<int, int>, unsigned int>::iterator found = cellIndices.find(key);
+            if (found != cellIndices.end())
+                return Cells[found->second];
+            SceneCell cell;
+            cell.X = key.first;
+            cell.Z = key.second;
+            cell.Center = glm::vec3((key.first + 0.5f) * CellSize, 0.0f, (key.second + 0.5f) * CellSize);
+            cellIndices[key] = (unsigned int)Cells.size();
+            Cells.push_back(cell);
+            return Cells.back();
+        }
+};
+#endif
@@ -0,0 +1,334 @@
+#ifndef SCENE_STREAMER_H
+#define SCENE_STREAMER_H
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+#include "model_loader.hpp"
+#include "scene.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Default streaming values
+const float STREAMING_RADIUS = 48.0f;
+const size_t STREAMING_CPU_BUDGET = 512 * 1024 * 1024;
+const size_t STREAMING_GPU_BUDGET = 512 * 1024 * 1024;
+
+// An instance of a resident cell, ready to be drawn
+struct StreamedInstance
+{
+    const SceneInstance *Instance;
+    unsigned int ModelIndex; // into Scene::Models
+    Model *Loaded;
+};
+
+// An instance of a wanted cell that isn't resident yet, drawn as its model's bounding box meanwhile
+struct StreamedPlaceholder
+{
+    const SceneInstance *Instance;
+    unsigned int ModelIndex;
+    glm::vec3 BoundsMin;    // model space
+    glm::vec3 BoundsMax;
+    float Progress;         // of its model's upload
+};
+
+// Keeps the cells of a Scene around the viewer loaded. Cells are wanted nearest first until the streaming radius
+// or one of the memory budgets is reached; the models they use are loaded by a ModelLoader, nearest first, within
+// its per-frame upload budget. A cell becomes resident once all its models are; models no wanted cell uses any
+// more are released. Budgets are checked against the measured size of a model, which is only known after it has
+// been imported once: the first import of a model is always allowed.
+class SceneStreamer
+{
+    public:
+        float Radius;
+        size_t CpuBudget;
+        size_t GpuBudget;
+
+        // statistics of the last Update()
+        unsigned int WantedCells;
+        unsigned int ResidentCells;
+        unsigned int ResidentModels;
+        unsigned int LoadsInFlight;   // queued, importing or waiting for upload
+        size_t CpuBytes;
+        size_t GpuBytes;
+        bool BudgetLimited;           // some cells within the radius were left out to stay within the budgets
+        // totals
+        unsigned int Uploads;
+        unsigned int Releases;
+
+        SceneStreamer(const Scene &scene, unsigned int threads = MODEL_LOADER_THREADS)
+            : Radius(STREAMING_RADIUS), CpuBudget(STREAMING_CPU_BUDGET), GpuBudget(STREAMING_GPU_BUDGET),
+              WantedCells(0), ResidentCells(0), ResidentModels(0), LoadsInFlight(0), CpuBytes(0), GpuBytes(0),
+              BudgetLimited(false), Uploads(0), Releases(0), scene(scene), models(scene.Models.size()), changed(true),
+              loader(threads)
+        {
+            // the cell lists are rebuilt every Update(), sized once so that moving around doesn't allocate
+            candidates.reserve(scene.Cells.size());
+            wanted.reserve(scene.Cells.size());
+            resident.reserve(scene.Cells.size());
+            previousResident.reserve(scene.Cells.size());
+        }
+
+        ~SceneStreamer()
+        {
+            // the handles go before the loader
+            models.clear();
+        }
+
+        // decides what should be loaded around the viewer and lets the loader make progress.
+        // Must be called once per frame on the thread owning the GL context.
+        void Update(const glm::vec3 &viewer)
+        {
+            measureModels();
+            selectCells(viewer);
+            updateModels();
+            loader.Update();
+            gatherResident();
+        }
+
+        // loads the models; its UploadBudget is the time spent creating GL objects per frame
+        ModelLoader &Loader()
+        {
+            return loader;
+        }
+
+        // true if the resident instances (and thus the set of uploaded models) changed during the last Update()
+        bool Changed() const
+        {
+            return changed;
+        }
+
+        // instances of the resident cells
+        const std::vector<StreamedInstance> &Instances() const
+        {
+            return instances;
+        }
+
+        // lights of the resident cells, indices into Scene::Lights
+        const std::vector<unsigned int> &Lights() const
+        {
+            return lights;
+        }
+
+        // instances of the wanted cells that aren't resident yet and whose model has been imported once
+        const std::vector<StreamedPlaceholder> &Placeholders() const
+        {
+            return placeholders;
+        }
+
+        // uploaded model of Scene::Models[index], or 0
+        Model *Resident(unsigned int index) const
+        {
+            return models[index].Handle ? models[index].Handle->Get() : 0;
+        }
+
+    private:
+        struct ModelSlot
+        {
+            ModelHandle Handle;         // while wanted
+            bool Wanted;
+            float Priority;             // distance of the nearest wanted cell using it
+            // measured at its first import, kept while unloaded
+            bool Measured;
+            size_t CpuBytes;            // once resident
+            size_t GpuBytes;
+            glm::vec3 BoundsMin;
+            glm::vec3 BoundsMax;
+            ModelSlot() : Wanted(false), Priority(0.0f), Measured(false), CpuBytes(0), GpuBytes(0), BoundsMin(0.0f), BoundsMax(0.0f) {}
+        };
+
+        const Scene &scene;
+        std::vector<ModelSlot> models;
+        std::vector<std::pair<float, unsigned int> > candidates; // distance, cell
+        std::vector<unsigned int> wanted;                        // cells, nearest first
+        std::vector<unsigned int> resident;                      // cells
+        std::vector<unsigned int> previousResident;              // scratch
+        std::vector<StreamedInstance> instances;
+        std::vector<unsigned int> lights;
+        std::vector<StreamedPlaceholder> placeholders;
+        bool changed;
+        ModelLoader loader;
+
+        // sizes and bounds of the models imported since the last frame
+        void measureModels()
+        {
+            for (unsigned int i = 0; i < models.size(); i++)
+            {
+                ModelSlot &slot = models[i];
+                if (slot.Measured || !slot.Handle || !slot.Handle->HasBounds)
+                    continue;
+                slot.Measured = true;
+                slot.CpuBytes = slot.Handle->ImportedCpuBytes;
+                slot.GpuBytes = slot.Handle->ImportedGpuBytes;
+                slot.BoundsMin = slot.Handle->BoundsMin;
+                slot.BoundsMax = slot.Handle->BoundsMax;
+            }
+        }
+
+        // wants cells nearest first while the measured sizes of their models fit the budgets
+        void selectCells(const glm::vec3 &viewer)
+        {
+            candidates.clear();
+            float halfDiagonal = scene.CellSize * 0.7071f;
+            for (unsigned int i = 0; i < scene.Cells.size(); i++)
+            {
+                glm::vec2 offset(scene.Cells[i].Center.x - viewer.x, scene.Cells[i].Center.z - viewer.z);
+                float distance = std::max(glm::length(offset) - halfDiagonal, 0.0f);
+                if (distance <= Radius)
+                    candidates.push_back(std::make_pair(distance, i));
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            for (unsigned int i = 0; i < models.size(); i++)
+                models[i].Wanted = false;
+            wanted.clear();
+            BudgetLimited = false;
+            size_t cpu = 0, gpu = 0;
+            for (unsigned int c = 0; c < candidates.size(); c++)
+            {
+                const SceneCell &cell = scene.Cells[candidates[c].second];
+                size_t extraCpu = 0, extraGpu = 0;
+                for (unsigned int m = 0; m < cell.Models.size(); m++)
+                {
+                    const ModelSlot &slot = models[cell.Models[m]];
+                    if (!slot.Wanted && slot.Measured)
+                    {
+                        extraCpu += slot.CpuBytes;
+                        extraGpu += slot.GpuBytes;
+                    }
+                }
+                if (cpu + extraCpu > CpuBudget || gpu + extraGpu > GpuBudget)
+                {
+                    BudgetLimited = true;
+                    break; // strictly nearest first, farther cells would only take the place of nearer ones
+                }
+                cpu += extraCpu;
+                gpu += extraGpu;
+                for (unsigned int m = 0; m < cell.Models.size(); m++)
+                {
+                    ModelSlot &slot = models[cell.Models[m]];
+                    if (!slot.Wanted)
+                        slot.Priority = candidates[c].first;
+                    slot.Wanted = true;
+                }
+                wanted.push_back(candidates[c].second);
+            }
+            WantedCells = (unsigned int)wanted.size();
+        }
+
+        // loads wanted models nearest first, drops the others
+        void updateModels()
+        {
+            for (unsigned int i = 0; i < models.size(); i++)
+            {
+                ModelSlot &slot = models[i];
+                if (slot.Wanted)
+                {
+                    if (!slot.Handle)
+                        slot.Handle = loader.Load(scene.Models[i].Path, slot.Priority);
+                    else if (!slot.Handle->Ready())
+                        loader.SetPriority(slot.Handle, slot.Priority);
+                }
+                else if (slot.Handle)
+                {
+                    // cancels the load, or releases the GL objects of a ready model
+                    if (slot.Handle->Ready())
+                        Releases++;
+                    slot.Handle.reset();
+                }
+            }
+        }
+
+        void gatherResident()
+        {
+            // both keep their capacity, so an unchanged set doesn't allocate
+            previousResident.swap(resident);
+            resident.clear();
+            for (unsigned int c = 0; c < wanted.size(); c++)
+            {
+                const SceneCell &cell = scene.Cells[wanted[c]];
+                bool ready = true;
+                for (unsigned int m = 0; m < cell.Models.size(); m++)
+                    ready &= done(models[cell.Models[m]]);
+                if (ready)
+                    resident.push_back(wanted[c]);
+            }
+            std::sort(resident.begin(), resident.end());
+            changed = resident != previousResident;
+            if (changed)
+            {
+                instances.clear();
+                lights.clear();
+                for (unsigned int c = 0; c < resident.size(); c++)
+                {
+                    const SceneCell &cell = scene.Cells[resident[c]];
+                    for (unsigned int i = 0; i < cell.Instances.size(); i++)
+                    {
+                        StreamedInstance instance;
+                        instance.Instance = &scene.Instances[cell.Instances[i]];
+                        instance.ModelIndex = instance.Instance->Model;
+                        instance.Loaded = Resident(instance.ModelIndex);
+                        if (instance.Loaded) // models that failed to load are left out
+                            instances.push_back(instance);
+                    }
+                    lights.insert(lights.end(), cell.Lights.begin(), cell.Lights.end());
+                }
+            }
+            ResidentCells = (unsigned int)resident.size();
+
+            // the cells still loading show their instances as bounding boxes
+            placeholders.clear();
+            for (unsigned int c = 0; c < wanted.size(); c++)
+            {
+                if (std::binary_search(resident.begin(), resident.end(), wanted[c]))
+                    continue;
+                const SceneCell &cell = scene.Cells[wanted[c]];
+                for (unsigned int i = 0; i < cell.Instances.size(); i++)
+                {
+                    const ModelSlot &slot = models[scene.Instances[cell.Instances[i]].Model];
+                    if (!slot.Measured)
+                        continue;
+                    StreamedPlaceholder placeholder;
+                    placeholder.Instance = &scene.Instances[cell.Instances[i]];
+                    placeholder.ModelIndex = placeholder.Instance->Model;
+                    placeholder.BoundsMin = slot.BoundsMin;
+                    placeholder.BoundsMax = slot.BoundsMax;
+                    placeholder.Progress = slot.Handle ? slot.Handle->Progress() : 0.0f;
+                    placeholders.push_back(placeholder);
+                }
+            }
+
+            ResidentModels = 0;
+            LoadsInFlight = loader.InFlight();
+            Uploads = loader.Uploads;
+            CpuBytes = GpuBytes = 0;
+            for (unsigned int i = 0; i < models.size(); i++)
+            {
+                const ModelSlot &slot = models[i];
+                if (!slot.Handle || sharedWithEarlier(i))
+                    continue;
+                if (slot.Handle->Ready())
+                    ResidentModels++;
+                CpuBytes += slot.Handle->CpuBytes();
+                GpuBytes += slot.Handle->GpuBytes();
+            }
+        }
+
+        // scene models with the same file share their handle, count it once
+        bool sharedWithEarlier(unsigned int index) const
+        {
+            for (unsigned int i = 0; i < index; i++)
+                if (models[i].Handle == models[index].Handle)
+                    return true;
+            return false;
+        }
+
+        // ready, or failed for good: a cell doesn't wait for models that can't be loaded
+        static bool done(const ModelSlot &slot)
+        {
+            return slot.Handle && (slot.Handle->Ready() || slot.Handle->State() == MODEL_LOAD_FAILED);
+        }
+};
+#endif
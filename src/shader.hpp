@@ -1,8 +1,10 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <algorithm>
 #include <string>
 #include <fstream>
+#include <map>
 #include <sstream>
 #include <iostream>
 
@@ -10,18 +12,92 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_state.hpp"
+#include "load_profiler.hpp"
+#include "material.hpp"
+
+// Preprocessor symbols a shader variant is compiled with: feature keywords (#define DIR_LIGHT) and integer
+// constants (#define POINT_LIGHTS 4), inserted right after the #version line of every stage
+class ShaderDefines
+{
+    public:
+        ShaderDefines &Keyword(const std::string &name, bool enabled = true)
+        {
+            if (enabled)
+                values[name] = "";
+            else
+                values.erase(name);
+            return *this;
+        }
+
+        ShaderDefines &Constant(const std::string &name, int value)
+        {
+            std::ostringstream text;
+            text << value;
+            values[name] = text.str();
+            return *this;
+        }
+
+        void Clear()
+        {
+            values.clear();
+        }
+
+        // identifies the variant, e.g. "BAKED_LIGHTING DIR_LIGHT POINT_LIGHTS=4"; sorted, so the order of the
+        // calls above doesn't matter
+        std::string Key() const
+        {
+            std::string key;
+            for (std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+            {
+                if (!key.empty())
+                    key += ' ';
+                key += it->second.empty() ? it->first : it->first + "=" + it->second;
+            }
+            return key;
+        }
+
+        // the source with the #define lines after its #version line, a #line directive keeps the compiler's line
+        // numbers those of the file
+        std::string Apply(const std::string &source) const
+        {
+            if (values.empty())
+                return source;
+            size_t versionLine = source.find("#version");
+            size_t insert = versionLine == std::string::npos ? std::string::npos : source.find('\n', versionLine);
+            if (insert == std::string::npos)
+                return source;
+            insert++;
+            std::ostringstream defines;
+            for (std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it)
+                defines << "#define " << it->first << (it->second.empty() ? "" : " ") << it->second << "\n";
+            unsigned int nextLine = (unsigned int)std::count(source.begin(), source.begin() + insert, '\n') + 1;
+            defines << "#line " << nextLine << "\n";
+            return source.substr(0, insert) + defines.str() + source.substr(insert);
+        }
+
+    private:
+        std::map<std::string, std::string> values;
+};
+
 class Shader
 {
     public:
         GLuint ID;
 
-        Shader(const char* vertexPath, const char* fragmentPath)
+        Shader()
+            : ID(0)
+        {
+        }
+
+        Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines())
         {
             // 1. retrieve the vertex/fragment source code from filePath
             std::string vertexCode;
             std::string fragmentCode;
             std::ifstream vShaderFile;
             std::ifstream fShaderFile;
+            LoadTimer read(LOAD_SHADER_READ, fragmentPath);
             // ensure ifstream objects can throw exceptions:
             vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
             fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
@@ -38,19 +114,62 @@ class Shader
                 vShaderFile.close();
                 fShaderFile.close();
                 // convert stream into string
-                vertexCode   = vShaderStream.str();
-                fragmentCode = fShaderStream.str();
+                vertexCode   = defines.Apply(vShaderStream.str());
+                fragmentCode = defines.Apply(fShaderStream.str());
             }
-            catch (std::ifstream::failure e)
+            catch (const std::ifstream::failure &e)
             {
                 std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
             }
+            read.Bytes(vertexCode.size() + fragmentCode.size());
+            read.Stop();
             const GLchar* vShaderCode = vertexCode.c_str();
             const GLchar* fShaderCode = fragmentCode.c_str();
             // 2. compile shaders
+            LoadTimer compile(LOAD_SHADER_COMPILE, fragmentPath, true);
+            compile.Bytes(vertexCode.size() + fragmentCode.size());
             this->Compile(vShaderCode, fShaderCode);
         }
 
+        // compute shader program, needs a 4.3 context
+        explicit Shader(const char* computePath)
+        {
+            std::string computeCode;
+            std::ifstream cShaderFile;
+            LoadTimer read(LOAD_SHADER_READ, computePath);
+            cShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+            try
+            {
+                cShaderFile.open(computePath);
+                std::stringstream cShaderStream;
+                cShaderStream << cShaderFile.rdbuf();
+                cShaderFile.close();
+                computeCode = cShaderStream.str();
+            }
+            catch (const std::ifstream::failure &e)
+            {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            }
+            read.Bytes(computeCode.size());
+            read.Stop();
+            LoadTimer compile(LOAD_SHADER_COMPILE, computePath, true);
+            compile.Bytes(computeCode.size());
+            this->CompileCompute(computeCode.c_str());
+        }
+
+        void CompileCompute(const GLchar *computeSource)
+        {
+            GLuint sCompute = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(sCompute, 1, &computeSource, NULL);
+            glCompileShader(sCompute);
+            checkCompileErrors(sCompute, "COMPUTE");
+            this->ID = glCreateProgram();
+            glAttachShader(this->ID, sCompute);
+            glLinkProgram(this->ID);
+            checkCompileErrors(this->ID, "PROGRAM");
+            glDeleteShader(sCompute);
+        }
+
         void Compile(const GLchar *vertexSource, const GLchar *fragmentSource)
         {
             GLuint sVertex, sFragment;
@@ -71,6 +190,8 @@ class Shader
             // Link Program
             glLinkProgram(this->ID);
             checkCompileErrors(this->ID, "PROGRAM");
+            // the material textures are always on the same units, see Material
+            Material::BindSamplers(this->ID);
             // Delete the shaders as they're linked into our program now and no longer necessery
             glDeleteShader(sVertex);
             glDeleteShader(sFragment);
@@ -78,63 +199,72 @@ class Shader
 
         Shader &Use()
         {
-            glUseProgram(this->ID);
+            GLState().UseProgram(this->ID);
             return *this;
         }
 
-        void SetFloat(const std::string &name, GLfloat value, GLboolean useShader = false)
+        void SetFloat(const char *name, GLfloat value, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform1f(glGetUniformLocation(this->ID, name.c_str()), value);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform1f(glGetUniformLocation(this->ID, name), value);
         }
-        void SetInteger(const std::string &name, GLint value, GLboolean useShader = false)
+        void SetInteger(const char *name, GLint value, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform1i(glGetUniformLocation(this->ID, name.c_str()), value);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform1i(glGetUniformLocation(this->ID, name), value);
         }
-        void SetVector2f(const std::string &name, GLfloat x, GLfloat y, GLboolean useShader = false)
+        void SetVector2f(const char *name, GLfloat x, GLfloat y, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform2f(glGetUniformLocation(this->ID, name.c_str()), x, y);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform2f(glGetUniformLocation(this->ID, name), x, y);
         }
-        void SetVector2f(const std::string &name, const glm::vec2 &value, GLboolean useShader = false)
+        void SetVector2f(const char *name, const glm::vec2 &value, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform2f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform2f(glGetUniformLocation(this->ID, name), value.x, value.y);
         }
-        void SetVector3f(const std::string &name, GLfloat x, GLfloat y, GLfloat z, GLboolean useShader = false)
+        void SetVector3f(const char *name, GLfloat x, GLfloat y, GLfloat z, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform3f(glGetUniformLocation(this->ID, name.c_str()), x, y, z);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform3f(glGetUniformLocation(this->ID, name), x, y, z);
         }
-        void SetVector3f(const std::string &name, const glm::vec3 &value, GLboolean useShader = false)
+        void SetVector3f(const char *name, const glm::vec3 &value, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform3f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y, value.z);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform3f(glGetUniformLocation(this->ID, name), value.x, value.y, value.z);
         }
-        void SetVector4f(const std::string &name, GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLboolean useShader = false)
+        void SetVector4f(const char *name, GLfloat x, GLfloat y, GLfloat z, GLfloat w, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform4f(glGetUniformLocation(this->ID, name.c_str()), x, y, z, w);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform4f(glGetUniformLocation(this->ID, name), x, y, z, w);
         }
-        void SetVector4f(const std::string &name, const glm::vec4 &value, GLboolean useShader = false)
+        void SetVector4f(const char *name, const glm::vec4 &value, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniform4f(glGetUniformLocation(this->ID, name.c_str()), value.x, value.y, value.z, value.w);
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniform4f(glGetUniformLocation(this->ID, name), value.x, value.y, value.z, value.w);
         }
-        void SetMatrix4(const std::string &name, const glm::mat4 &matrix, GLboolean useShader = false)
+        void SetMatrix4(const char *name, const glm::mat4 &matrix, GLboolean useShader = false)
         {
             if (useShader)
                 this->Use();
-            glUniformMatrix4fv(glGetUniformLocation(this->ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+            RenderStats().Count(STAT_UNIFORM_UPLOADS);
+            glUniformMatrix4fv(glGetUniformLocation(this->ID, name), 1, GL_FALSE, glm::value_ptr(matrix));
         }
 
     private:
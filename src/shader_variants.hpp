@@ -0,0 +1,83 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "gl_state.hpp"
+#include "shader.hpp"
+
+// The specialised programs of a vertex/fragment shader pair: each set of ShaderDefines is compiled the first time
+// it is asked for and cached by its key, so that feature switches and light counts are compile-time constants of
+// the program in use instead of uniforms branched on per fragment.
+class ShaderVariants
+{
+    public:
+        typedef std::function<void(Shader&)> SetupFunction;
+
+        unsigned int Compiled; // variants compiled so far
+
+        ShaderVariants()
+            : Compiled(0)
+        {
+        }
+
+        ShaderVariants(const std::string &vertexPath, const std::string &fragmentPath)
+            : Compiled(0), vertexPath(vertexPath), fragmentPath(fragmentPath)
+        {
+        }
+
+        ~ShaderVariants()
+        {
+            Release();
+        }
+
+        // points the variants at a shader pair, dropping the ones compiled so far
+        void Init(const std::string &vertexPath, const std::string &fragmentPath)
+        {
+            Release();
+            this->vertexPath = vertexPath;
+            this->fragmentPath = fragmentPath;
+        }
+
+        void Release()
+        {
+            for (std::map<std::string, Shader>::iterator it = variants.begin(); it != variants.end(); ++it)
+                GLState().DeleteProgram(it->second.ID);
+            variants.clear();
+        }
+
+        // runs on every newly compiled variant, e.g. to point its samplers at their texture units
+        void OnCompile(const SetupFunction &setup)
+        {
+            this->setup = setup;
+            for (std::map<std::string, Shader>::iterator it = variants.begin(); it != variants.end(); ++it)
+                setup(it->second.Use());
+        }
+
+        // the program for the given defines, compiled on first use
+        Shader &Get(const ShaderDefines &defines)
+        {
+            std::string key = defines.Key();
+            std::map<std::string, Shader>::iterator found = variants.find(key);
+            if (found != variants.end())
+                return found->second;
+            Shader &shader = variants[key];
+            shader = Shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+            Compiled++;
+            std::cout << "compiled " << fragmentPath << " [" << key << "]" << std::endl;
+            if (setup)
+                setup(shader.Use());
+            return shader;
+        }
+
+    private:
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::map<std::string, Shader> variants;
+        SetupFunction setup;
+};
+
+#endif
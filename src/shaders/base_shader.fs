@@ -6,7 +6,18 @@ uniform sampler2D texture_normal1;
 uniform sampler2D texture_specular1;
 uniform sampler2D texture_emission1;
 
+// variant defines (ShaderVariants):
+//   DIR_LIGHT           the directional light is on
+//   BAKED_LIGHTING      the irradiance grid holds the ambient and diffuse light of the static lights
+//   POINT_LIGHTS        point light slots in use, the others are left out
+//   BAKED_POINT_LIGHTS  how many of them, the last ones, are baked: only their specular is added here
 #define NR_POINT_LIGHTS 10
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS NR_POINT_LIGHTS
+#endif
+#ifndef BAKED_POINT_LIGHTS
+#define BAKED_POINT_LIGHTS 0
+#endif
 struct PointLight {
     vec3 Position;
     vec3 Color;
@@ -28,8 +39,14 @@ uniform vec3 viewPos;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform DirLight dirLight;
 
-uniform bool dirLightFlag;
-uniform bool bumpFlag;
+#ifdef BAKED_LIGHTING
+// baked static lights (IrradianceGrid), the light reaching a probe is in the first component of each channel
+uniform sampler3D irradianceRed;
+uniform sampler3D irradianceGreen;
+uniform sampler3D irradianceBlue;
+uniform vec3 irradianceMin;
+uniform vec3 irradianceExtent;
+#endif
 
 in vec3 TangentLightPos[NR_POINT_LIGHTS];
 
@@ -44,6 +61,7 @@ in VS_OUT {
 
 vec3 CalcPointLight(PointLight light, vec3 tangentLightPos, vec3 viewDir, vec3 bump, vec3 diffuseSample, vec3 normalSample, vec3 specularSample, vec3 emissionSample);
 vec3 CalcDirLight(DirLight light, vec3 viewDir, vec3 bump, vec3 diffuseSample, vec3 normalSample, vec3 specularSample, vec3 emissionSample);
+vec3 CalcBakedPointLight(PointLight light, vec3 tangentLightPos, vec3 viewDir, vec3 bump, vec3 specularSample, vec3 emissionSample);
 
 void main()
 {
@@ -59,15 +77,21 @@ void main()
     vec3 bump = normalize(normalSample * 2.0 - 1.0);
     float diff = max(dot(viewDir, bump), 0.0);
 
+#ifdef DIR_LIGHT
+    vec3 result = CalcDirLight(dirLight, viewDir, bump, diffuseSample, normalSample, specularSample, emissionSample);
+#else
     vec3 result = vec3(0.01);
-    if (dirLightFlag)
-    {
-        result = CalcDirLight(dirLight, viewDir, bump, diffuseSample, normalSample, specularSample, emissionSample);
-    }
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-    {
+#endif
+#ifdef BAKED_LIGHTING
+    // the point lights' diffuse term doesn't depend on the light direction here, the baked light is enough
+    vec3 uvw = (fs_in.FragPos - irradianceMin) / irradianceExtent;
+    vec3 received = vec3(texture(irradianceRed, uvw).x, texture(irradianceGreen, uvw).x, texture(irradianceBlue, uvw).x);
+    result += received * (1.0 + diff) * diffuseSample;
+#endif
+    for(int i = 0; i < POINT_LIGHTS - BAKED_POINT_LIGHTS; i++)
         result += CalcPointLight(pointLights[i], TangentLightPos[i], viewDir, bump, diffuseSample, normalSample, specularSample, emissionSample);
-    }
+    for(int i = POINT_LIGHTS - BAKED_POINT_LIGHTS; i < POINT_LIGHTS; i++)
+        result += CalcBakedPointLight(pointLights[i], TangentLightPos[i], viewDir, bump, specularSample, emissionSample);
     FragColor = vec4(result, 1.0);
 }
 
@@ -100,6 +124,17 @@ vec3 CalcPointLight(PointLight light, vec3 tangentLightPos, vec3 viewDir, vec3 b
     return (ambientColor + diffuseColor + specularColor + emissionSample);
 }
 
+// the specular part of a baked point light, its ambient and diffuse light are in the irradiance grid
+vec3 CalcBakedPointLight(PointLight light, vec3 tangentLightPos, vec3 viewDir, vec3 bump, vec3 specularSample, vec3 emissionSample)
+{
+    vec3 lightDir   = normalize(tangentLightPos - fs_in.TangentFragPos);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(bump, halfwayDir), 0.0), 16.0);
+    float dist = length(light.Position - fs_in.FragPos);
+    float attenuation = 1.0 / (1.0 + light.Linear * dist + light.Quadratic * (dist * dist));
+    return light.Color * spec * specularSample * attenuation + emissionSample;
+}
+
 // calculates the fragment color when using a directional light.
 vec3 CalcDirLight(DirLight light, vec3 viewDir, vec3 bump, vec3 diffuseSample, vec3 normalSample, vec3 specularSample, vec3 emissionSample)
 {
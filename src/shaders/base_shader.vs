@@ -1,4 +1,15 @@
 #version 330 core
+#ifdef MULTI_VIEW
+// one instance per view, routed to its viewport from here where the driver allows it (see multi_view.hpp)
+#if defined(ARB_VIEWPORT_LAYER_ARRAY)
+#extension GL_ARB_shader_viewport_layer_array : require
+#define VIEWPORT_INDEX
+#elif defined(AMD_VERTEX_SHADER_VIEWPORT_INDEX)
+#extension GL_AMD_vertex_shader_viewport_index : require
+#define VIEWPORT_INDEX
+#endif
+#define MAX_VIEWS 4
+#endif
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -8,10 +19,18 @@ layout (location = 4) in vec3 aBitangent;
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+#ifdef MULTI_VIEW
+uniform mat4 viewProjections[MAX_VIEWS];
+uniform vec3 viewPositions[MAX_VIEWS];
+uniform int viewOffset; // the view drawn, when the views are drawn one after the other
+#endif
 
 uniform vec3 viewPos;
 
 #define NR_POINT_LIGHTS 10
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS NR_POINT_LIGHTS // slots in use, see base_shader.fs
+#endif
 struct PointLight {
     vec3 Position;
     vec3 Color;
@@ -42,8 +61,17 @@ out VS_OUT {
     vec3 TangentFragPos;
 } vs_out;
 
+// must match depth_prepass.vs so the colour pass can use GL_EQUAL depth testing
+invariant gl_Position;
+
 void main()
 {
+#ifdef MULTI_VIEW
+    int viewIndex = gl_InstanceID + viewOffset;
+    vec3 eyePos = viewPositions[viewIndex];
+#else
+    vec3 eyePos = viewPos;
+#endif
     mat3 normalMatrix = transpose(inverse(mat3(model)));
     vec3 T = normalize(normalMatrix * aTangent);
     vec3 N = normalize(normalMatrix * aNormal);
@@ -56,13 +84,20 @@ void main()
     vs_out.TexCoords = aTexCoords;
     vs_out.Normal = normalMatrix * aNormal;
     vs_out.TangentLightPos = TBN * dirLight.Direction;
-    vs_out.TangentViewPos  = TBN * viewPos;
+    vs_out.TangentViewPos  = TBN * eyePos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
 
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
+    for(int i = 0; i < POINT_LIGHTS; i++)
     {
         TangentLightPos[i] = TBN * pointLights[i].Position;
     }
 
+#ifdef MULTI_VIEW
+    gl_Position = viewProjections[viewIndex] * model * vec4(aPos, 1.0);
+#ifdef VIEWPORT_INDEX
+    gl_ViewportIndex = viewIndex;
+#endif
+#else
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+#endif
+}
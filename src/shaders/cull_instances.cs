@@ -0,0 +1,99 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// matches DrawElementsIndirectCommand, 20 bytes per record
+struct DrawCommand
+{
+    uint Count;
+    uint InstanceCount;
+    uint FirstIndex;
+    int BaseVertex;
+    uint BaseInstance;
+};
+
+struct Instance
+{
+    mat4 Model;
+    vec4 BoundingSphere; // model space center and radius
+    uint FirstCommand;   // commands of the instance's model
+    uint CommandCount;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout (std430, binding = 1) buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 2) writeonly buffer Visible { uint visible[]; };
+layout (std430, binding = 3) buffer Counter { uint visibleInstances; };
+
+uniform uint instanceCount;
+uniform vec4 frustumPlanes[6];
+
+// previous frame's depth pyramid
+uniform bool hiZEnabled;
+uniform sampler2D hiZ;
+uniform mat4 hiZViewProjection;
+uniform ivec2 hiZSize; // level 0 size of the rendered region
+uniform int hiZLevels;
+
+bool occludedByHiZ(vec3 center, float radius)
+{
+    // screen rectangle and nearest depth of the sphere's bounding box, as seen by the previous frame
+    vec2 ndcMin = vec2(1.0);
+    vec2 ndcMax = vec2(-1.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hiZViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0)
+            return false; // crosses the camera plane, no usable rectangle
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+    // outside of what the previous frame saw: nothing is known about it
+    if (any(lessThan(ndcMax, vec2(-1.0))) || any(greaterThan(ndcMin, vec2(1.0))))
+        return false;
+
+    vec2 texMin = clamp(ndcMin * 0.5 + 0.5, 0.0, 1.0) * vec2(hiZSize);
+    vec2 texMax = clamp(ndcMax * 0.5 + 0.5, 0.0, 1.0) * vec2(hiZSize);
+    // pick the level where the rectangle spans at most 2x2 texels
+    float extent = max(texMax.x - texMin.x, texMax.y - texMin.y);
+    int level = clamp(int(ceil(log2(max(extent, 1.0)))), 0, hiZLevels - 1);
+    ivec2 levelSize = hiZSize;
+    for (int l = 0; l < level; l++)
+        levelSize = max(levelSize / 2, ivec2(1));
+    ivec2 p0 = min(ivec2(texMin) >> level, levelSize - 1);
+    ivec2 p1 = min(ivec2(texMax) >> level, levelSize - 1);
+    float farthest = max(max(texelFetch(hiZ, p0, level).r, texelFetch(hiZ, ivec2(p1.x, p0.y), level).r),
+                         max(texelFetch(hiZ, ivec2(p0.x, p1.y), level).r, texelFetch(hiZ, p1, level).r));
+    return nearest * 0.5 + 0.5 > farthest;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= instanceCount)
+        return;
+
+    Instance instance = instances[index];
+    vec3 center = (instance.Model * vec4(instance.BoundingSphere.xyz, 1.0)).xyz;
+    float scale = max(length(instance.Model[0].xyz), max(length(instance.Model[1].xyz), length(instance.Model[2].xyz)));
+    float radius = instance.BoundingSphere.w * scale;
+
+    // frustum test against the current camera
+    for (int i = 0; i < 6; i++)
+        if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+            return;
+    // occlusion test; the sphere is rotation invariant so an instance never hides behind its own last frame
+    if (hiZEnabled && occludedByHiZ(center, radius))
+        return;
+
+    atomicAdd(visibleInstances, 1u);
+    // append the instance to the commands of its model's meshes, instanced attribute fetches start at BaseInstance
+    for (uint c = instance.FirstCommand; c < instance.FirstCommand + instance.CommandCount; c++)
+    {
+        uint slot = atomicAdd(commands[c].InstanceCount, 1u);
+        visible[commands[c].BaseInstance + slot] = index;
+    }
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+void main()
+{
+    // depth only, colour writes are masked off during the pre-pass
+}
\ No newline at end of file
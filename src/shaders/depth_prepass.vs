@@ -0,0 +1,38 @@
+#version 330 core
+#ifdef MULTI_VIEW
+// one instance per view, routed to its viewport from here where the driver allows it (see multi_view.hpp)
+#if defined(ARB_VIEWPORT_LAYER_ARRAY)
+#extension GL_ARB_shader_viewport_layer_array : require
+#define VIEWPORT_INDEX
+#elif defined(AMD_VERTEX_SHADER_VIEWPORT_INDEX)
+#extension GL_AMD_vertex_shader_viewport_index : require
+#define VIEWPORT_INDEX
+#endif
+#define MAX_VIEWS 4
+#endif
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+#ifdef MULTI_VIEW
+uniform mat4 viewProjections[MAX_VIEWS];
+uniform vec3 viewPositions[MAX_VIEWS];
+uniform int viewOffset; // the view drawn, when the views are drawn one after the other
+#endif
+
+// must produce bit-identical depth to base_shader.vs for the GL_EQUAL colour pass
+invariant gl_Position;
+
+void main()
+{
+#ifdef MULTI_VIEW
+    int viewIndex = gl_InstanceID + viewOffset;
+    gl_Position = viewProjections[viewIndex] * model * vec4(aPos, 1.0);
+#ifdef VIEWPORT_INDEX
+    gl_ViewportIndex = viewIndex;
+#endif
+#else
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
+}
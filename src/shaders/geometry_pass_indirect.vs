@@ -0,0 +1,35 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in uint aInstance; // index written by cull_instances.cs
+
+struct Instance
+{
+    mat4 Model;
+    vec4 BoundingSphere;
+    uint FirstCommand;
+    uint CommandCount;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    mat4 model = instances[aInstance].Model;
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    FragPos = worldPos.xyz;
+    TexCoords = aTexCoords;
+
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    Normal = normalMatrix * aNormal;
+
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,35 @@
+#version 430 core
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) uniform writeonly image2D destination;
+
+uniform sampler2D source;
+uniform int sourceLevel; // -1 copies level 0 from the depth buffer
+uniform ivec2 sourceSize;
+uniform ivec2 destinationSize;
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(p, destinationSize)))
+        return;
+
+    if (sourceLevel < 0)
+    {
+        imageStore(destination, p, vec4(texelFetch(source, p, 0).r));
+        return;
+    }
+
+    // farthest depth of the 2x2 footprint; for odd source sizes the last texel also covers the leftover row/column
+    ivec2 base = p * 2;
+    ivec2 extent = ivec2(2);
+    if (p.x == destinationSize.x - 1 && (sourceSize.x & 1) != 0)
+        extent.x = 3;
+    if (p.y == destinationSize.y - 1 && (sourceSize.y & 1) != 0)
+        extent.y = 3;
+    float farthest = 0.0;
+    for (int y = 0; y < extent.y; y++)
+        for (int x = 0; x < extent.x; x++)
+            farthest = max(farthest, texelFetch(source, min(base + ivec2(x, y), sourceSize - 1), sourceLevel).r);
+    imageStore(destination, p, vec4(farthest));
+}
@@ -7,6 +7,17 @@ uniform sampler2D gPosition;
 uniform sampler2D gNormal;
 uniform sampler2D gAlbedoSpec;
 
+// variant defines (ShaderVariants):
+//   BAKED_LIGHTING      the irradiance grid holds the ambient and diffuse light of the static lights
+//   POINT_LIGHTS        point light slots in use, the others are left out
+//   BAKED_POINT_LIGHTS  how many of them, the last ones, are baked: only their specular is added here
+#define NR_LIGHTS 10
+#ifndef POINT_LIGHTS
+#define POINT_LIGHTS NR_LIGHTS
+#endif
+#ifndef BAKED_POINT_LIGHTS
+#define BAKED_POINT_LIGHTS 0
+#endif
 struct PointLight {
     vec3 Position;
     vec3 Color;
@@ -14,10 +25,29 @@ struct PointLight {
     float Linear;
     float Quadratic;
 };
-const int NR_LIGHTS = 10;
 uniform PointLight pointLights[NR_LIGHTS];
 uniform vec3 viewPos;
 
+#ifdef BAKED_LIGHTING
+// baked static lights (IrradianceGrid): per channel the light reaching a probe and the sum of its directions
+uniform sampler3D irradianceRed;
+uniform sampler3D irradianceGreen;
+uniform sampler3D irradianceBlue;
+uniform vec3 irradianceMin;
+uniform vec3 irradianceExtent;
+
+vec3 BakedIrradiance(vec3 position, vec3 normal)
+{
+    vec3 uvw = (position - irradianceMin) / irradianceExtent;
+    vec4 red = texture(irradianceRed, uvw);
+    vec4 green = texture(irradianceGreen, uvw);
+    vec4 blue = texture(irradianceBlue, uvw);
+    vec3 ambient = vec3(red.x, green.x, blue.x);
+    vec3 diffuse = max(vec3(dot(normal, red.yzw), dot(normal, green.yzw), dot(normal, blue.yzw)), 0.0);
+    return ambient + diffuse;
+}
+#endif
+
 void main()
 {
     // retrieve data from gbuffer
@@ -29,7 +59,10 @@ void main()
     // then calculate lighting as usual
     vec3 lighting = vec3(0.01);; // hard-coded ambient component
     vec3 viewDir = normalize(viewPos - FragPos);
-    for(int i = 0; i < NR_LIGHTS; ++i)
+#ifdef BAKED_LIGHTING
+    lighting += Diffuse * BakedIrradiance(FragPos, Normal);
+#endif
+    for(int i = 0; i < POINT_LIGHTS - BAKED_POINT_LIGHTS; ++i)
     {
         // ambient
         vec3 ambient = Diffuse * pointLights[i].Color;
@@ -48,5 +81,14 @@ void main()
         specular *= attenuation;
         lighting += ambient + diffuse + specular;
     }
+    for(int i = POINT_LIGHTS - BAKED_POINT_LIGHTS; i < POINT_LIGHTS; ++i)
+    {
+        vec3 lightDir = normalize(pointLights[i].Position - FragPos);
+        vec3 halfwayDir = normalize(lightDir + viewDir);
+        float spec = pow(max(dot(Normal, halfwayDir), 0.0), 16.0);
+        float distance = length(pointLights[i].Position - FragPos);
+        float attenuation = 1.0 / (1.0 + pointLights[i].Linear * distance + pointLights[i].Quadratic * distance * distance);
+        lighting += pointLights[i].Color * spec * Specular * attenuation;
+    }
     FragColor = vec4(lighting, 1.0);
 }
\ No newline at end of file
@@ -4,8 +4,11 @@ layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
+// fraction of the g-buffer covered by the current render resolution
+uniform vec2 uvScale;
+
 void main()
 {
-    TexCoords = aTexCoords;
+    TexCoords = aTexCoords * uvScale;
     gl_Position = vec4(aPos, 1.0);
 }
\ No newline at end of file
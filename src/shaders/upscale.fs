@@ -0,0 +1,45 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneColor;
+// fraction of the scene texture covered by the current render resolution
+uniform vec2 uvScale;
+// size in texels of the whole scene texture
+uniform vec2 sceneSize;
+// 0: bilinear, 1: edge-aware
+uniform int filterMode;
+
+float luma(vec3 color)
+{
+    return dot(color, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    // keep the bilinear footprint inside the rendered sub-rectangle
+    vec2 uv = min(TexCoords, uvScale - 0.5 / sceneSize);
+    vec3 bilinear = texture(sceneColor, uv).rgb;
+    if (filterMode == 0)
+    {
+        FragColor = vec4(bilinear, 1.0);
+        return;
+    }
+
+    // edge-aware: re-weight the 2x2 bilinear footprint so that texels on the other side of a
+    // luminance edge contribute less, which keeps silhouettes sharp when upscaling
+    vec2 texel = uv * sceneSize - 0.5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = fract(texel);
+    ivec2 maxTexel = ivec2(uvScale * sceneSize) - 1;
+    vec3 c00 = texelFetch(sceneColor, clamp(base,                 ivec2(0), maxTexel), 0).rgb;
+    vec3 c10 = texelFetch(sceneColor, clamp(base + ivec2(1, 0),   ivec2(0), maxTexel), 0).rgb;
+    vec3 c01 = texelFetch(sceneColor, clamp(base + ivec2(0, 1),   ivec2(0), maxTexel), 0).rgb;
+    vec3 c11 = texelFetch(sceneColor, clamp(base + ivec2(1, 1),   ivec2(0), maxTexel), 0).rgb;
+    float l = luma(bilinear);
+    vec4 w = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    w *= 1.0 / (1.0 + 8.0 * abs(vec4(luma(c00), luma(c10), luma(c01), luma(c11)) - l));
+    vec3 result = (c00 * w.x + c10 * w.y + c01 * w.z + c11 * w.w) / max(w.x + w.y + w.z + w.w, 1e-5);
+    FragColor = vec4(result, 1.0);
+}
\ No newline at end of file
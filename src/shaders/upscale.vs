@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+
+// fraction of the scene texture covered by the current render resolution
+uniform vec2 uvScale;
+
+void main()
+{
+    TexCoords = aTexCoords * uvScale;
+    gl_Position = vec4(aPos, 1.0);
+}
\ No newline at end of file
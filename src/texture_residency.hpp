@@ -0,0 +1,384 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Default residency values
+const size_t TEXTURE_RESIDENCY_BUDGET = 256 * 1024 * 1024;
+const unsigned int TEXTURE_RESIDENCY_EVICT_AFTER_FRAMES = 120; // unused for this long, a texture only keeps a thumbnail
+const int TEXTURE_RESIDENCY_THUMBNAIL_SIZE = 16;               // largest side of an evicted texture
+const unsigned int TEXTURE_RESIDENCY_SHRINKS_PER_FRAME = 4;    // each one reads a mip level back
+const unsigned int TEXTURE_RESIDENCY_UPLOADS_PER_FRAME = 2;
+
+// Keeps the material textures within a video memory budget. Every texture starts at full resolution; each frame
+// the renderer reports the on-screen size of what uses it (Touch), which decides how many top mips it needs.
+// When over budget, least recently used textures first lose the mips they don't need, then are reduced to a
+// thumbnail (evicted), then, as a last resort, even visible textures lose their top mip. Shrinking re-specifies
+// the texture from one of its own lower mips, so GL names stay valid; growing back (restreaming) decodes the
+// file again on a worker thread and uploads the wanted level on the render thread.
+class TextureResidencyManager
+{
+    public:
+        size_t Budget;
+        unsigned int EvictAfterFrames;
+        unsigned int ShrinksPerFrame;
+        unsigned int UploadsPerFrame;
+
+        // statistics of the last Update()
+        unsigned int TextureCount;
+        size_t ResidentBytes;
+        unsigned int Evictions;    // textures shrunk this frame
+        unsigned int Restreams;    // textures grown back this frame
+        // totals
+        unsigned int TotalEvictions;
+        unsigned int TotalRestreams;
+
+        TextureResidencyManager()
+            : Budget(TEXTURE_RESIDENCY_BUDGET), EvictAfterFrames(TEXTURE_RESIDENCY_EVICT_AFTER_FRAMES),
+              ShrinksPerFrame(TEXTURE_RESIDENCY_SHRINKS_PER_FRAME), UploadsPerFrame(TEXTURE_RESIDENCY_UPLOADS_PER_FRAME),
+              TextureCount(0), ResidentBytes(0), Evictions(0), Restreams(0), TotalEvictions(0), TotalRestreams(0),
+              frame(0), stopping(false)
+        {
+        }
+
+        ~TextureResidencyManager()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (worker.joinable())
+                worker.join();
+        }
+
+        // starts tracking a texture uploaded at full resolution from the given file
+        void Register(GLuint id, const std::string &path, int width, int height, int components)
+        {
+            if (width <= 0 || height <= 0)
+                return;
+            Entry entry;
+            entry.Path = path;
+            entry.Width = width;
+            entry.Height = height;
+            entry.Components = (components == 3 || components == 4) ? components : 1; // see TextureFromImage
+            entry.Level = 0;
+            entry.RequiredLevel = 0;
+            entry.ThumbnailLevel = 0;
+            while (std::max(width >> entry.ThumbnailLevel, height >> entry.ThumbnailLevel) > TEXTURE_RESIDENCY_THUMBNAIL_SIZE)
+                entry.ThumbnailLevel++;
+            entry.LastUse = frame;
+            entry.Pending = false;
+            entries[id] = entry;
+        }
+
+        // stops tracking a texture, call before deleting it
+        void Unregister(GLuint id)
+        {
+            entries.erase(id);
+        }
+
+        // the texture is used this frame by something covering about pixels pixels on screen
+        void Touch(GLuint id, float pixels)
+        {
+            std::map<GLuint, Entry>::iterator found = entries.find(id);
+            if (found == entries.end())
+                return;
+            Entry &entry = found->second;
+            // the sampler picks the level where one texel covers about one pixel
+            int level = 0;
+            float size = (float)std::max(entry.Width, entry.Height);
+            if (pixels > 0.0f && size > pixels)
+                level = std::min((int)std::floor(std::log2(size / pixels)), entry.ThumbnailLevel);
+            if (entry.LastUse != frame)
+                entry.RequiredLevel = level;
+            else
+                entry.RequiredLevel = std::min(entry.RequiredLevel, level);
+            entry.LastUse = frame;
+        }
+
+        // uploads finished restreams and enforces the budget; call once per frame on the thread owning the context
+        void Update()
+        {
+            Evictions = Restreams = 0;
+            uploadRestreams();
+            ResidentBytes = 0;
+            for (std::map<GLuint, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+                ResidentBytes += bytes(it->second, it->second.Level);
+            TextureCount = (unsigned int)entries.size();
+            shrink();
+            requestRestreams();
+            frame++;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string Path;
+            int Width;              // of level 0 of the source image
+            int Height;
+            int Components;
+            int Level;              // source level currently stored as the texture's level 0
+            int RequiredLevel;      // finest level the on-screen size asked for at LastUse
+            int ThumbnailLevel;     // level kept by an evicted texture
+            unsigned int LastUse;   // frame
+            bool Pending;           // restream in flight
+        };
+
+        struct Job
+        {
+            GLuint ID;
+            std::string Path;
+            int Components;
+            int Level;
+        };
+
+        struct Result
+        {
+            GLuint ID;
+            int Level;
+            int Width;
+            int Height;
+            int Components;
+            std::vector<unsigned char> Pixels;
+        };
+
+        std::map<GLuint, Entry> entries;
+        unsigned int frame;
+        std::vector<std::pair<unsigned int, GLuint> > order; // scratch, LastUse and texture
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<Job> jobs;
+        std::vector<Result> results;
+        std::thread worker;
+        bool stopping;
+
+        // level the texture should be at: what its on-screen size needs, a thumbnail when unused for a while
+        int wantedLevel(const Entry &entry) const
+        {
+            if (frame - entry.LastUse > EvictAfterFrames)
+                return entry.ThumbnailLevel;
+            return entry.RequiredLevel;
+        }
+
+        // of the texture when its largest level is level
+        static size_t bytes(const Entry &entry, int level)
+        {
+            return EstimatedTextureBytes(std::max(entry.Width >> level, 1), std::max(entry.Height >> level, 1));
+        }
+
+        static GLenum format(int components)
+        {
+            if (components == 3)
+                return GL_RGB;
+            if (components == 4)
+                return GL_RGBA;
+            return GL_RED;
+        }
+
+        // re-specifies the texture with new content for its level 0 and rebuilds the mips below it
+        static void specify(GLuint id, int width, int height, int components, const unsigned char *pixels)
+        {
+            GLenum pixelFormat = format(components);
+            GLState().BindTexture(GL_TEXTURE_2D, id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, pixelFormat, width, height, 0, pixelFormat, GL_UNSIGNED_BYTE, pixels);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            RenderStats().Count(STAT_TEXTURE_BYTES, (size_t)width * height * components);
+            RenderStats().TextureAllocated(id, GPU_MEMORY_TEXTURES, EstimatedTextureBytes(width, height));
+            // levels left over from a larger size would be inconsistent, keep them out of the mip chain
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)std::floor(std::log2((float)std::max(width, height))));
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+
+        // least recently used first
+        void sortByLastUse()
+        {
+            order.clear();
+            for (std::map<GLuint, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+                order.push_back(std::make_pair(it->second.LastUse, it->first));
+            std::sort(order.begin(), order.end());
+        }
+
+        void shrink()
+        {
+            if (ResidentBytes <= Budget)
+                return;
+            sortByLastUse();
+            // 1. drop what isn't needed, least recently used first: unused textures go down to a thumbnail
+            for (unsigned int i = 0; i < order.size() && ResidentBytes > Budget && Evictions < ShrinksPerFrame; i++)
+            {
+                Entry &entry = entries[order[i].second];
+                int wanted = wantedLevel(entry);
+                if (entry.Level < wanted)
+                    shrinkTo(order[i].second, entry, wanted);
+            }
+            // 2. still over: visible textures lose their top mip, least recently used first
+            for (unsigned int i = 0; i < order.size() && ResidentBytes > Budget && Evictions < ShrinksPerFrame; i++)
+            {
+                Entry &entry = entries[order[i].second];
+                if (entry.Level < entry.ThumbnailLevel)
+                    shrinkTo(order[i].second, entry, entry.Level + 1);
+            }
+        }
+
+        // rebuilds the texture from one of its lower mips, read back from the GPU
+        void shrinkTo(GLuint id, Entry &entry, int level)
+        {
+            int mip = level - entry.Level; // level of the current texture holding the wanted size
+            int width = std::max(entry.Width >> level, 1);
+            int height = std::max(entry.Height >> level, 1);
+            std::vector<unsigned char> pixels((size_t)width * height * entry.Components);
+            GLState().BindTexture(GL_TEXTURE_2D, id);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTexImage(GL_TEXTURE_2D, mip, format(entry.Components), GL_UNSIGNED_BYTE, &pixels[0]);
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            specify(id, width, height, entry.Components, &pixels[0]);
+            ResidentBytes -= bytes(entry, entry.Level) - bytes(entry, level);
+            entry.Level = level;
+            Evictions++;
+            TotalEvictions++;
+        }
+
+        // asks the worker for textures below the level they need, most recently used first, while the budget allows
+        void requestRestreams()
+        {
+            sortByLastUse();
+            size_t projected = ResidentBytes;
+            std::vector<Job> requests;
+            for (int i = (int)order.size() - 1; i >= 0; i--)
+            {
+                Entry &entry = entries[order[i].second];
+                int wanted = wantedLevel(entry);
+                if (entry.Pending || wanted >= entry.Level)
+                    continue;
+                size_t growth = bytes(entry, wanted) - bytes(entry, entry.Level);
+                if (projected + growth > Budget)
+                    continue;
+                projected += growth;
+                entry.Pending = true;
+                Job job;
+                job.ID = order[i].second;
+                job.Path = entry.Path;
+                job.Components = entry.Components;
+                job.Level = wanted;
+                requests.push_back(job);
+            }
+            if (requests.empty())
+                return;
+            if (!worker.joinable())
+                worker = std::thread(&TextureResidencyManager::work, this);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.insert(jobs.end(), requests.begin(), requests.end());
+            }
+            wake.notify_one();
+        }
+
+        void uploadRestreams()
+        {
+            std::vector<Result> finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                unsigned int count = std::min((unsigned int)results.size(), UploadsPerFrame);
+                finished.insert(finished.end(), results.begin(), results.begin() + count);
+                results.erase(results.begin(), results.begin() + count);
+            }
+            for (unsigned int i = 0; i < finished.size(); i++)
+            {
+                std::map<GLuint, Entry>::iterator found = entries.find(finished[i].ID);
+                if (found == entries.end())
+                    continue; // released in the meantime
+                Entry &entry = found->second;
+                entry.Pending = false;
+                if (finished[i].Pixels.empty() || finished[i].Level >= entry.Level)
+                    continue;
+                specify(finished[i].ID, finished[i].Width, finished[i].Height, finished[i].Components, &finished[i].Pixels[0]);
+                entry.Level = finished[i].Level;
+                Restreams++;
+                TotalRestreams++;
+            }
+        }
+
+        void work()
+        {
+            for (;;)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    while (!stopping && jobs.empty())
+                        wake.wait(lock);
+                    if (stopping)
+                        return;
+                    job = jobs.front();
+                    jobs.erase(jobs.begin());
+                }
+                Result result;
+                result.ID = job.ID;
+                result.Level = job.Level;
+                result.Width = result.Height = 0;
+                result.Components = job.Components;
+                int components = 0;
+                unsigned char *data = stbi_load(job.Path.c_str(), &result.Width, &result.Height, &components, job.Components);
+                if (data)
+                {
+                    result.Pixels.assign(data, data + (size_t)result.Width * result.Height * result.Components);
+                    stbi_image_free(data);
+                    for (int level = 0; level < job.Level; level++)
+                        halve(result);
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(result);
+            }
+        }
+
+        // 2x2 box filter, the last row/column is repeated for odd sizes
+        static void halve(Result &image)
+        {
+            int width = std::max(image.Width / 2, 1);
+            int height = std::max(image.Height / 2, 1);
+            int c = image.Components;
+            std::vector<unsigned char> pixels((size_t)width * height * c);
+            for (int y = 0; y < height; y++)
+            {
+                int y0 = std::min(y * 2, image.Height - 1), y1 = std::min(y * 2 + 1, image.Height - 1);
+                for (int x = 0; x < width; x++)
+                {
+                    int x0 = std::min(x * 2, image.Width - 1), x1 = std::min(x * 2 + 1, image.Width - 1);
+                    for (int k = 0; k < c; k++)
+                    {
+                        int sum = image.Pixels[((size_t)y0 * image.Width + x0) * c + k] + image.Pixels[((size_t)y0 * image.Width + x1) * c + k]
+                                + image.Pixels[((size_t)y1 * image.Width + x0) * c + k] + image.Pixels[((size_t)y1 * image.Width + x1) * c + k];
+                        pixels[((size_t)y * width + x) * c + k] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+            image.Pixels.swap(pixels);
+            image.Width = width;
+            image.Height = height;
+        }
+};
+
+// The residency manager of the current context, the engine only uses one
+inline TextureResidencyManager &TextureResidency()
+{
+    static TextureResidencyManager residency;
+    return residency;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Default worker pool values
+const unsigned int WORKER_POOL_MAX_THREADS = 64; // calling thread included
+
+// Threads shared by the CPU-parallel stages (lighting, the irradiance bake, mesh post-processing). They are
+// started the first time a job needs them and wait between jobs, so a job costs a wake-up instead of a thread
+// creation and join per thread. A job is a work-stealing loop: every thread calls work() and it takes items from a
+// shared counter until none are left, so a single call does the whole job too. One job runs at a time; a caller
+// finding the pool busy (another loader thread, or a job started from inside a job) runs its work on its own thread.
+class WorkerPool
+{
+    public:
+        WorkerPool()
+            : generation(0), active(0), pending(0), stopping(false), job(0), jobWork(0)
+        {
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (unsigned int i = 0; i < workers.size(); i++)
+                workers[i].join();
+        }
+
+        // one per core, the default of the stages' ThreadCount
+        static unsigned int HardwareThreads()
+        {
+            return std::max(1u, std::min(std::thread::hardware_concurrency(), WORKER_POOL_MAX_THREADS));
+        }
+
+        // calls work() on threads threads, the calling thread being one of them, and waits for all of them
+        template <typename Work>
+        void Run(unsigned int threads, const Work &work)
+        {
+            threads = std::min(threads, WORKER_POOL_MAX_THREADS);
+            std::unique_lock<std::mutex> running(runMutex, std::try_to_lock);
+            if (threads <= 1 || !running.owns_lock())
+            {
+                work();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (workers.size() + 1 < threads)
+                    workers.push_back(std::thread(&WorkerPool::wait, this, (unsigned int)workers.size() + 1, generation));
+                job = &invoke<Work>;
+                jobWork = &work;
+                active = threads;
+                pending = threads - 1;
+                generation++;
+            }
+            wake.notify_all();
+            work();
+            std::unique_lock<std::mutex> lock(mutex);
+            while (pending > 0)
+                finished.wait(lock);
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex runMutex; // held by the caller of the running job
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        unsigned int generation;
+        unsigned int active;  // threads of the current job, the caller included
+        unsigned int pending; // workers of the current job still running
+        bool stopping;
+        void (*job)(const void *work);
+        const void *jobWork;
+
+        template <typename Work>
+        static void invoke(const void *work)
+        {
+            (*static_cast<const Work*>(work))();
+        }
+
+        // worker index (1 and up): runs every job of a new generation that asks for at least index + 1 threads
+        void wait(unsigned int index, unsigned int seen)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                while (!stopping && generation == seen)
+                    wake.wait(lock);
+                if (stopping)
+                    return;
+                seen = generation;
+                if (index >= active)
+                    continue;
+                void (*function)(const void *) = job;
+                const void *work = jobWork;
+                lock.unlock();
+                function(work);
+                lock.lock();
+                if (--pending == 0)
+                    finished.notify_one();
+            }
+        }
+};
+
+inline WorkerPool &Workers()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+#endif